@@ -0,0 +1,232 @@
+// Minimal FastCGI responder standing in for php-fpm in benchmarks and tests.
+// Usage: fcgi_responder unix:<path> | <port>
+// Serves any number of keep-alive connections from one poll() loop and
+// accepts multiplexed requests. Each response is a text/plain body listing
+// REQUEST_METHOD, SCRIPT_FILENAME and QUERY_STRING, followed by the request
+// body as received; "?status=N" in the query string sets the Status header.
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <string>
+#include <vector>
+
+enum {
+    FCGI_BEGIN_REQUEST = 1,
+    FCGI_ABORT_REQUEST = 2,
+    FCGI_END_REQUEST = 3,
+    FCGI_PARAMS = 4,
+    FCGI_STDIN = 5,
+    FCGI_STDOUT = 6,
+    FCGI_GET_VALUES = 9,
+    FCGI_GET_VALUES_RESULT = 10,
+    FCGI_KEEP_CONN = 1
+};
+
+struct Request {
+    std::string params;
+    std::string body;
+};
+
+struct Connection {
+    std::string in;
+    std::string out;
+    std::map<unsigned, Request> requests;
+    bool keepConn;
+    bool closing;
+
+    Connection() : keepConn(true), closing(false) {}
+};
+
+static void appendRecord(std::string& out, int type, unsigned id, const std::string& content) {
+    size_t offset = 0;
+    do {
+        size_t length = content.size() - offset;
+        if (length > 65535) length = 65535;
+        unsigned char header[8] = {1, static_cast<unsigned char>(type), static_cast<unsigned char>(id >> 8),
+                                   static_cast<unsigned char>(id), static_cast<unsigned char>(length >> 8),
+                                   static_cast<unsigned char>(length), 0, 0};
+        out.append(reinterpret_cast<char*>(header), 8);
+        out.append(content, offset, length);
+        offset += length;
+    } while (offset < content.size());
+}
+
+static size_t readLength(const std::string& data, size_t& pos) {
+    unsigned char first = data[pos];
+    if (first < 128) {
+        ++pos;
+        return first;
+    }
+    size_t length = ((first & 0x7f) << 24) | (static_cast<unsigned char>(data[pos + 1]) << 16) |
+                    (static_cast<unsigned char>(data[pos + 2]) << 8) | static_cast<unsigned char>(data[pos + 3]);
+    pos += 4;
+    return length;
+}
+
+static std::map<std::string, std::string> decodeParams(const std::string& data) {
+    std::map<std::string, std::string> params;
+    size_t pos = 0;
+    while (pos < data.size()) {
+        size_t nameLength = readLength(data, pos);
+        size_t valueLength = readLength(data, pos);
+        if (pos + nameLength + valueLength > data.size()) break;
+        params[data.substr(pos, nameLength)] = data.substr(pos + nameLength, valueLength);
+        pos += nameLength + valueLength;
+    }
+    return params;
+}
+
+static void respond(Connection& conn, unsigned id, const Request& request) {
+    std::map<std::string, std::string> params = decodeParams(request.params);
+    std::string query = params["QUERY_STRING"];
+    std::string response;
+    size_t status = query.find("status=");
+    if (status != std::string::npos) response += "Status: " + query.substr(status + 7, 3) + "\r\n";
+    response += "Content-Type: text/plain\r\n\r\n";
+    response += "method=" + params["REQUEST_METHOD"] + "\n";
+    response += "script=" + params["SCRIPT_FILENAME"] + "\n";
+    response += "query=" + query + "\n";
+    response += request.body;
+    appendRecord(conn.out, FCGI_STDOUT, id, response);
+    appendRecord(conn.out, FCGI_STDOUT, id, "");
+    appendRecord(conn.out, FCGI_END_REQUEST, id, std::string(8, '\0'));
+}
+
+// Consumes complete records; false on a protocol error
+static bool processRecords(Connection& conn) {
+    size_t pos = 0;
+    while (conn.in.size() - pos >= 8) {
+        const unsigned char* header = reinterpret_cast<const unsigned char*>(conn.in.data()) + pos;
+        size_t length = (header[4] << 8) | header[5];
+        size_t total = 8 + length + header[6];
+        if (conn.in.size() - pos < total) break;
+        unsigned id = (header[2] << 8) | header[3];
+        std::string content = conn.in.substr(pos + 8, length);
+        pos += total;
+
+        if (header[1] == FCGI_BEGIN_REQUEST) {
+            if (length < 8) return false;
+            conn.requests[id] = Request();
+            conn.keepConn = (content[2] & FCGI_KEEP_CONN) != 0;
+        } else if (header[1] == FCGI_GET_VALUES) {
+            std::string result;
+            result += static_cast<char>(14);
+            result += static_cast<char>(1);
+            result += "FCGI_MPXS_CONNS1";
+            appendRecord(conn.out, FCGI_GET_VALUES_RESULT, 0, result);
+        } else if (conn.requests.find(id) == conn.requests.end()) {
+            continue;
+        } else if (header[1] == FCGI_PARAMS) {
+            conn.requests[id].params += content;
+        } else if (header[1] == FCGI_STDIN && length > 0) {
+            conn.requests[id].body += content;
+        } else if (header[1] == FCGI_STDIN || header[1] == FCGI_ABORT_REQUEST) {
+            // End of the body, or the client gave up on the request
+            if (header[1] == FCGI_STDIN) respond(conn, id, conn.requests[id]);
+            else appendRecord(conn.out, FCGI_END_REQUEST, id, std::string(8, '\0'));
+            conn.requests.erase(id);
+            if (!conn.keepConn) conn.closing = true;
+        }
+    }
+    conn.in.erase(0, pos);
+    return true;
+}
+
+static int listenOn(const char* address) {
+    int fd;
+    if (strncmp(address, "unix:", 5) == 0) {
+        struct sockaddr_un addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        strncpy(addr.sun_path, address + 5, sizeof(addr.sun_path) - 1);
+        unlink(addr.sun_path);
+        fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd == -1 || bind(fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) == -1) return -1;
+    } else {
+        struct sockaddr_in addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        addr.sin_port = htons(static_cast<unsigned short>(atoi(address)));
+        fd = socket(AF_INET, SOCK_STREAM, 0);
+        int on = 1;
+        if (fd != -1) setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+        if (fd == -1 || bind(fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) == -1) return -1;
+    }
+    if (listen(fd, 512) == -1) return -1;
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+    return fd;
+}
+
+int main(int argc, char** argv) {
+    if (argc != 2) {
+        fprintf(stderr, "usage: %s unix:<path> | <port>\n", argv[0]);
+        return 1;
+    }
+    signal(SIGPIPE, SIG_IGN);
+    int listener = listenOn(argv[1]);
+    if (listener == -1) {
+        perror("listen");
+        return 1;
+    }
+
+    std::map<int, Connection> connections;
+    while (true) {
+        std::vector<struct pollfd> fds;
+        struct pollfd entry;
+        entry.fd = listener;
+        entry.events = POLLIN;
+        fds.push_back(entry);
+        for (std::map<int, Connection>::const_iterator it = connections.begin(); it != connections.end(); ++it) {
+            entry.fd = it->first;
+            entry.events = it->second.out.empty() ? POLLIN : POLLIN | POLLOUT;
+            fds.push_back(entry);
+        }
+        if (poll(&fds[0], fds.size(), -1) == -1 && errno != EINTR) {
+            perror("poll");
+            return 1;
+        }
+
+        for (size_t i = 1; i < fds.size(); ++i) {
+            if (fds[i].revents == 0) continue;
+            Connection& conn = connections[fds[i].fd];
+            bool open = true;
+            if (fds[i].revents & (POLLIN | POLLHUP | POLLERR)) {
+                char buffer[65536];
+                ssize_t received = recv(fds[i].fd, buffer, sizeof(buffer), 0);
+                if (received <= 0) open = received < 0 && errno == EAGAIN;
+                else conn.in.append(buffer, received);
+                if (open && !processRecords(conn)) open = false;
+            }
+            if (open && !conn.out.empty()) {
+                ssize_t sent = send(fds[i].fd, conn.out.data(), conn.out.size(), 0);
+                if (sent > 0) conn.out.erase(0, sent);
+                else if (errno != EAGAIN) open = false;
+            }
+            if (!open || (conn.closing && conn.out.empty())) {
+                close(fds[i].fd);
+                connections.erase(fds[i].fd);
+            }
+        }
+
+        if (fds[0].revents & POLLIN) {
+            int fd;
+            while ((fd = accept(listener, NULL, NULL)) != -1) {
+                fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+                connections[fd] = Connection();
+            }
+        }
+    }
+}
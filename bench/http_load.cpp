@@ -0,0 +1,170 @@
+// Minimal keep-alive HTTP load generator used by the benchmark scripts.
+// Usage: http_load <host> <port> <path> <connections> <threads> <seconds>
+// Every connection repeatedly sends a GET and reads the full response
+// (Content-Length framed); prints completed requests per second.
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+struct Connection {
+    int fd;
+    std::string in;
+    size_t sent;
+};
+
+struct Worker {
+    pthread_t thread;
+    int connections;
+    unsigned long completed;
+    unsigned long errors;
+};
+
+static struct sockaddr_in g_addr;
+static std::string g_request;
+static double g_deadline;
+
+static double nowSeconds() {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+static int openConnection() {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) return -1;
+    if (connect(fd, (struct sockaddr*)&g_addr, sizeof(g_addr)) != 0) {
+        close(fd);
+        return -1;
+    }
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+    return fd;
+}
+
+// Returns the length of the first complete response in 'in', or 0 if incomplete
+static size_t completeResponse(const std::string& in) {
+    size_t headerEnd = in.find("\r\n\r\n");
+    if (headerEnd == std::string::npos) return 0;
+    size_t length = 0;
+    size_t pos = 0;
+    while ((pos = in.find("\r\n", pos)) != std::string::npos && pos < headerEnd) {
+        pos += 2;
+        if (strncasecmp(in.c_str() + pos, "Content-Length:", 15) == 0) {
+            length = strtoul(in.c_str() + pos + 15, NULL, 10);
+            break;
+        }
+    }
+    size_t total = headerEnd + 4 + length;
+    return in.size() >= total ? total : 0;
+}
+
+static void* runWorker(void* arg) {
+    Worker* worker = static_cast<Worker*>(arg);
+    std::vector<Connection> conns(worker->connections);
+    std::vector<struct pollfd> fds(worker->connections);
+    for (int i = 0; i < worker->connections; ++i) {
+        conns[i].fd = openConnection();
+        conns[i].sent = 0;
+        if (conns[i].fd < 0) {
+            ++worker->errors;
+            return NULL;
+        }
+    }
+
+    char buffer[65536];
+    while (nowSeconds() < g_deadline) {
+        for (int i = 0; i < worker->connections; ++i) {
+            fds[i].fd = conns[i].fd;
+            fds[i].events = conns[i].sent < g_request.size() ? POLLOUT : POLLIN;
+            fds[i].revents = 0;
+        }
+        if (poll(&fds[0], fds.size(), 100) <= 0) continue;
+
+        for (int i = 0; i < worker->connections; ++i) {
+            Connection& c = conns[i];
+            if (fds[i].revents & POLLOUT) {
+                ssize_t n = send(c.fd, g_request.c_str() + c.sent, g_request.size() - c.sent, 0);
+                if (n > 0) c.sent += n;
+            } else if (fds[i].revents & (POLLIN | POLLHUP | POLLERR)) {
+                ssize_t n = recv(c.fd, buffer, sizeof(buffer), 0);
+                if (n > 0) {
+                    c.in.append(buffer, n);
+                    size_t done = completeResponse(c.in);
+                    if (done) {
+                        ++worker->completed;
+                        c.in.erase(0, done);
+                        c.sent = 0;
+                    }
+                } else if (n == 0 || errno != EAGAIN) {
+                    ++worker->errors;
+                    close(c.fd);
+                    c.fd = openConnection();
+                    c.in.clear();
+                    c.sent = 0;
+                    if (c.fd < 0) return NULL;
+                }
+            }
+        }
+    }
+    for (int i = 0; i < worker->connections; ++i) close(conns[i].fd);
+    return NULL;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc != 7) {
+        fprintf(stderr, "usage: %s <host> <port> <path> <connections> <threads> <seconds>\n", argv[0]);
+        return 1;
+    }
+    int connections = atoi(argv[4]);
+    int threads = atoi(argv[5]);
+    double seconds = atof(argv[6]);
+    if (connections < 1 || threads < 1 || seconds <= 0) {
+        fprintf(stderr, "connections, threads and seconds must be positive\n");
+        return 1;
+    }
+    if (threads > connections) threads = connections;
+
+    memset(&g_addr, 0, sizeof(g_addr));
+    g_addr.sin_family = AF_INET;
+    g_addr.sin_port = htons(atoi(argv[2]));
+    if (inet_pton(AF_INET, argv[1], &g_addr.sin_addr) != 1) {
+        fprintf(stderr, "invalid IPv4 address: %s\n", argv[1]);
+        return 1;
+    }
+    g_request = std::string("GET ") + argv[3] + " HTTP/1.1\r\nHost: " + argv[1] + "\r\nConnection: keep-alive\r\n\r\n";
+
+    double start = nowSeconds();
+    g_deadline = start + seconds;
+    std::vector<Worker> workers(threads);
+    for (int i = 0; i < threads; ++i) {
+        workers[i].connections = connections / threads + (i < connections % threads ? 1 : 0);
+        workers[i].completed = 0;
+        workers[i].errors = 0;
+        pthread_create(&workers[i].thread, NULL, runWorker, &workers[i]);
+    }
+    unsigned long completed = 0;
+    unsigned long errors = 0;
+    for (int i = 0; i < threads; ++i) {
+        pthread_join(workers[i].thread, NULL);
+        completed += workers[i].completed;
+        errors += workers[i].errors;
+    }
+    double elapsed = nowSeconds() - start;
+    printf("%.0f req/s (%lu requests, %lu errors, %.1fs)\n", completed / elapsed, completed, errors, elapsed);
+    return errors && !completed ? 1 : 0;
+}
@@ -0,0 +1,40 @@
+#!/bin/sh
+# Measures keep-alive GET throughput of webserv with worker_threads 1..N.
+# Usage: bench/thread_scaling.sh [max_threads] [connections] [seconds] [path]
+# Run from the repository root after `make bench`.
+
+MAX_THREADS=${1:-$(nproc 2>/dev/null || echo 4)}
+CONNECTIONS=${2:-256}
+SECONDS_PER_RUN=${3:-5}
+REQUEST_PATH=${4:-/index.html}
+PORT=${BENCH_PORT:-18080}
+
+[ -x ./webserv ] && [ -x bench/http_load ] || { echo "run 'make bench' first" >&2; exit 1; }
+
+CONF=$(mktemp /tmp/webserv-bench.XXXXXX)
+trap 'rm -f "$CONF"; [ -n "$PID" ] && kill "$PID" 2>/dev/null' EXIT
+
+# The load generator gets its own threads; on small machines it competes with the server
+LOAD_THREADS=${LOAD_THREADS:-$MAX_THREADS}
+
+echo "threads  throughput"
+threads=1
+while [ "$threads" -le "$MAX_THREADS" ]; do
+    cat > "$CONF" <<EOF
+worker_threads $threads;
+server {
+    listen $PORT;
+    root $(pwd)/www;
+    index index.html;
+}
+EOF
+    ./webserv "$CONF" > /dev/null 2>&1 &
+    PID=$!
+    sleep 0.5
+    printf "%7d  " "$threads"
+    bench/http_load 127.0.0.1 "$PORT" "$REQUEST_PATH" "$CONNECTIONS" "$LOAD_THREADS" "$SECONDS_PER_RUN"
+    kill "$PID" 2>/dev/null
+    wait "$PID" 2>/dev/null
+    PID=
+    threads=$((threads * 2))
+done
@@ -0,0 +1,65 @@
+#!/usr/bin/env python3
+# cgi_pool worker: runs the Python CGI script named by SCRIPT_FILENAME inside
+# this long-lived process instead of a fresh interpreter per request.
+#   location /py { cgi_pass /path/to/cgi-bin/pool_worker.py; cgi_pool 4 1000; }
+# Without WEBSERV_CGI_POOL it behaves as a plain one-shot CGI wrapper.
+import io
+import os
+import sys
+
+compiled = {}  # script path -> (mtime, code)
+
+
+def run(environ, body):
+    script = environ.get('SCRIPT_FILENAME', '')
+    mtime = os.stat(script).st_mtime
+    cached = compiled.get(script)
+    if cached is None or cached[0] != mtime:
+        with open(script, 'rb') as f:
+            cached = (mtime, compile(f.read(), script, 'exec'))
+        compiled[script] = cached
+
+    out = io.BytesIO()
+    saved = (sys.stdin, sys.stdout, dict(os.environ))
+    os.environ.clear()
+    os.environ.update(environ)
+    sys.stdin = io.TextIOWrapper(io.BytesIO(body))
+    text = sys.stdout = io.TextIOWrapper(out, write_through=True)
+    try:
+        exec(cached[1], {'__name__': '__main__', '__file__': script})
+    except SystemExit:
+        pass
+    finally:
+        text.flush()
+        text.detach()  # keeps out open when the wrapper is collected
+        sys.stdin, sys.stdout = saved[0], saved[1]
+        os.environ.clear()
+        os.environ.update(saved[2])
+    return out.getvalue()
+
+
+def main():
+    if 'WEBSERV_CGI_POOL' not in os.environ:
+        length = int(os.environ.get('CONTENT_LENGTH') or 0)
+        sys.stdout.buffer.write(run(dict(os.environ), sys.stdin.buffer.read(length)))
+        return
+    stdin, stdout = sys.stdin.buffer, sys.stdout.buffer
+    while True:
+        line = stdin.readline()
+        if not line:
+            return  # the server closed our stdin: recycled or shutting down
+        env_length, body_length = (int(n) for n in line.split())
+        pairs = stdin.read(env_length).split(b'\0')
+        body = stdin.read(body_length)
+        environ = dict(p.decode('latin-1').split('=', 1) for p in pairs if p)
+        try:
+            result = run(environ, body)
+        except Exception as e:
+            result = ('Status: 500\r\nContent-Type: text/plain\r\n\r\n%s\n' % e).encode()
+        stdout.write(b'%d\n' % len(result))
+        stdout.write(result)
+        stdout.flush()
+
+
+if __name__ == '__main__':
+    main()
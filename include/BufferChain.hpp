@@ -0,0 +1,68 @@
+#ifndef BUFFERCHAIN_HPP
+#define BUFFERCHAIN_HPP
+
+#include <cstddef>
+#include <deque>
+
+// Process-wide freelist of fixed-size blocks backing every BufferChain. Blocks
+// are recycled instead of freed, up to a bound; the counters show how many a
+// workload really keeps in flight.
+class BufferPool {
+public:
+    static const size_t BLOCK_SIZE = 16 * 1024;
+    static const size_t MAX_FREE_BLOCKS = 4096; // 64 MB kept for reuse at most
+
+    struct Stats {
+        size_t inUse;     // blocks held by buffers right now
+        size_t highWater; // most blocks ever held at once
+        size_t free;      // blocks waiting in the freelist
+        size_t allocated; // blocks ever taken from the heap
+    };
+
+    static char* acquire();
+    static void release(char* block);
+    static Stats stats();
+};
+
+// Byte queue made of pool blocks. Readers consume by advancing a cursor and
+// drained blocks go straight back to the pool; writers fill the free space at
+// the tail directly (recv(), pread()) without staging copies.
+class BufferChain {
+public:
+    BufferChain();
+    BufferChain(const BufferChain& other);
+    BufferChain& operator=(const BufferChain& other);
+    ~BufferChain();
+
+    size_t size() const;
+    bool empty() const;
+
+    // Contiguous bytes at the read cursor; length is 0 when the chain is empty
+    const char* data(size_t& length) const;
+    void consume(size_t length);
+    // Makes the first min(length, size()) bytes contiguous, for lines that straddle blocks
+    void pullup(size_t length);
+
+    // Free space at the tail (a fresh block when the tail is full); commit() what was
+    // written, commit(0) when nothing was
+    char* reserve(size_t& length);
+    void commit(size_t length);
+    void append(const char* bytes, size_t length);
+    void clear();
+
+private:
+    struct Block {
+        char* bytes;
+        size_t capacity; // BLOCK_SIZE for pool blocks, larger for pullup() blocks
+        size_t start;    // read cursor
+        size_t end;      // write cursor
+    };
+
+    static Block newBlock(size_t capacity);
+    static void freeBlock(Block& block);
+
+    std::deque<Block> blocks;
+    size_t total;
+};
+
+#endif // BUFFERCHAIN_HPP
@@ -0,0 +1,130 @@
+#ifndef CGIPOOL_HPP
+#define CGIPOOL_HPP
+
+#include <sys/types.h>
+
+#include <cstddef>
+#include <deque>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "EventPoller.hpp"
+
+// Pre-spawned CGI interpreters (cgi_pool), owned by one event loop. A pool runs
+// a fixed number of copies of one cgi_pass program, started once with
+// WEBSERV_CGI_POOL=1 and kept across requests. Each request and its response
+// travel as frames over the worker's stdin and stdout:
+//   request:  "<env bytes> <body bytes>\n", then NAME=VALUE\0 pairs, then the body
+//   response: "<bytes>\n", then CGI output (headers, blank line, body)
+// Requests queue FIFO while every worker is busy. A paused request's worker is
+// left unread, so it blocks on its stdout until the request is resumed. A worker is replaced after
+// maxRequests requests and when it exits. A worker whose request is cancelled
+// (client gone, CGI timeout) is killed, since its frame stream cannot be
+// resynchronized.
+class CgiPool {
+public:
+    // What happened to a request while handling a batch of events
+    struct Update {
+        int owner;
+        bool finished; // the response frame is complete, or the request failed
+        bool failed;   // the worker died or broke the protocol
+
+        Update(int o, bool f, bool e) : owner(o), finished(f), failed(e) {}
+    };
+
+    struct Stats {
+        size_t workers;            // live processes
+        size_t busy;               // processes with a request
+        size_t queued;             // requests waiting for a worker
+        size_t maxQueued;          // most requests ever waiting at once
+        unsigned long dispatched;  // requests handed to a worker
+        unsigned long totalWaitMs; // queueing time of all dispatched requests
+        unsigned long maxWaitMs;
+        unsigned long respawned;   // workers replaced after a crash, a kill or maxRequests
+
+        Stats();
+    };
+
+    CgiPool();
+    ~CgiPool();
+
+    // Creates program's pool with size workers unless it exists; false when no worker runs
+    bool prepare(EventPoller& poller, const std::string& program, size_t size, unsigned maxRequests);
+    // Queues a request for owner; false when the pool has no worker to run it.
+    // stdinData and output must stay valid until the request finishes or is cancelled.
+    bool begin(EventPoller& poller, int owner, const std::string& program, size_t size, unsigned maxRequests,
+               const std::map<std::string, std::string>& env, const char* stdinData, size_t stdinLength,
+               std::string* output, unsigned long now);
+    // Forgets owner's request, killing the worker running it
+    void cancel(EventPoller& poller, int owner);
+    // Stops or resumes reading owner's response while its client is behind
+    void pause(EventPoller& poller, int owner, bool paused);
+    // Handles readiness of the worker pipes among events, then replaces retired workers
+    // and starts queued requests
+    void handleEvents(EventPoller& poller, const std::vector<PollEvent>& events, std::vector<Update>& updates,
+                      unsigned long now);
+
+    bool stats(const std::string& program, Stats& out) const;
+    // True while retired workers wait to be reaped by handleEvents()
+    bool reaping() const;
+
+private:
+    struct Worker {
+        pid_t pid;        // 0 while the slot has no process
+        int in;           // worker's stdin
+        int out;          // worker's stdout
+        bool writing;     // in is registered for EVENT_WRITE
+        bool paused;      // out is not registered: the request's client is behind
+        int owner;        // request being served, -1 when idle
+        size_t sent;      // bytes of the request frame written
+        std::string line; // response length line read so far
+        long remaining;   // response bytes still expected, -1 before the length line
+        unsigned served;
+
+        Worker();
+    };
+    struct Pool {
+        std::string program;
+        unsigned maxRequests; // 0 for no limit
+        std::vector<Worker> workers;
+        std::deque<int> queue;
+        Stats stats;
+        size_t nextQueueLog;
+        unsigned long nextStatsLog;
+
+        Pool();
+    };
+    struct Request {
+        Pool* pool;
+        std::string frame; // length line and environment
+        const char* body;
+        size_t bodyLength;
+        std::string* output;
+        unsigned long queuedAt;
+
+        Request();
+    };
+
+    CgiPool(const CgiPool&);
+    CgiPool& operator=(const CgiPool&);
+
+    Pool& findPool(const std::string& program, size_t size, unsigned maxRequests);
+    bool spawn(EventPoller& poller, Pool& pool, size_t slot);
+    void retire(EventPoller& poller, Pool& pool, size_t slot, bool killIt);
+    void crashed(EventPoller& poller, Pool& pool, size_t slot, std::vector<Update>& updates);
+    void dispatch(EventPoller& poller, Pool& pool, unsigned long now);
+    bool flush(EventPoller& poller, Worker& worker);
+    bool receive(Worker& worker, std::vector<Update>& updates);
+    void reap();
+    void logStats(const Pool& pool) const;
+
+    std::map<std::string, Pool> pools;                     // cgi_pass program -> pool
+    std::map<int, std::pair<Pool*, size_t> > pipes;        // pipe fd -> pool and worker slot
+    std::map<int, Request> requests;                       // owner -> request
+    std::vector<pid_t> exited;                             // workers killed or retired, not yet reaped
+    std::vector<std::pair<Pool*, size_t> > vacated;        // slots to restart after the current batch
+};
+
+#endif // CGIPOOL_HPP
@@ -13,6 +13,7 @@
 #include <vector>
 
 #include "LocationConfig.hpp"
+#include "LocationRouter.hpp"
 
 class ConfigParser {
 public:
@@ -21,26 +22,53 @@ public:
 
     struct ServerConfig {
         std::vector<std::string> listenPorts;
-        std::string serverName;
+        std::vector<std::string> serverNames; // as written: exact, wildcard or "~regex"
         std::string root;
         std::vector<std::string> indexFiles;
         std::map<int, std::string> errorPages;
         long clientMaxBodySize; // in bytes
-        std::map<std::string, LocationConfig> locations;
+        long clientBodyBufferSize;      // request bodies above this are spooled to disk
+        std::string clientBodyTempPath; // directory for spooled request bodies
+        RootDirectory rootDirectory;    // root opened at startup, see Server::openRootDirectories()
+        std::map<std::string, LocationConfig> locations;      // prefix blocks
+        std::map<std::string, LocationConfig> exactLocations; // `location = /path` blocks
+        std::vector<LocationConfig> regexLocations;           // `location ~ re` blocks, in file order
         // Default LocationConfig for settings not overridden by a specific location block
         LocationConfig defaultLocationSettings;
+        // Lookup structure over the maps above, see Server::compileLocations()
+        LocationRouter locationRouter;
 
-        ServerConfig() : clientMaxBodySize(1024 * 1024) {} // Default 1MB
+        ServerConfig() : clientMaxBodySize(1024 * 1024), clientBodyBufferSize(16 * 1024), clientBodyTempPath("/tmp") {} // Default 1MB
+    };
+
+    // Settings from outside the server blocks that apply to the whole process
+    struct GlobalConfig {
+        std::string eventBackend; // "epoll" or "select"; empty selects the build default
+        int workerProcesses;      // 1 runs a single process, 0 means one per CPU ("auto")
+        bool workerCpuAffinity;   // pin worker N to CPU N
+        int workerThreads;        // event-loop threads per process, 0 means one per CPU ("auto")
+        long staticFileCacheBytes; // small-file response cache per event loop, 0 disables it
+        int openFileCacheEntries;  // cached path lookups per event loop, 0 disables them
+        int openFileCacheValidSec; // lifetime of a cached lookup
+        bool openFileCacheInotify; // also drop lookups as soon as their directory changes
+
+        GlobalConfig()
+            : workerProcesses(1), workerCpuAffinity(false), workerThreads(1), staticFileCacheBytes(8 * 1024 * 1024),
+              openFileCacheEntries(1024), openFileCacheValidSec(60), openFileCacheInotify(true) {}
     };
 
     const std::vector<ServerConfig>& getServers() const;
+    const GlobalConfig& getGlobal() const;
 
 private:
     std::string configFile;
     std::vector<ServerConfig> servers;
+    GlobalConfig global;
 
     // Helper methods for parsing
     void parseServerBlock(std::ifstream& file, std::string& line);
+    void parseEventsBlock(std::ifstream& file, std::string& line);
+    void parseGlobalDirective(const std::string& line);
     void parseLocationBlock(std::ifstream& file, std::string& line, LocationConfig& location, bool isDefaultLocation);
 
 };
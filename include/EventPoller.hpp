@@ -0,0 +1,84 @@
+#ifndef EVENTPOLLER_HPP
+#define EVENTPOLLER_HPP
+
+#include <sys/select.h>
+#ifdef __linux__
+#include <sys/epoll.h>
+#endif
+
+#include <map>
+#include <string>
+#include <vector>
+
+// Readiness flags requested from and reported by an EventPoller
+enum {
+    EVENT_READ = 1,
+    EVENT_WRITE = 2,
+    EVENT_ERROR = 4 // hangup or error condition, only ever reported
+};
+
+struct PollEvent {
+    int fd;
+    int events;
+
+    PollEvent() : fd(-1), events(0) {}
+    PollEvent(int f, int e) : fd(f), events(e) {}
+};
+
+// Readiness notification backend used by the Server event loop. File descriptors
+// are registered once with their interest mask and only ready ones are reported.
+class EventPoller {
+public:
+    virtual ~EventPoller() {}
+
+    virtual bool add(int fd, int events) = 0;
+    virtual bool modify(int fd, int events) = 0;
+    virtual void remove(int fd) = 0;
+    // Fills 'ready' with the descriptors that became ready; returns their count or -1
+    virtual int wait(std::vector<PollEvent>& ready, int timeoutMs) = 0;
+    virtual const char* name() const = 0;
+
+    // Creates the named backend ("epoll" or "select"); an empty name picks the build default
+    static EventPoller* create(const std::string& backend);
+};
+
+// Portable fallback, limited to FD_SETSIZE descriptors
+class SelectPoller : public EventPoller {
+public:
+    SelectPoller();
+
+    bool add(int fd, int events);
+    bool modify(int fd, int events);
+    void remove(int fd);
+    int wait(std::vector<PollEvent>& ready, int timeoutMs);
+    const char* name() const;
+
+private:
+    fd_set readSet;
+    fd_set writeSet;
+    std::map<int, int> interest;
+};
+
+#ifdef __linux__
+class EpollPoller : public EventPoller {
+public:
+    EpollPoller();
+    ~EpollPoller();
+
+    bool add(int fd, int events);
+    bool modify(int fd, int events);
+    void remove(int fd);
+    int wait(std::vector<PollEvent>& ready, int timeoutMs);
+    const char* name() const;
+
+private:
+    EpollPoller(const EpollPoller&);
+    EpollPoller& operator=(const EpollPoller&);
+
+    int epfd;
+    size_t registered;
+    std::vector<struct epoll_event> events;
+};
+#endif
+
+#endif // EVENTPOLLER_HPP
@@ -0,0 +1,106 @@
+#ifndef FASTCGICLIENT_HPP
+#define FASTCGICLIENT_HPP
+
+#include <sys/socket.h>
+
+#include <cstddef>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "EventPoller.hpp"
+
+// Non-blocking FastCGI client owned by one event loop. Requests go to backends
+// named "unix:/path" or "host:port" over keep-alive connections (FCGI_KEEP_CONN)
+// pooled per address. A connection carries up to `multiplex` requests at once,
+// their records interleaved and told apart by request id. Bodies are sent as
+// STDIN records straight from the caller's buffer as the socket drains, and
+// STDOUT is appended to the caller's string as it arrives. A request that
+// fails on a reused connection before any reply (the backend closed it while
+// idle, or refused to multiplex) is retried once on a fresh connection. A
+// connection is left unread while all of its requests are paused.
+class FastCgiClient {
+public:
+    // What happened to a request while handling a batch of events
+    struct Update {
+        int owner;
+        bool finished; // END_REQUEST arrived, or the request failed
+        bool failed;   // no complete response will come
+
+        Update(int o, bool f, bool e) : owner(o), finished(f), failed(e) {}
+    };
+
+    FastCgiClient();
+    ~FastCgiClient();
+
+    // Parses "unix:/path", "host:port" or a bare port; host is an IPv4 address or localhost
+    static bool parseAddress(const std::string& address, struct sockaddr_storage& addr, socklen_t& length);
+
+    // Starts a request on behalf of owner; false when the backend cannot be reached.
+    // stdinData and output must stay valid until the request finishes or is cancelled.
+    bool begin(EventPoller& poller, int owner, const std::string& address, unsigned multiplex,
+               const std::map<std::string, std::string>& params, const char* stdinData, size_t stdinLength,
+               std::string* output);
+    // Forgets owner's request, aborting it on the backend
+    void cancel(EventPoller& poller, int owner);
+    // Stops or resumes reading owner's response while its client is behind
+    void pause(EventPoller& poller, int owner, bool paused);
+    // Handles readiness of the backend sockets among events
+    void handleEvents(EventPoller& poller, const std::vector<PollEvent>& events, std::vector<Update>& updates);
+
+private:
+    struct Request {
+        std::string address;
+        unsigned multiplex;
+        std::string head;      // BEGIN_REQUEST and PARAMS records, replayed on a retry
+        const char* stdinData;
+        size_t stdinLength;
+        size_t stdinQueued;    // body bytes already in a connection's send buffer
+        bool stdinClosed;      // the empty STDIN record is queued
+        std::string* output;
+        int fd;                // connection, -1 while waiting for a retry
+        unsigned short id;
+        bool responded;        // a record for it has arrived
+        bool paused;           // its client is behind
+        int attempts;
+
+        Request();
+    };
+    struct Connection {
+        std::string address;
+        bool connecting;
+        bool reusable;         // false once a request ended with records of it still unsent
+        unsigned capacity;     // concurrent requests allowed
+        unsigned long served;  // completed requests; a failure after reuse is retryable
+        std::string out;
+        size_t outPos;
+        std::string in;
+        size_t inPos;
+        std::map<unsigned short, int> ids; // request id -> owner, -1 once aborted
+        unsigned short nextId;
+        int mask;              // interest registered with the poller
+
+        Connection();
+    };
+
+    FastCgiClient(const FastCgiClient&);
+    FastCgiClient& operator=(const FastCgiClient&);
+
+    int connectTo(const std::string& address, unsigned multiplex);
+    bool assign(EventPoller& poller, int owner, Request& request);
+    void pump(Connection& conn);
+    void watch(EventPoller& poller, int fd, Connection& conn);
+    bool flush(int fd, Connection& conn);
+    bool receive(int fd, Connection& conn, std::vector<Update>& updates);
+    void fail(EventPoller& poller, int fd, std::vector<Update>& updates);
+    void retryOrFail(int owner, bool retryable, std::vector<Update>& updates);
+    void release(EventPoller& poller, int fd);
+    void closeConnection(EventPoller& poller, int fd);
+
+    std::map<int, Request> requests;                // owner -> request
+    std::map<int, Connection> connections;          // socket -> connection
+    std::map<std::string, std::vector<int> > pools; // address -> its sockets
+    std::vector<int> retries;                       // owners to dispatch again after this batch
+};
+
+#endif // FASTCGICLIENT_HPP
@@ -0,0 +1,85 @@
+#ifndef HTTPHEADERS_HPP
+#define HTTPHEADERS_HPP
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include "StringRef.hpp"
+
+// Header fields the server looks up by name, resolved once when the field is added
+enum KnownHeader {
+    HEADER_ACCEPT,
+    HEADER_ACCEPT_ENCODING,
+    HEADER_AUTHORIZATION,
+    HEADER_CONNECTION,
+    HEADER_CONTENT_DISPOSITION,
+    HEADER_CONTENT_LENGTH,
+    HEADER_CONTENT_TYPE,
+    HEADER_COOKIE,
+    HEADER_EXPECT,
+    HEADER_HOST,
+    HEADER_IF_MODIFIED_SINCE,
+    HEADER_IF_NONE_MATCH,
+    HEADER_IF_RANGE,
+    HEADER_ORIGIN,
+    HEADER_RANGE,
+    HEADER_REFERER,
+    HEADER_TRANSFER_ENCODING,
+    HEADER_UPGRADE,
+    HEADER_USER_AGENT,
+    HEADER_X_FILENAME,
+    HEADER_UNKNOWN
+};
+
+// A request's header fields as (offset, length) pairs into the request head,
+// which stays where it was received (see attach()), plus a small byte string
+// for fields set afterwards. Each known header has a slot holding its field
+// index, so the common lookups are an array read. Names keep the case they
+// arrived in and compare case-insensitively; a repeated field replaces the
+// earlier one in lookups. Views returned by get() and the iteration accessors
+// are invalidated by the next set() or attach().
+class HttpHeaders {
+public:
+    HttpHeaders();
+
+    // Bytes the offsets given to add() are relative to
+    void attach(const char* head);
+    void add(size_t nameOffset, size_t nameLength, size_t valueOffset, size_t valueLength);
+    void set(const std::string& name, const std::string& value); // replaces every field of that name
+    void remove(const std::string& name);
+    void clear();
+
+    StringRef get(KnownHeader header) const;
+    StringRef get(const std::string& name) const; // any case
+    bool has(KnownHeader header) const;
+
+    // Fields in arrival order
+    size_t count() const;
+    StringRef name(size_t index) const;
+    StringRef value(size_t index) const;
+
+    static KnownHeader lookup(const char* name, size_t length);
+
+private:
+    struct Field {
+        size_t nameOffset;
+        size_t nameLength;
+        size_t valueOffset;
+        size_t valueLength;
+        bool owned; // offsets into bytes rather than into the head
+    };
+
+    const char* base(const Field& field) const;
+    void append(const Field& field);
+
+    int find(const char* name, size_t length) const; // last field of that name, -1 if none
+    void index(); // recomputes the known slots after fields were removed
+
+    const char* head;
+    std::string bytes; // fields added by set()
+    std::vector<Field> fields;
+    int known[HEADER_UNKNOWN]; // field index per known header, -1 when absent
+};
+
+#endif // HTTPHEADERS_HPP
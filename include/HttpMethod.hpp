@@ -0,0 +1,29 @@
+#ifndef HTTPMETHOD_HPP
+#define HTTPMETHOD_HPP
+
+#include <cstddef>
+#include <string>
+
+// Request methods the server recognizes, as bits so that a set of them (the
+// methods a location allows) is a single mask
+enum HttpMethod {
+    METHOD_UNKNOWN = 0,
+    METHOD_GET = 1 << 0,
+    METHOD_HEAD = 1 << 1,
+    METHOD_POST = 1 << 2,
+    METHOD_PUT = 1 << 3,
+    METHOD_DELETE = 1 << 4,
+    METHOD_OPTIONS = 1 << 5,
+    METHOD_PATCH = 1 << 6,
+    METHOD_TRACE = 1 << 7,
+    METHOD_CONNECT = 1 << 8
+};
+
+// METHOD_UNKNOWN for anything but an exact, case-sensitive method token
+HttpMethod parseHttpMethod(const char* token, size_t length);
+HttpMethod parseHttpMethod(const std::string& token);
+
+// Allow header value for a mask: method names in alphabetical order, ", "-separated
+std::string renderAllowHeader(unsigned methods);
+
+#endif // HTTPMETHOD_HPP
@@ -6,29 +6,64 @@
 #include <sstream>
 #include <string>
 
+#include "HttpHeaders.hpp"
+#include "HttpMethod.hpp"
+#include "RequestBody.hpp"
+
+// A parsed request. Method, target, version and header fields are views into
+// the request head, which HttpRequestParser leaves in the connection buffer
+// while the request is dispatched; copying a request, or ownHead(), gives it
+// its own copy of the head so it can outlive that buffer (CGI keeps one).
 class HttpRequest {
 public:
     HttpRequest();
-    void parseRequest(const std::string& request);
-    std::string getMethod() const;
-    std::string getPath() const;
-    std::string getHeader(const std::string& header) const;
-    std::string getBody() const;
-    std::string getVersion() const;
-    std::string getQueryString() const; // Added
-    const std::map<std::string, std::string>& getHeaders() const; // Added
-    static bool decodeChunkedBody(const std::string& data, size_t startPos, size_t& consumed, std::string& out);
-    static std::map<std::string, std::string> parseHeaders(const std::string& headerBlock);
-    static std::string normalizeChunkedRequest(const std::string& buffer, size_t headerEnd, const std::string& decodedBody);
+    HttpRequest(const HttpRequest& other);
+    HttpRequest& operator=(const HttpRequest& other);
+
+    // Line-level parsing driven by HttpRequestParser. Lines come without their
+    // CRLF as offsets into head, the bytes attachHead() is later pointed at.
+    bool parseRequestLine(const char* head, size_t offset, size_t length);
+    bool parseHeaderLine(const char* head, size_t offset, size_t length);
+    void attachHead(const char* head);
+    void ownHead();
+    void setHeader(const std::string& name, const std::string& value);
+    void removeHeader(const std::string& name);
+    void setBodySpool(size_t memoryLimit, const std::string& tempDir);
+    bool appendBody(const char* data, size_t length);
+    void borrowBody(const char* data, size_t length);
+
+    // Views stay valid while the head they point into does; copy them with str() to keep them
+    StringRef getMethod() const;
+    HttpMethod getMethodId() const; // METHOD_UNKNOWN for methods the server does not know
+    StringRef getPath() const;
+    StringRef getQueryString() const;
+    StringRef getVersion() const;
+    StringRef getHeader(KnownHeader header) const;
+    StringRef getHeader(const std::string& header) const;
+    const HttpHeaders& getHeaders() const;
+    const RequestBody& getBody() const;
     bool wantsKeepAlive() const;
 
 private:
-    std::string method;
-    std::string path;
-    std::string queryString; // Added
-    std::string version;
-    std::map<std::string, std::string> headers;
-    std::string body;
+    struct Span {
+        size_t offset;
+        size_t length;
+
+        Span() : offset(0), length(0) {}
+    };
+
+    StringRef view(const Span& span) const;
+
+    const char* head;    // bytes the spans are relative to
+    size_t headLength;   // end of the last parsed line
+    std::string ownCopy; // the head, once the request owns it
+    Span method;
+    HttpMethod methodId;
+    Span path;
+    Span queryString;
+    Span version;
+    HttpHeaders headers;
+    RequestBody body;
 };
 
 #endif // HTTPREQUEST_HPP
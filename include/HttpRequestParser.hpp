@@ -0,0 +1,89 @@
+#ifndef HTTPREQUESTPARSER_HPP
+#define HTTPREQUESTPARSER_HPP
+
+#include <cstddef>
+#include <string>
+
+#include "BufferChain.hpp"
+#include "HttpRequest.hpp"
+
+// Resumable HTTP/1.x request parser kept per connection. Every parse() call only
+// looks at bytes appended to the buffer since the previous call, so the request
+// line and each header line are parsed exactly once however the data trickles in.
+// The request's views point into the head where it was received: a request
+// without a body, or with a small body that arrived with it, stays pinned in
+// the buffer until release() after dispatch. Otherwise the head is copied into
+// the request once and consumed, and body bytes are moved into the request body
+// (memory or spool file) as they arrive, so the buffer only ever holds the head
+// and not-yet-consumed bytes. In streaming mode the decoded body is handed to
+// the caller through streamedBody() instead (a CGI started at the head).
+class HttpRequestParser {
+public:
+    enum Result {
+        PARSE_INCOMPLETE,
+        PARSE_HEAD_COMPLETE,    // body follows; call beginBody() before parsing on
+        PARSE_COMPLETE,
+        PARSE_ERROR,            // malformed request line or framing
+        PARSE_HEADER_TOO_LARGE, // request head exceeds maxHeaderBytes
+        PARSE_BODY_TOO_LARGE,   // body exceeds the limit given to beginBody()
+        PARSE_STORAGE_ERROR     // the body could not be spooled
+    };
+
+    HttpRequestParser();
+
+    Result parse(BufferChain& buffer, size_t maxHeaderBytes);
+    // Sets the body limit and spooling policy; false if Content-Length already exceeds maxBodyBytes
+    bool beginBody(size_t maxBodyBytes, size_t memoryLimit, const std::string& tempDir);
+    // Leaves decoded body bytes in streamedBody() rather than in the request body
+    void streamBody();
+    bool streamingBody() const;
+    // Stops decoding once streamedBody() holds limit bytes; parse() then returns
+    // PARSE_INCOMPLETE and leaves the rest of the body in the buffer
+    void limitStreamedBody(size_t limit);
+    // Body bytes decoded but not taken by the caller yet; the caller clears or swaps it out
+    std::string& streamedBody();
+    void reset();
+    // Consumes the bytes a completed request still pins in buffer, then reset()s
+    void release(BufferChain& buffer);
+
+    bool headersComplete() const;
+    bool expectsContinue() const;
+    // The request being assembled; complete once parse() returned PARSE_COMPLETE
+    HttpRequest& request();
+
+private:
+    enum State {
+        STATE_REQUEST_LINE,
+        STATE_HEADERS,
+        STATE_BODY,
+        STATE_CHUNK_SIZE,     // "<hex>[;ext]" line
+        STATE_CHUNK_DATA,
+        STATE_CHUNK_DATA_END, // CRLF after the chunk data
+        STATE_CHUNK_TRAILER,  // trailer fields up to the final empty line
+        STATE_DONE
+    };
+
+    bool finishHeaders();
+    bool borrowBody(BufferChain& buffer);
+    Result parseBody(BufferChain& buffer);
+    Result parseChunked(BufferChain& buffer);
+    bool storeBody(const char* data, size_t length);
+    size_t streamRoom() const;
+
+    State state;
+    size_t lineStart;     // head offset of the line being assembled
+    size_t pinned;        // front bytes of the buffer the request's views point into
+    size_t scanPos;       // no line break before this head offset is left unread
+    size_t contentLength;
+    size_t chunkRemaining;
+    size_t bodyBytes;     // decoded body bytes so far, stored or streamed
+    size_t maxBodyBytes;
+    size_t memoryLimit;   // client_body_buffer_size of the request's server
+    bool expectContinue;
+    bool streaming;
+    std::string streamed;
+    size_t streamLimit;   // streamed is not grown past this
+    HttpRequest req;
+};
+
+#endif // HTTPREQUESTPARSER_HPP
@@ -2,29 +2,50 @@
 #define HTTPRESPONSE_HPP
 
 #include <map>
-#include <set>
 #include <sstream>
 #include <string>
 
+#include "OutputQueue.hpp"
+
+// A complete 200 response serialized ahead of time (see StaticFileCache); the
+// two header blocks differ only in their Connection field
+struct PreparedResponse : public SharedBytes {
+    std::string keepAliveHead;
+    std::string closeHead;
+    std::string body;
+};
+
 class HttpResponse {
 public:
     HttpResponse();
+    HttpResponse(const HttpResponse& other);
+    HttpResponse& operator=(const HttpResponse& other);
+    ~HttpResponse();
     void setStatus(int statusCode);
     void setHeader(const std::string& key, const std::string& value);
     void setBody(const std::string& body);
+    void swapBody(std::string& body); // takes body without copying it
     const std::string& getBody() const;
-    std::string generateResponse(bool isHead = false);
+    // Answers with a prepared 200 response; only Connection may be set afterwards
+    void setPrepared(PreparedResponse* prepared);
+    // Queues the header block and then the body (moved, not copied) for sending
+    void serialize(OutputQueue& out, bool isHead = false);
+    // Queues only the header block, for a body sent separately as it is produced;
+    // no Content-Length is added
+    void serializeHead(OutputQueue& out);
     int getStatus() const;
     bool hasHeader(const std::string& key) const;
     static std::string getStatusMessage(int statusCode);
     static std::string getMimeType(const std::string& path);
     void setDefaultErrorBody();
-    void setAllowHeader(const std::set<std::string>& methods);
 
 private:
+    std::string buildHead() const;
+
     int statusCode;
     std::map<std::string, std::string> headers;
     std::string body;
+    PreparedResponse* prepared; // referenced, sent in place by serialize()
 };
 
 #endif // HTTPRESPONSE_HPP
\ No newline at end of file
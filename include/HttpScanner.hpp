@@ -0,0 +1,26 @@
+#ifndef HTTPSCANNER_HPP
+#define HTTPSCANNER_HPP
+
+#include <cstddef>
+
+// Byte-class scans of the request head, 16 (SSE4.2) or 32 (AVX2) bytes at a
+// time where the CPU allows it, with a scalar table fallback. The level is
+// picked once at startup from cpuid; setLevel() exists for benchmarks.
+class HttpScanner {
+public:
+    enum Level { LEVEL_SCALAR, LEVEL_SSE42, LEVEL_AVX2 };
+
+    // Leading bytes that are tchar (RFC 9110 5.6.2): method and field names
+    static size_t tokenLength(const char* data, size_t length);
+    // Leading bytes that may appear in a field value: VCHAR, obs-text, SP and HTAB
+    static size_t fieldValueLength(const char* data, size_t length);
+    // Leading bytes of a request target: anything but controls, SP and DEL
+    static size_t targetLength(const char* data, size_t length);
+
+    static Level level();
+    static bool setLevel(Level level); // false when the CPU lacks it
+    static bool supported(Level level);
+    static const char* levelName(Level level);
+};
+
+#endif // HTTPSCANNER_HPP
@@ -5,6 +5,16 @@
 #include <string>
 #include <vector>
 
+#include "HttpMethod.hpp"
+
+// A configured root, canonicalized and opened once when the configuration is loaded
+struct RootDirectory {
+    std::string path; // realpath() of the root, or the root as written when it does not exist
+    int fd;           // directory descriptor request paths are resolved beneath, -1 if unavailable
+
+    RootDirectory() : fd(-1) {}
+};
+
 class LocationConfig {
 public:
     LocationConfig();
@@ -13,8 +23,14 @@ public:
     void setPath(const std::string& path);
     std::string getPath() const;
 
+    void setModifier(const std::string& modifier); // "", "=", "~" or "~*"
+    const std::string& getModifier() const;
+    bool isRegex() const;
+
     void setRoot(const std::string& root);
     std::string getRoot() const;
+    void setRootDirectory(const RootDirectory& directory);
+    const RootDirectory& getRootDirectory() const;
 
     void setIndex(const std::string& index); // Should this be std::vector<std::string>? For now, keep as project has it.
     std::string getIndex() const; // Assuming single index for now, can be changed to vector later if needed;
@@ -24,8 +40,11 @@ public:
     void setAutoindex(bool autoindex);
     bool getAutoindex() const;
 
-    void setMethods(const std::vector<std::string>& methods);
-    const std::vector<std::string>& getMethods() const;
+    // Mask of HttpMethod bits; the Allow headers are rendered here rather than per response
+    void setMethods(unsigned methods);
+    bool allowsMethod(HttpMethod method) const;
+    const std::string& getAllowHeader() const;        // for 405 responses
+    const std::string& getOptionsAllowHeader() const; // for OPTIONS, which is always allowed
 
     void setRedirect(const std::string& redirect);
     std::string getRedirect() const;
@@ -33,6 +52,17 @@ public:
     void setCgiPass(const std::string& cgiPass);
     std::string getCgiPass() const;
 
+    // FastCGI backend ("unix:/path" or "host:port") and requests allowed per connection
+    void setFastCgiPass(const std::string& address);
+    const std::string& getFastCgiPass() const;
+    void setFastCgiMultiplex(unsigned requests);
+    unsigned getFastCgiMultiplex() const;
+
+    // Persistent cgi_pass workers: pool size (0 forks per request) and requests before recycling
+    void setCgiPool(unsigned workers, unsigned maxRequests);
+    unsigned getCgiPoolSize() const;
+    unsigned getCgiPoolMaxRequests() const;
+
     void setUploadStore(const std::string& uploadStore);
     std::string getUploadStore() const;
 
@@ -40,13 +70,21 @@ public:
 
 private:
     std::string path;
+    std::string modifier;
     std::string root;
+    RootDirectory rootDirectory;
     std::string index;
     std::vector<std::string> indexFiles;
     bool autoindex;
-    std::vector<std::string> methods;
+    unsigned methods;
+    std::string allowHeader;
+    std::string optionsAllowHeader;
     std::string redirect;
     std::string cgiPass;
+    std::string fastCgiPass;
+    unsigned fastCgiMultiplex;
+    unsigned cgiPoolSize;
+    unsigned cgiPoolMaxRequests;
     std::string uploadStore;
 };
 
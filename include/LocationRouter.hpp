@@ -0,0 +1,49 @@
+#ifndef LOCATIONROUTER_HPP
+#define LOCATIONROUTER_HPP
+
+#include <cstddef>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "LocationConfig.hpp"
+#include "RegexSet.hpp"
+
+// A server's location blocks compiled for lookup: `location = /path` blocks in
+// an exact-match table, prefix blocks in a radix trie walked once per request,
+// and `location ~ re` / `~* re` blocks in one RegexSet. As in nginx, an exact
+// match wins outright, then the first regex in file order, then the longest
+// prefix. Prefix semantics are the historical ones: a location matches when it
+// is a string prefix of the path, or when it is the path plus a trailing slash.
+// Built over a ServerConfig's own containers, so it has to be rebuilt whenever
+// that ServerConfig is copied.
+class LocationRouter {
+public:
+    LocationRouter();
+
+    void build(const std::map<std::string, LocationConfig>& prefixLocations,
+               const std::map<std::string, LocationConfig>& exactLocations,
+               const std::vector<LocationConfig>& regexLocations, const LocationConfig& fallback);
+
+    // The location serving path; the fallback when no block matches
+    const LocationConfig& match(const std::string& path) const;
+
+private:
+    struct Node {
+        std::string label;                 // edge label from the parent
+        const LocationConfig* location;    // block whose path ends here, if any
+        std::map<char, size_t> children;   // first label byte -> node index
+
+        Node() : location(NULL) {}
+    };
+
+    void insert(const std::string& path, const LocationConfig* location);
+
+    std::vector<Node> nodes; // nodes[0] is the root
+    std::map<std::string, const LocationConfig*> exact;
+    RegexSet regexes;
+    std::vector<const LocationConfig*> regexTargets; // location of each RegexSet pattern
+    const LocationConfig* fallback;
+};
+
+#endif // LOCATIONROUTER_HPP
@@ -0,0 +1,75 @@
+#ifndef OPENFILECACHE_HPP
+#define OPENFILECACHE_HPP
+
+#include <sys/stat.h>
+
+#include <cstddef>
+#include <list>
+#include <map>
+#include <set>
+#include <string>
+#include <utility>
+
+// Per-event-loop cache of how static request paths resolve, in the spirit of
+// nginx's open_file_cache: the resolved path, its stat() data, the index file
+// chosen for a directory and an open descriptor. Paths that do not exist are
+// cached too. Entries expire after a validity period and, on Linux, are dropped
+// as soon as inotify reports a change in the directory they were resolved in.
+class OpenFileCache {
+public:
+    struct Entry {
+        std::string path;      // resolved path; empty when resolution was refused
+        int error;             // errno of stat(), 0 when the path exists
+        struct stat st;
+        std::string indexPath; // directories: first existing index file, empty when none
+        struct stat indexSt;
+        int fd;                // read-only descriptor of the file or index file, -1 if none
+
+        Entry();
+    };
+
+    OpenFileCache();
+    ~OpenFileCache();
+
+    // maxEntries 0 disables caching; inotify is only used where available
+    void configure(size_t maxEntries, unsigned long validMs, bool useInotify);
+    int eventFd() const;  // inotify descriptor to poll, -1 when not in use
+    void processEvents(); // drops entries of directories that changed
+
+    // Cached entry for (scope, uri) within its validity period, else NULL
+    const Entry* find(const void* scope, const std::string& uri, unsigned long now);
+    // Stores a freshly resolved entry and takes over its descriptor
+    const Entry& insert(const void* scope, const std::string& uri, const Entry& entry, unsigned long now);
+    // Drops the entries a write to path may have changed: those resolved in its
+    // directory, and those in or below path itself
+    void invalidate(const std::string& path);
+    void clear();
+
+private:
+    typedef std::pair<const void*, std::string> Key;
+    struct Slot {
+        Entry entry;
+        unsigned long expires;
+        std::string directory; // the entry depends on this directory's contents; empty if none
+        int watch;             // inotify watch of that directory, -1 if none
+        std::list<Key>::iterator lruPos;
+    };
+
+    OpenFileCache(const OpenFileCache&);
+    OpenFileCache& operator=(const OpenFileCache&);
+
+    void erase(std::map<Key, Slot>::iterator it);
+    void eraseDirectory(const std::string& directory);
+    int watchDirectory(const std::string& directory);
+
+    std::map<Key, Slot> slots;
+    std::list<Key> lru;                     // most recently used first
+    std::map<std::string, std::set<Key> > directories; // directory -> entries depending on it
+    std::map<int, std::set<Key> > watchers;            // inotify watch -> entries depending on it
+    Entry scratch;                          // result holder while caching is off
+    size_t maxEntries;
+    unsigned long validMs;
+    int inotifyFd;
+};
+
+#endif // OPENFILECACHE_HPP
@@ -0,0 +1,69 @@
+#ifndef OUTPUTQUEUE_HPP
+#define OUTPUTQUEUE_HPP
+
+#include <cstddef>
+#include <deque>
+#include <string>
+
+// Immutable bytes several queues may send from at the same time, such as a
+// cached file. Deleted with its last reference; references never leave the
+// event loop that created them, so the count is not atomic.
+class SharedBytes {
+public:
+    SharedBytes();
+    virtual ~SharedBytes();
+    void retain();
+    void release();
+
+private:
+    SharedBytes(const SharedBytes&);
+    SharedBytes& operator=(const SharedBytes&);
+
+    int refs;
+};
+
+// Bytes waiting to be sent on a connection, kept as a list of segments (header
+// blocks, bodies) that are flushed together with one sendmsg() per batch of
+// iovecs. Segments handed over with adopt() are swapped in, not copied, and
+// shared segments are sent from their owner's memory.
+class OutputQueue {
+public:
+    OutputQueue();
+    OutputQueue(const OutputQueue& other);
+    OutputQueue& operator=(const OutputQueue& other);
+    ~OutputQueue();
+
+    void append(const char* data, size_t length); // copies
+    void append(const std::string& data);         // copies
+    void adopt(std::string& data);                // takes data's buffer, leaving it empty
+    // Sends owner's bytes in place; owner stays alive until they are sent
+    void appendShared(SharedBytes* owner, const char* data, size_t length);
+    void clear();
+
+    bool empty() const;
+    size_t size() const; // bytes not sent yet
+
+    // Sends as much as the socket accepts without blocking and returns the byte
+    // count. 'more' tells the kernel further data (a file stream) follows at once.
+    size_t flush(int fd, bool more);
+
+private:
+    struct Segment {
+        std::string bytes;   // owned data, unless owner is set
+        SharedBytes* owner;
+        const char* shared;  // owner's data
+        size_t sharedLength;
+
+        Segment() : owner(NULL), shared(NULL), sharedLength(0) {}
+        const char* data() const { return owner != NULL ? shared : bytes.data(); }
+        size_t size() const { return owner != NULL ? sharedLength : bytes.size(); }
+    };
+
+    void popFront();
+
+    std::deque<Segment> segments;
+    size_t headOffset;   // bytes of segments.front() already sent
+    size_t pendingBytes;
+};
+
+#endif // OUTPUTQUEUE_HPP
@@ -0,0 +1,71 @@
+#ifndef REGEXSET_HPP
+#define REGEXSET_HPP
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// A list of regular expressions searched together: all patterns are compiled
+// into one Thompson NFA and, when small enough, into a DFA at load time, so
+// finding the first matching pattern is a single pass over the text no matter
+// how many patterns there are. Read-only after compile(), hence safe to share
+// between event-loop threads.
+//
+// Supported syntax is the part of PCRE location patterns use: literals and
+// escapes, ., [classes], \d \w \s (and negations), groups including (?:...)
+// and named ones, |, * + ? {m,n} (lazy forms accepted), ^ and $, and a
+// leading (?i). Backreferences, lookaround and possessive forms are rejected.
+class RegexSet {
+public:
+    RegexSet();
+
+    // Appends pattern as number size(); false with a reason when it cannot be compiled
+    bool add(const std::string& pattern, bool caseInsensitive, std::string& error);
+    void compile();
+
+    // Number of the first pattern matching anywhere in text, -1 when none does
+    int firstMatch(const std::string& text) const;
+    int firstMatch(const char* text, size_t length) const;
+
+    size_t size() const;
+    bool empty() const;
+
+private:
+    enum StateType { STATE_CHAR, STATE_SPLIT, STATE_BOL, STATE_EOL, STATE_ACCEPT };
+    struct State {
+        StateType type;
+        int charSet;           // STATE_CHAR: index into charSets
+        int next;              // successor for CHAR, BOL and EOL
+        std::vector<int> alts; // STATE_SPLIT: epsilon successors
+        int pattern;           // STATE_ACCEPT: pattern number
+
+        State() : type(STATE_SPLIT), charSet(-1), next(-1), pattern(-1) {}
+    };
+    struct CharSet {
+        unsigned char bits[32];
+        bool has(unsigned char c) const { return (bits[c >> 3] >> (c & 7)) & 1; }
+    };
+    struct DfaState {
+        std::vector<int> next; // per byte class
+        int firstAccept;       // lowest pattern accepted on entering the state, INT_MAX when none
+        int firstAcceptAtEnd;  // the same when the text ends here ($ satisfied)
+    };
+    class Parser;
+
+    int newState(StateType type);
+    void closure(std::vector<int>& states, bool atStart, bool atEnd) const;
+    int lowestAccept(const std::vector<int>& states) const;
+    bool buildDfa();
+    int simulate(const char* text, size_t length) const;
+
+    std::vector<State> states;
+    std::vector<CharSet> charSets;
+    std::vector<int> entries; // start state of each pattern
+    int start;                // splits into every pattern and the unanchored ".*" loop
+
+    unsigned char byteClass[256];
+    int classCount;
+    std::vector<DfaState> dfa; // empty when the DFA grew too large; the NFA is simulated then
+};
+
+#endif // REGEXSET_HPP
@@ -0,0 +1,51 @@
+#ifndef REQUESTBODY_HPP
+#define REQUESTBODY_HPP
+
+#include <cstddef>
+#include <string>
+
+// Request body storage. Data stays in memory up to a configurable threshold
+// (client_body_buffer_size) and is then spooled to an unlinked temporary file
+// in client_body_temp_path, so large uploads never sit in RAM. A small body
+// that arrived with its head can also be borrowed in place from the connection
+// buffer. Copying a spooled body dup()s the descriptor instead of duplicating
+// the data; copying a borrowed one takes ownership of its bytes.
+class RequestBody {
+public:
+    RequestBody();
+    RequestBody(const RequestBody& other);
+    RequestBody& operator=(const RequestBody& other);
+    ~RequestBody();
+
+    // Bodies larger than memoryLimit move to a temporary file in tempDir
+    void setSpool(size_t memoryLimit, const std::string& tempDir);
+    bool append(const char* data, size_t length); // false when spooling failed
+    // Uses length bytes at data as the body without copying; they must outlive it
+    void borrow(const char* data, size_t length);
+    void clear();
+
+    size_t size() const;
+    bool empty() const;
+    bool inFile() const;
+    int fd() const;                    // spooled file, -1 while the body is in memory
+    // The whole body as one contiguous range; a spooled body is mmap()ed on first use
+    const char* data() const;
+    // Copies the body to outFd without staging a spooled body in memory
+    bool writeTo(int outFd) const;
+
+private:
+    bool spill();
+    void unmap() const;
+
+    std::string buffer;
+    const char* borrowed; // bytes owned by someone else, NULL when the body owns its data
+    size_t borrowedSize;
+    int fileFd;
+    size_t fileSize;
+    size_t memoryLimit;
+    std::string tempDir;
+    mutable void* mapping;
+    mutable size_t mappingSize;
+};
+
+#endif // REQUESTBODY_HPP
@@ -5,7 +5,7 @@
 #include <fcntl.h>
 #include <limits.h>
 #include <netinet/in.h>
-#include <sys/select.h>
+#include <pthread.h>
 #include <sys/socket.h>
 #include <sys/time.h>
 #include <sys/types.h>
@@ -18,6 +18,7 @@
 #include <cstdlib>
 #include <cstring>
 #include <ctime>
+#include <deque>
 #include <fstream>
 #include <iostream>
 #include <map>
@@ -27,10 +28,27 @@
 #include <utility>
 #include <vector>
 
+#include "BufferChain.hpp"
+#include "CgiPool.hpp"
 #include "ConfigParser.hpp"
+#include "EventPoller.hpp"
+#include "FastCgiClient.hpp"
 #include "HttpRequest.hpp"
+#include "HttpRequestParser.hpp"
 #include "HttpResponse.hpp"
 #include "LocationConfig.hpp"
+#include "OpenFileCache.hpp"
+#include "OutputQueue.hpp"
+#include "ServerNameTable.hpp"
+#include "StaticFileCache.hpp"
+#include "TimerWheel.hpp"
+
+// Where a CGI request runs; only CGI_PROCESS uses the pid and pipe fields
+enum CgiBackend {
+    CGI_PROCESS, // a child forked for this request
+    CGI_FASTCGI, // Reactor::fastcgi
+    CGI_POOL     // Reactor::cgiPool
+};
 
 // Structure to track CGI state for non-blocking handling
 struct CgiState {
@@ -40,19 +58,26 @@ struct CgiState {
     std::string bodyToWrite;
     size_t bodyWritten;
     std::string cgiOutput;
-    bool writeComplete;
+    bool writeComplete; // pipe_in is closed
+    bool bodyPending;   // the request body is still arriving; bodyToWrite holds the next part
     bool readComplete;
-    time_t startTime;
-    time_t lastIO;
+    unsigned long startTime; // monotonic ms
+    unsigned long lastIO;    // monotonic ms
     HttpRequest request;
     const ConfigParser::ServerConfig* config;
     LocationConfig locConfig;
     std::string effectiveRoot;
     bool isHead;
+    CgiBackend backend;
+    bool streaming;    // response head is queued; further output goes straight to the client
+    bool chunked;      // the streamed body uses chunked transfer coding
+    bool bodyless;     // HEAD, 204 or 304: further script output is discarded
+    bool outputPaused; // the backend is left unread until the client drains its queue
     
     CgiState() : pid(0), pipe_in(-1), pipe_out(-1), bodyWritten(0), 
-                 writeComplete(false), readComplete(false), 
-                 startTime(0), lastIO(0), config(NULL), isHead(false) {}
+                 writeComplete(false), bodyPending(false), readComplete(false), 
+                 startTime(0), lastIO(0), config(NULL), isHead(false), backend(CGI_PROCESS),
+                 streaming(false), chunked(false), bodyless(false), outputPaused(false) {}
 };
 
 // Per-connection file streaming state
@@ -62,132 +87,246 @@ struct FileStreamState {
     off_t size;
     bool active;
     bool isHead;
-    std::string pendingChunk;
+    bool useSendfile;         // cleared when the kernel cannot sendfile() this file
+    BufferChain pending;      // userspace fallback: read but not yet sent
 
-    FileStreamState() : fd(-1), offset(0), size(0), active(false), isHead(false), pendingChunk() {}
+    FileStreamState() : fd(-1), offset(0), size(0), active(false), isHead(false), useSendfile(true) {}
 };
 
 // Per-connection state tracked by the event loop
 struct ClientState {
-    std::string inBuffer;
-    std::string outBuffer;
-    size_t outOffset;
+    BufferChain inBuffer; // starts at the first byte of the request being parsed
+    OutputQueue output;   // serialized responses waiting for the socket
     bool keepAlive;
-    bool closing;
-    bool expectContinue;
+    bool closing; // close once the queued output has been sent
     bool sentContinue;
-    time_t lastActivity;
+    unsigned long lastActivity; // monotonic ms of the last successful recv/send
+    unsigned long requestStart; // monotonic ms when the first byte of the current request arrived
+    bool readingBody;           // headers of the buffered request are complete, body is not
+    bool cgiBody;               // that body goes into the stdin of a CGI started at the head
     int port;
-    bool chunkedMode;
-    bool chunkComplete;
-    std::string chunkDecoded;
-    size_t contentLength;
-    size_t bodyStart;
+    HttpRequestParser parser; // progress through inBuffer, kept across reads
     FileStreamState fileStream;
+    int pollMask; // interest currently registered with the EventPoller
+    bool queued;  // already in Reactor::readyQueue
 
     ClientState()
-        : outOffset(0),
-          keepAlive(false),
+        : keepAlive(false),
           closing(false),
-          expectContinue(false),
           sentContinue(false),
           lastActivity(0),
+          requestStart(0),
+          readingBody(false),
+          cgiBody(false),
           port(0),
-          chunkedMode(false),
-          chunkComplete(false),
-          contentLength(0),
-          bodyStart(0) {}
+          pollMask(EVENT_READ),
+          queued(false) {}
+};
+
+// A connection passed to another event loop: freshly accepted, or an idle
+// keep-alive connection moved off an overloaded loop
+struct Handoff {
+    int fd;
+    int port;
+    unsigned long lastActivity;
+
+    Handoff(int f, int p, unsigned long last) : fd(f), port(p), lastActivity(last) {}
+};
+
+// State owned by one event loop. The single-threaded server runs one Reactor;
+// worker_threads N runs N of them, each touched only by its own thread except
+// for the handoff inbox.
+struct Reactor {
+    int index;
+    EventPoller* poller;
+    std::map<int, ClientState> clients;
+    // CGI state tracking (client fd -> CGI state)
+    std::map<int, CgiState> cgiStates;
+    // CGI pipe fd -> owning client fd, to route poller events back to cgiStates
+    std::map<int, int> cgiPipeOwners;
+    // Client fds whose CGI hit stdout EOF and still has to be reaped
+    std::vector<int> cgiExitPending;
+    // Keep-alive connections to fastcgi_pass backends, requests keyed by client fd
+    FastCgiClient fastcgi;
+    // Pre-spawned interpreters of cgi_pool locations, requests keyed by client fd
+    CgiPool cgiPool;
+    // Connections with unprocessed input or resumable work (pipelined requests)
+    std::deque<int> readyQueue;
+    // Idle, header-read, keep-alive and CGI deadlines
+    TimerWheel timers;
+    // Small static files with their serialized headers
+    StaticFileCache fileCache;
+    // Path resolution, stat() results and open descriptors of static files
+    OpenFileCache openFiles;
+
+    // Cross-thread handoff, only used with worker_threads > 1
+    pthread_mutex_t inboxLock;
+    std::vector<Handoff> inbox; // guarded by inboxLock
+    int load;                   // connections owned plus queued in inbox, guarded by inboxLock
+    int wakeFds[2];             // self-pipe that interrupts poller->wait() when the inbox fills
+    unsigned long nextRebalance;
+
+    explicit Reactor(unsigned long nowMs)
+        : index(0), poller(NULL), timers(nowMs), load(0), nextRebalance(0) {
+        pthread_mutex_init(&inboxLock, NULL);
+        wakeFds[0] = wakeFds[1] = -1;
+    }
+    ~Reactor() {
+        delete poller;
+        if (wakeFds[0] != -1) close(wakeFds[0]);
+        if (wakeFds[1] != -1) close(wakeFds[1]);
+        pthread_mutex_destroy(&inboxLock);
+    }
+
+private:
+    Reactor(const Reactor&);
+    Reactor& operator=(const Reactor&);
 };
 
 class Server {
 public:
     Server(const std::string& configFile);
+    ~Server();
     void start();
     void stop();
     
 private:
+    Server(const Server&);
+    Server& operator=(const Server&);
+
     void parseConfig(const std::string& configFile);
-    std::pair<std::string, const LocationConfig*> matchLocation(const ConfigParser::ServerConfig& serverConfig, const std::string& path) const;
     const LocationConfig& findLocationConfig(const ConfigParser::ServerConfig& serverConfig, const std::string& path) const;
-    std::string resolvePath(const ConfigParser::ServerConfig& config, const std::string& basePath, const std::string& relativePath) const;
+    static void compileLocations(ConfigParser::ServerConfig& config);
+    void openRootDirectories();
+    const RootDirectory& mapRequestPath(const ConfigParser::ServerConfig& config, const LocationConfig& location,
+                                        const std::string& uri, std::string& sub) const;
+    static void lookupBeneath(const RootDirectory& root, const std::string& sub, OpenFileCache::Entry& file, bool openFile);
+    std::string resolveRequestPath(const ConfigParser::ServerConfig& config, const LocationConfig& location,
+                                   const std::string& uri) const;
+    std::string resolvePath(const std::string& basePath, const std::string& relativePath) const;
     void serveErrorPage(HttpResponse& response, int statusCode, const ConfigParser::ServerConfig& config);
-    std::set<std::string> getAllowedMethodsForPath(const std::string& path, const ConfigParser::ServerConfig& config) const;
 
-    void dispatchRequest(int clientFd, HttpRequest& request, HttpResponse& response, 
+    void dispatchRequest(Reactor& reactor, int clientFd, HttpRequest& request, HttpResponse& response, 
                          const ConfigParser::ServerConfig& config, bool& responsReady, ClientState& state);
     
     // Specific HTTP method handlers
-    void handleGetHeadRequest(HttpRequest& request, HttpResponse& response,
+    void handleGetHeadRequest(Reactor& reactor, HttpRequest& request, HttpResponse& response,
                               const ConfigParser::ServerConfig& config,
                               const LocationConfig& locConfig,
-                              const std::string& effectiveRoot,
                               bool isHead,
                               FileStreamState& streamPlan);
+    const OpenFileCache::Entry& lookupStaticFile(Reactor& reactor, const ConfigParser::ServerConfig& config,
+                                                 const LocationConfig& locConfig, const std::string& uri);
     void handlePostRequest(HttpRequest& request, HttpResponse& response,
                            const ConfigParser::ServerConfig& config,
                            const LocationConfig& locConfig,
-                           const std::string& effectiveRoot);
+                           const std::string& effectiveRoot,
+                           std::string& changedPath);
     void handlePutRequest(HttpRequest& request, HttpResponse& response,
                           const ConfigParser::ServerConfig& config,
                           const LocationConfig& locConfig,
-                          const std::string& effectiveRoot);
+                          const std::string& effectiveRoot,
+                          std::string& changedPath);
     void handleDeleteRequest(HttpRequest& request, HttpResponse& response,
                              const ConfigParser::ServerConfig& config,
                              const LocationConfig& locConfig,
-                             const std::string& effectiveRoot);
-    void handleOptionsRequest(HttpRequest& request, HttpResponse& response,
-                              const ConfigParser::ServerConfig& config);
+                             const std::string& effectiveRoot,
+                             std::string& changedPath);
+    void handleOptionsRequest(HttpResponse& response, const LocationConfig& locConfig);
     
     // CGI Handler (now non-blocking)
-    bool startCgiRequest(int clientFd, HttpRequest& request,
+    bool startCgiRequest(Reactor& reactor, int clientFd, HttpRequest& request,
                           const ConfigParser::ServerConfig& config,
                           const LocationConfig& locConfig,
                          const std::string& effectiveRoot,
-                         bool isHead);
+                         bool isHead, bool bodyFollows = false);
+    bool startFastCgiRequest(Reactor& reactor, int clientFd, HttpRequest& request,
+                             const ConfigParser::ServerConfig& config,
+                             const LocationConfig& locConfig,
+                             bool isHead);
+    bool startPooledCgiRequest(Reactor& reactor, int clientFd, HttpRequest& request,
+                               const ConfigParser::ServerConfig& config,
+                               const LocationConfig& locConfig,
+                               const std::string& scriptFilename,
+                               bool isHead);
     
     // CGI helpers for main loop
-    void handleCgiWrite(int clientFd, CgiState& cgi);
-    void handleCgiRead(int clientFd, CgiState& cgi);
-    void finalizeCgiRequest(int clientFd, CgiState& cgi, int status, std::string& responseBuffer);
+    void handleCgiWrite(Reactor& reactor, int clientFd, CgiState& cgi);
+    void handleCgiRead(Reactor& reactor, int clientFd, CgiState& cgi);
+    void finalizeCgiRequest(Reactor& reactor, int clientFd, CgiState& cgi, int status);
+    void buildCgiResponse(int clientFd, CgiState& cgi, HttpResponse& response);
+    bool streamCgiOutput(Reactor& reactor, int clientFd, CgiState& cgi);
+    void endCgiRequest(Reactor& reactor, int clientFd, bool failed);
                           
     // Utility
     
     // Config selection
-    const ConfigParser::ServerConfig& selectConfig(int port, const std::string& hostHeader) const;
+    const ConfigParser::ServerConfig& selectConfig(int port, const StringRef& hostHeader) const;
 
     // Event-loop helpers to keep start() readable
     void buildPortMapping(std::set<int>& portsToBind);
-    bool bindListeningSockets(const std::set<int>& portsToBind);
-    void initMasterFdSets(fd_set& master_read, fd_set& master_write, int& fdmax) const;
-    void buildFdSets(const fd_set& master_read, const fd_set& master_write,
-                     fd_set& read_fds, fd_set& write_fds, int fdmax, int& loopFdMax);
-    void handleClientTimeouts(std::map<int, ClientState>& clients,
-                              fd_set& master_read, fd_set& master_write, time_t now);
-    void handleCgiTimeouts(std::map<int, ClientState>& clients,
-                           fd_set& master_write, int& fdmax, time_t now);
-    void acceptConnections(fd_set& master_read, int& fdmax,
-                           std::map<int, ClientState>& clients, time_t now);
-    void processCgiIo(fd_set& read_fds, fd_set& write_fds,
-                      fd_set& master_write, int& fdmax,
-                      std::map<int, ClientState>& clients);
-    void processClientReads(fd_set& read_fds, fd_set& master_read, fd_set& master_write,
-                            int& fdmax, std::map<int, ClientState>& clients,
-                            time_t now);
-    void processClientWrites(fd_set& write_fds, fd_set& master_read, fd_set& master_write,
-                             std::map<int, ClientState>& clients, time_t now);
+    bool bindListeningSockets(const std::set<int>& portsToBind, bool reusePort);
+    bool runEventLoop(const std::set<int>& portsToBind, bool reusePort);
+
+    // Multi-process mode (worker_processes), see ServerWorkers.cpp
+    int resolveWorkerCount() const;
+    void runMaster(const std::set<int>& portsToBind, int workerCount);
+    pid_t spawnWorker(const std::set<int>& portsToBind, int slot);
+    bool registerListeningSockets(Reactor& reactor);
+    bool configureFileCaches(Reactor& reactor);
+    void startCgiPools(Reactor& reactor);
+    bool runReactorPass(Reactor& reactor, std::vector<PollEvent>& events);
+
+    // Multi-threaded mode (worker_threads), see ServerThreads.cpp
+    int resolveThreadCount() const;
+    bool runThreadedLoops(int threadCount);
+    static void* reactorThreadMain(void* arg);
+    Reactor& leastLoadedReactor();
+    void handOff(Reactor& target, const Handoff& handoff);
+    void syncReactor(Reactor& reactor);
+    void rebalanceReactor(Reactor& reactor, unsigned long now);
+
+    // Event-loop helpers, always called on the thread that owns 'reactor'
+    void adoptClient(Reactor& reactor, int fd, int port, unsigned long lastActivity);
+    void refreshClient(Reactor& reactor, int fd, ClientState& state);
+    void armCgiTimer(Reactor& reactor, int clientFd, CgiState& cgi);
+    void watchCgiPipes(Reactor& reactor, int clientFd, CgiState& cgi);
+    void unwatchCgiPipe(Reactor& reactor, int& pipeFd);
+    void throttleCgiOutput(Reactor& reactor, int clientFd, ClientState& state);
+    void cleanupCgi(Reactor& reactor, int clientFd);
+    void closeClientFd(Reactor& reactor, int fd);
+    void detachClient(Reactor& reactor, int fd);
+    void handleExpiredTimers(Reactor& reactor, unsigned long now);
+    void acceptConnections(Reactor& reactor, const std::vector<PollEvent>& events, unsigned long now);
+    void processCgiIo(Reactor& reactor, const std::vector<PollEvent>& events);
+    void processFastCgiIo(Reactor& reactor, const std::vector<PollEvent>& events);
+    void processCgiPoolIo(Reactor& reactor, const std::vector<PollEvent>& events);
+    void applyBackendUpdate(Reactor& reactor, CgiBackend backend, int clientFd, bool finished, bool failed,
+                            unsigned long now);
+    void completeCgiRequest(Reactor& reactor, int clientFd, HttpResponse& response);
+    void processClientReads(Reactor& reactor, const std::vector<PollEvent>& events, unsigned long now);
+    void scheduleClient(Reactor& reactor, int fd, ClientState& state);
+    void processReadyClients(Reactor& reactor);
+    void processBufferedRequests(Reactor& reactor, int fd, ClientState& state);
+    bool startsBodyStreamingCgi(const ConfigParser::ServerConfig& config, const HttpRequest& request) const;
+    bool feedCgiBody(Reactor& reactor, int fd, ClientState& state);
+    void queueFinalResponse(ClientState& state, HttpResponse& response, bool isHead, bool keepAlive);
+    void processClientWrites(Reactor& reactor, const std::vector<PollEvent>& events, unsigned long now);
 
     std::string configPath;
+    ConfigParser::GlobalConfig globalConfig;
     std::vector<ConfigParser::ServerConfig> serverConfigs;
-    ConfigParser::ServerConfig currentConfig; // Fallback
+    const ConfigParser::ServerConfig* currentConfig; // Fallback, the first server block
     std::vector<int> serverSockets;
     
-    // Mapping from port to list of configs (for multi-port/host support)
-    std::map<int, std::vector<const ConfigParser::ServerConfig*> > portToConfigs;
+    // Server blocks of each port, indexed by server_name
+    std::map<int, ServerNameTable> portToHosts;
     // Mapping from server socket fd to port
     std::map<int, int> socketPortMap;
-    
-    // CGI state tracking (client fd -> CGI state)
-    std::map<int, CgiState> cgiStates;
+    // Event loops of worker_threads mode; fixed once their threads are running
+    std::vector<Reactor*> reactors;
+    // Root directory descriptors opened at startup, see openRootDirectories()
+    std::vector<int> rootFds;
 };
 
 #endif // SERVER_HPP
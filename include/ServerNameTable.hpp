@@ -0,0 +1,68 @@
+#ifndef SERVERNAMETABLE_HPP
+#define SERVERNAMETABLE_HPP
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include "ConfigParser.hpp"
+#include "RegexSet.hpp"
+#include "StringRef.hpp"
+
+// The server blocks listening on one port, indexed by server_name. Names are
+// lowercased into hash tables when the configuration is loaded: exact names,
+// `*.example.com` suffixes and `www.*` prefixes. `.example.com` stands for both
+// example.com and *.example.com, and `~re` names go into one RegexSet. As in
+// nginx, an exact name wins, then the longest suffix wildcard, then the longest
+// prefix wildcard, then the first regex in file order, and otherwise the first
+// server block on the port. Lookups hash the Host header in place and do not
+// allocate.
+class ServerNameTable {
+public:
+    ServerNameTable();
+
+    // Adds all names of config; call compile() once every block has been added
+    void add(const ConfigParser::ServerConfig* config);
+    void compile();
+
+    // Server block for a Host header value (a port suffix is ignored)
+    const ConfigParser::ServerConfig* match(const StringRef& host) const;
+
+private:
+    // Open-addressing hash table from a lowercase name to its server block
+    class NameMap {
+    public:
+        NameMap();
+
+        // The block already holding name, or config when it was inserted
+        const ConfigParser::ServerConfig* insert(const std::string& name, const ConfigParser::ServerConfig* config);
+        // Case-insensitive lookup, NULL when absent
+        const ConfigParser::ServerConfig* find(const char* name, size_t length) const;
+
+    private:
+        struct Slot {
+            std::string name;
+            const ConfigParser::ServerConfig* config; // NULL marks a free slot
+
+            Slot() : config(NULL) {}
+        };
+
+        static size_t hash(const char* name, size_t length);
+        void grow();
+
+        std::vector<Slot> slots; // size is a power of two, at most half full
+        size_t used;
+    };
+
+    void addName(NameMap& map, const std::string& name, const std::string& original,
+                 const ConfigParser::ServerConfig* config);
+
+    const ConfigParser::ServerConfig* defaultServer;
+    NameMap exact;
+    NameMap suffixes; // "*.example.com" stored as ".example.com"
+    NameMap prefixes; // "www.*" stored as "www."
+    RegexSet regexes;
+    std::vector<const ConfigParser::ServerConfig*> regexTargets; // block of each RegexSet pattern
+};
+
+#endif // SERVERNAMETABLE_HPP
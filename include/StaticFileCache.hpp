@@ -0,0 +1,56 @@
+#ifndef STATICFILECACHE_HPP
+#define STATICFILECACHE_HPP
+
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include <cstddef>
+#include <ctime>
+#include <list>
+#include <map>
+#include <string>
+
+#include "HttpResponse.hpp"
+
+// Size-bounded LRU of small static files, each kept together with its complete
+// response header blocks, so a hit costs neither open()/read() nor formatting.
+// Entries are checked against the caller's stat() by inode, size and mtime.
+// Every event loop owns its own cache.
+class StaticFileCache {
+public:
+    static const size_t MAX_FILE_BYTES = 64 * 1024; // larger files are streamed with sendfile()
+
+    StaticFileCache();
+    ~StaticFileCache();
+
+    void setCapacity(size_t maxBytes); // 0 disables the cache
+
+    // The cached response for path if it still matches st; otherwise the file is
+    // read (through fd when it is not -1) and cached. NULL when caching is off or
+    // the file is too large or unreadable.
+    PreparedResponse* lookup(const std::string& path, const struct stat& st, int fd = -1);
+
+private:
+    struct Entry : public PreparedResponse {
+        std::string path;
+        dev_t device;
+        ino_t inode;
+        off_t size;
+        time_t mtime;
+        size_t cost; // bytes charged against the capacity
+        std::list<Entry*>::iterator lruPos;
+    };
+
+    StaticFileCache(const StaticFileCache&);
+    StaticFileCache& operator=(const StaticFileCache&);
+
+    Entry* load(const std::string& path, const struct stat& st, int fd);
+    void evict(Entry* entry);
+
+    std::map<std::string, Entry*> entries;
+    std::list<Entry*> lru; // most recently used first
+    size_t bytes;
+    size_t capacity;
+};
+
+#endif // STATICFILECACHE_HPP
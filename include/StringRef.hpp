@@ -0,0 +1,48 @@
+#ifndef STRINGREF_HPP
+#define STRINGREF_HPP
+
+#include <cctype>
+#include <cstddef>
+#include <cstring>
+#include <string>
+
+// Non-owning view of bytes kept alive by someone else, for reading parsed
+// request data without copying it into a std::string
+struct StringRef {
+    const char* data;
+    size_t length;
+
+    StringRef() : data(""), length(0) {}
+    StringRef(const char* bytes, size_t size) : data(bytes), length(size) {}
+    StringRef(const std::string& s) : data(s.data()), length(s.size()) {}
+
+    bool empty() const { return length == 0; }
+    size_t size() const { return length; }
+    std::string str() const { return std::string(data, length); }
+
+    bool operator==(const char* literal) const {
+        return strlen(literal) == length && memcmp(data, literal, length) == 0;
+    }
+    bool operator!=(const char* literal) const { return !(*this == literal); }
+
+    // ASCII case-insensitive comparisons, for header values
+    bool equalsIgnoreCase(const char* literal) const {
+        size_t n = strlen(literal);
+        if (n != length) return false;
+        for (size_t i = 0; i < n; ++i) {
+            if (tolower(static_cast<unsigned char>(data[i])) != tolower(static_cast<unsigned char>(literal[i]))) {
+                return false;
+            }
+        }
+        return true;
+    }
+    bool containsIgnoreCase(const char* literal) const {
+        size_t n = strlen(literal);
+        for (size_t start = 0; start + n <= length; ++start) {
+            if (StringRef(data + start, n).equalsIgnoreCase(literal)) return true;
+        }
+        return false;
+    }
+};
+
+#endif // STRINGREF_HPP
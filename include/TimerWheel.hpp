@@ -0,0 +1,51 @@
+#ifndef TIMERWHEEL_HPP
+#define TIMERWHEEL_HPP
+
+#include <cstddef>
+#include <vector>
+
+// Two-level hashed timer wheel keyed by small non-negative integers (e.g. fds).
+// Scheduling, re-arming and cancelling are O(1); expiring N timers costs O(N)
+// plus one step per elapsed tick. Deadlines are absolute monotonic milliseconds.
+class TimerWheel {
+public:
+    static const unsigned long TICK_MS = 100;
+
+    explicit TimerWheel(unsigned long nowMs = 0);
+
+    void schedule(int key, unsigned long deadlineMs); // re-arms if already scheduled
+    void cancel(int key);
+    bool isScheduled(int key) const;
+    size_t size() const;
+
+    // Unschedules every timer due at or before nowMs and appends its key to 'expired'
+    void expire(unsigned long nowMs, std::vector<int>& expired);
+    // Milliseconds until the earliest pending deadline, or -1 when nothing is scheduled
+    long nextTimeoutMs(unsigned long nowMs) const;
+
+private:
+    enum {
+        LEVEL0_SLOTS = 256,
+        LEVEL1_SLOTS = 64,
+        LEVEL0_BITS = 8
+    };
+
+    struct Node {
+        int prev;
+        int next;
+        int slot; // -1 when not scheduled
+        unsigned long tick;
+
+        Node() : prev(-1), next(-1), slot(-1), tick(0) {}
+    };
+
+    void link(int key, unsigned long tick);
+    void unlink(int key);
+
+    std::vector<Node> nodes;
+    int heads[LEVEL0_SLOTS + LEVEL1_SLOTS];
+    unsigned long currentTick;
+    size_t count;
+};
+
+#endif // TIMERWHEEL_HPP
@@ -10,6 +10,14 @@
 #include <unistd.h>   // for access
 #include <cerrno>     // for errno
 
+// Statistics lines (DEBUG[POOL], DEBUG[CGIPOOL], DEBUG[THREADS]) are only written
+// by builds made with "make DEBUG_LOG=1"
+#ifdef WEBSERV_DEBUG_LOG
+static const bool DEBUG_LOG = true;
+#else
+static const bool DEBUG_LOG = false;
+#endif
+
 // Function to split a string by a delimiter
 std::vector<std::string> split(const std::string &s, char delimiter);
 
@@ -28,4 +36,10 @@ bool createDirectoriesRecursively(const std::string& dirPath);
 // Function to delete directories recursively
 bool deleteDirectoryRecursively(const std::string& path);
 
+// Function to read the monotonic clock in milliseconds (unaffected by wall-clock changes)
+unsigned long monotonicMillis();
+
+// Function to create a pipe with both ends close-on-exec
+bool openCloexecPipe(int fds[2]);
+
 #endif // UTILS_HPP
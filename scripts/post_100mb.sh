@@ -7,6 +7,7 @@ set -euo pipefail
 # Examples:
 #   ./scripts/post_100mb.sh http://127.0.0.1:8080/upload 100
 #   ./scripts/post_100mb.sh http://127.0.0.1:8080/upload
+#   CHUNKED=1 ./scripts/post_100mb.sh http://127.0.0.1:8080/upload   # Transfer-Encoding: chunked
 
 URL="${1:-http://127.0.0.1:8080/upload}"
 SIZE_M_STR="${2:-100}"
@@ -18,6 +19,11 @@ fi
 
 SIZE_M="$SIZE_M_STR"
 
+EXTRA_HEADERS=()
+if [ "${CHUNKED:-0}" = "1" ]; then
+  EXTRA_HEADERS=(-H "Transfer-Encoding: chunked")
+fi
+
 TMP_FILE="$(mktemp -t post_body_XXXXXX.bin)"
 trap 'rm -f "$TMP_FILE"' EXIT
 
@@ -38,6 +44,7 @@ set +e
 HTTP_OUTPUT=$(curl -sS -o /dev/null \
   -X POST \
   -H "Content-Type: application/octet-stream" \
+  ${EXTRA_HEADERS[@]+"${EXTRA_HEADERS[@]}"} \
   --data-binary @"$TMP_FILE" \
   -w "code=%{http_code} uploaded=%{size_upload}B time_total=%{time_total}s speed=%{speed_upload}B/s" \
   "$URL")
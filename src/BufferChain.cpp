@@ -0,0 +1,196 @@
+#include "BufferChain.hpp"
+#include "Utils.hpp"
+
+#include <pthread.h>
+
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+const size_t BufferPool::BLOCK_SIZE;
+const size_t BufferPool::MAX_FREE_BLOCKS;
+
+// Shared by every event-loop thread of the process
+static pthread_mutex_t poolLock = PTHREAD_MUTEX_INITIALIZER;
+static std::vector<char*> freeBlocks;
+static BufferPool::Stats poolStats = BufferPool::Stats();
+// High-water marks below this are not worth a log line
+static size_t nextHighWaterLog = 256;
+
+char* BufferPool::acquire() {
+    char* block = NULL;
+    bool logHighWater = false;
+    Stats snapshot;
+
+    pthread_mutex_lock(&poolLock);
+    if (!freeBlocks.empty()) {
+        block = freeBlocks.back();
+        freeBlocks.pop_back();
+    }
+    ++poolStats.inUse;
+    if (poolStats.inUse > poolStats.highWater) {
+        poolStats.highWater = poolStats.inUse;
+        if (poolStats.highWater >= nextHighWaterLog) {
+            nextHighWaterLog *= 2;
+            logHighWater = true;
+        }
+    }
+    if (block == NULL) ++poolStats.allocated;
+    poolStats.free = freeBlocks.size();
+    snapshot = poolStats;
+    pthread_mutex_unlock(&poolLock);
+
+    if (block == NULL) block = new char[BLOCK_SIZE];
+    if (DEBUG_LOG && logHighWater) {
+        std::cerr << "DEBUG[POOL]: " << snapshot.highWater << " buffer blocks in use (high water), "
+                  << snapshot.free << " free, " << snapshot.allocated << " allocated" << std::endl;
+    }
+    return block;
+}
+
+void BufferPool::release(char* block) {
+    pthread_mutex_lock(&poolLock);
+    --poolStats.inUse;
+    bool keep = freeBlocks.size() < MAX_FREE_BLOCKS;
+    if (keep) freeBlocks.push_back(block);
+    poolStats.free = freeBlocks.size();
+    pthread_mutex_unlock(&poolLock);
+    if (!keep) delete[] block;
+}
+
+BufferPool::Stats BufferPool::stats() {
+    pthread_mutex_lock(&poolLock);
+    Stats snapshot = poolStats;
+    pthread_mutex_unlock(&poolLock);
+    return snapshot;
+}
+
+BufferChain::Block BufferChain::newBlock(size_t capacity) {
+    Block block;
+    block.capacity = capacity > BufferPool::BLOCK_SIZE ? capacity : BufferPool::BLOCK_SIZE;
+    block.bytes = block.capacity == BufferPool::BLOCK_SIZE ? BufferPool::acquire() : new char[block.capacity];
+    block.start = 0;
+    block.end = 0;
+    return block;
+}
+
+void BufferChain::freeBlock(Block& block) {
+    if (block.capacity == BufferPool::BLOCK_SIZE) BufferPool::release(block.bytes);
+    else delete[] block.bytes;
+    block.bytes = NULL;
+}
+
+BufferChain::BufferChain() : total(0) {}
+
+BufferChain::BufferChain(const BufferChain& other) : total(0) {
+    *this = other;
+}
+
+BufferChain& BufferChain::operator=(const BufferChain& other) {
+    if (this == &other) return *this;
+    clear();
+    for (std::deque<Block>::const_iterator it = other.blocks.begin(); it != other.blocks.end(); ++it) {
+        append(it->bytes + it->start, it->end - it->start);
+    }
+    return *this;
+}
+
+BufferChain::~BufferChain() {
+    clear();
+}
+
+size_t BufferChain::size() const {
+    return total;
+}
+
+bool BufferChain::empty() const {
+    return total == 0;
+}
+
+const char* BufferChain::data(size_t& length) const {
+    if (blocks.empty()) {
+        length = 0;
+        return NULL;
+    }
+    length = blocks.front().end - blocks.front().start;
+    return blocks.front().bytes + blocks.front().start;
+}
+
+void BufferChain::consume(size_t length) {
+    if (length > total) length = total;
+    total -= length;
+    while (length > 0) {
+        Block& front = blocks.front();
+        size_t inFront = front.end - front.start;
+        if (length < inFront) {
+            front.start += length;
+            return;
+        }
+        length -= inFront;
+        freeBlock(front);
+        blocks.pop_front();
+    }
+}
+
+void BufferChain::pullup(size_t length) {
+    if (length > total) length = total;
+    if (blocks.empty() || blocks.front().end - blocks.front().start >= length) return;
+
+    Block joined = newBlock(length);
+    size_t copied = 0;
+    while (copied < length) {
+        Block& front = blocks.front();
+        size_t take = front.end - front.start;
+        if (take > length - copied) take = length - copied;
+        memcpy(joined.bytes + copied, front.bytes + front.start, take);
+        copied += take;
+        front.start += take;
+        if (front.start == front.end) {
+            freeBlock(front);
+            blocks.pop_front();
+        }
+    }
+    joined.end = copied;
+    blocks.push_front(joined);
+}
+
+char* BufferChain::reserve(size_t& length) {
+    if (blocks.empty() || blocks.back().end == blocks.back().capacity) {
+        blocks.push_back(newBlock(BufferPool::BLOCK_SIZE));
+    }
+    Block& tail = blocks.back();
+    length = tail.capacity - tail.end;
+    return tail.bytes + tail.end;
+}
+
+void BufferChain::commit(size_t length) {
+    Block& tail = blocks.back();
+    if (length == 0 && tail.start == tail.end) {
+        // Nothing was written into a block reserve() just added: an idle buffer holds no memory
+        freeBlock(tail);
+        blocks.pop_back();
+        return;
+    }
+    tail.end += length;
+    total += length;
+}
+
+void BufferChain::append(const char* bytes, size_t length) {
+    while (length > 0) {
+        size_t space;
+        char* dest = reserve(space);
+        size_t take = length < space ? length : space;
+        memcpy(dest, bytes, take);
+        commit(take);
+        bytes += take;
+        length -= take;
+    }
+}
+
+void BufferChain::clear() {
+    for (std::deque<Block>::iterator it = blocks.begin(); it != blocks.end(); ++it) {
+        freeBlock(*it);
+    }
+    blocks.clear();
+    total = 0;
+}
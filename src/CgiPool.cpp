@@ -0,0 +1,415 @@
+#include "CgiPool.hpp"
+#include "Utils.hpp"
+
+#include <fcntl.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+
+static const size_t MAX_LENGTH_LINE = 20; // digits of a response length
+static const size_t FIRST_QUEUE_LOG = 8;  // queue high-water marks below this are not logged
+static const unsigned long FIRST_STATS_LOG = 1000;
+static const size_t READ_PER_EVENT = 256 * 1024; // more waits for the next poll, so a pause takes effect
+
+// Environment the workers start with; each request brings its own in the frame
+static char envPool[] = "WEBSERV_CGI_POOL=1";
+static char envGateway[] = "GATEWAY_INTERFACE=CGI/1.1";
+static char envSoftware[] = "SERVER_SOFTWARE=WebServ/1.0";
+
+CgiPool::Stats::Stats()
+    : workers(0), busy(0), queued(0), maxQueued(0), dispatched(0), totalWaitMs(0), maxWaitMs(0), respawned(0) {}
+
+CgiPool::Worker::Worker() : pid(0), in(-1), out(-1), writing(false), paused(false), owner(-1), sent(0), remaining(-1), served(0) {}
+
+CgiPool::Pool::Pool() : maxRequests(0), nextQueueLog(FIRST_QUEUE_LOG), nextStatsLog(FIRST_STATS_LOG) {}
+
+CgiPool::Request::Request() : pool(NULL), body(NULL), bodyLength(0), output(NULL), queuedAt(0) {}
+
+CgiPool::CgiPool() {}
+
+CgiPool::~CgiPool() {
+    for (std::map<std::string, Pool>::iterator it = pools.begin(); it != pools.end(); ++it) {
+        for (size_t i = 0; i < it->second.workers.size(); ++i) {
+            Worker& worker = it->second.workers[i];
+            if (worker.pid == 0) continue;
+            close(worker.in);
+            close(worker.out);
+            kill(worker.pid, SIGTERM);
+        }
+    }
+}
+
+bool CgiPool::prepare(EventPoller& poller, const std::string& program, size_t size, unsigned maxRequests) {
+    Pool& pool = findPool(program, size, maxRequests);
+    bool live = false;
+    for (size_t slot = 0; slot < pool.workers.size(); ++slot) {
+        if (pool.workers[slot].pid != 0 || spawn(poller, pool, slot)) live = true;
+    }
+    return live;
+}
+
+bool CgiPool::begin(EventPoller& poller, int owner, const std::string& program, size_t size, unsigned maxRequests,
+                    const std::map<std::string, std::string>& env, const char* stdinData, size_t stdinLength,
+                    std::string* output, unsigned long now) {
+    cancel(poller, owner);
+    Pool& pool = findPool(program, size, maxRequests);
+    Request& request = requests[owner];
+    request.pool = &pool;
+    std::string pairs;
+    for (std::map<std::string, std::string>::const_iterator it = env.begin(); it != env.end(); ++it) {
+        pairs += it->first;
+        pairs += '=';
+        pairs += it->second;
+        pairs += '\0';
+    }
+    std::ostringstream header;
+    header << pairs.size() << ' ' << stdinLength << '\n';
+    request.frame = header.str() + pairs;
+    request.body = stdinData;
+    request.bodyLength = stdinLength;
+    request.output = output;
+    request.queuedAt = now;
+
+    pool.queue.push_back(owner);
+    if (pool.queue.size() > pool.stats.maxQueued) {
+        pool.stats.maxQueued = pool.queue.size();
+        if (pool.stats.maxQueued >= pool.nextQueueLog) {
+            pool.nextQueueLog *= 2;
+            logStats(pool);
+        }
+    }
+    dispatch(poller, pool, now);
+
+    for (size_t slot = 0; slot < pool.workers.size(); ++slot) {
+        if (pool.workers[slot].pid != 0) return true;
+    }
+    cancel(poller, owner); // no worker could be started
+    return false;
+}
+
+void CgiPool::cancel(EventPoller& poller, int owner) {
+    std::map<int, Request>::iterator it = requests.find(owner);
+    if (it == requests.end()) return;
+    Pool& pool = *it->second.pool;
+    requests.erase(it);
+
+    std::deque<int>::iterator waiting = std::find(pool.queue.begin(), pool.queue.end(), owner);
+    if (waiting != pool.queue.end()) {
+        pool.queue.erase(waiting);
+        return;
+    }
+    for (size_t slot = 0; slot < pool.workers.size(); ++slot) {
+        if (pool.workers[slot].owner != owner) continue;
+        retire(poller, pool, slot, true);
+        vacated.push_back(std::make_pair(&pool, slot));
+        return;
+    }
+}
+
+void CgiPool::pause(EventPoller& poller, int owner, bool paused) {
+    std::map<int, Request>::iterator it = requests.find(owner);
+    if (it == requests.end()) return;
+    Pool& pool = *it->second.pool;
+    for (size_t slot = 0; slot < pool.workers.size(); ++slot) {
+        Worker& worker = pool.workers[slot];
+        if (worker.owner != owner || worker.paused == paused) continue;
+        if (paused) {
+            poller.remove(worker.out);
+        } else if (!poller.add(worker.out, EVENT_READ)) {
+            return;
+        }
+        worker.paused = paused;
+        return;
+    }
+}
+
+void CgiPool::handleEvents(EventPoller& poller, const std::vector<PollEvent>& events, std::vector<Update>& updates,
+                           unsigned long now) {
+    if (pools.empty()) return;
+    for (size_t i = 0; i < events.size(); ++i) {
+        std::map<int, std::pair<Pool*, size_t> >::iterator it = pipes.find(events[i].fd);
+        if (it == pipes.end()) continue;
+        Pool& pool = *it->second.first;
+        size_t slot = it->second.second;
+        Worker& worker = pool.workers[slot];
+
+        bool ok = true;
+        if (events[i].fd == worker.out) {
+            ok = receive(worker, updates);
+        } else if (worker.owner != -1 && worker.writing) {
+            ok = flush(poller, worker);
+        }
+        if (!ok) {
+            crashed(poller, pool, slot, updates);
+        } else if (worker.owner == -1 && pool.maxRequests > 0 && worker.served >= pool.maxRequests) {
+            retire(poller, pool, slot, false);
+            vacated.push_back(std::make_pair(&pool, slot));
+        }
+    }
+    // Replacements start only now, so their pipes cannot pick up stale events from this batch
+    for (size_t i = 0; i < vacated.size(); ++i) {
+        Pool& pool = *vacated[i].first;
+        if (pool.workers[vacated[i].second].pid == 0 && spawn(poller, pool, vacated[i].second)) {
+            ++pool.stats.respawned;
+        }
+    }
+    vacated.clear();
+    for (std::map<std::string, Pool>::iterator it = pools.begin(); it != pools.end(); ++it) {
+        if (!it->second.queue.empty()) dispatch(poller, it->second, now);
+    }
+    if (!exited.empty()) reap();
+}
+
+bool CgiPool::stats(const std::string& program, Stats& out) const {
+    std::map<std::string, Pool>::const_iterator it = pools.find(program);
+    if (it == pools.end()) return false;
+    const Pool& pool = it->second;
+    out = pool.stats;
+    out.workers = 0;
+    out.busy = 0;
+    for (size_t i = 0; i < pool.workers.size(); ++i) {
+        if (pool.workers[i].pid != 0) ++out.workers;
+        if (pool.workers[i].owner != -1) ++out.busy;
+    }
+    out.queued = pool.queue.size();
+    return true;
+}
+
+bool CgiPool::reaping() const {
+    return !exited.empty();
+}
+
+CgiPool::Pool& CgiPool::findPool(const std::string& program, size_t size, unsigned maxRequests) {
+    Pool& pool = pools[program];
+    if (pool.workers.empty()) {
+        pool.program = program;
+        pool.maxRequests = maxRequests;
+        pool.workers.resize(std::max(size, static_cast<size_t>(1)));
+    }
+    return pool;
+}
+
+bool CgiPool::spawn(EventPoller& poller, Pool& pool, size_t slot) {
+    if (access(pool.program.c_str(), X_OK) != 0) {
+        std::cerr << "CGI pool program not found or not executable: " << pool.program << std::endl;
+        return false;
+    }
+    int toChild[2];
+    int fromChild[2];
+    if (!openCloexecPipe(toChild)) {
+        std::cerr << "Pipe failed: " << strerror(errno) << std::endl;
+        return false;
+    }
+    if (!openCloexecPipe(fromChild)) {
+        std::cerr << "Pipe failed: " << strerror(errno) << std::endl;
+        close(toChild[0]);
+        close(toChild[1]);
+        return false;
+    }
+
+    // Everything the child needs is built before fork() so it does not allocate
+    char* argv[2];
+    argv[0] = const_cast<char*>(pool.program.c_str());
+    argv[1] = NULL;
+    char* envp[4] = {envPool, envGateway, envSoftware, NULL};
+
+    pid_t pid = fork();
+    if (pid == -1) {
+        std::cerr << "Fork failed: " << strerror(errno) << std::endl;
+        close(toChild[0]);
+        close(toChild[1]);
+        close(fromChild[0]);
+        close(fromChild[1]);
+        return false;
+    }
+    if (pid == 0) {
+        if (dup2(toChild[0], STDIN_FILENO) == -1 || dup2(fromChild[1], STDOUT_FILENO) == -1) _exit(EXIT_FAILURE);
+        execve(argv[0], argv, envp);
+        _exit(EXIT_FAILURE);
+    }
+    close(toChild[0]);
+    close(fromChild[1]);
+    fcntl(toChild[1], F_SETFL, fcntl(toChild[1], F_GETFL, 0) | O_NONBLOCK);
+    fcntl(fromChild[0], F_SETFL, fcntl(fromChild[0], F_GETFL, 0) | O_NONBLOCK);
+
+    Worker& worker = pool.workers[slot];
+    worker = Worker();
+    worker.pid = pid;
+    worker.in = toChild[1];
+    worker.out = fromChild[0];
+    pipes[worker.in] = std::make_pair(&pool, slot);
+    pipes[worker.out] = std::make_pair(&pool, slot);
+    if (!poller.add(worker.out, EVENT_READ)) {
+        retire(poller, pool, slot, true);
+        return false;
+    }
+    return true;
+}
+
+// Takes a worker out of its slot; a live one exits on stdin EOF unless killed
+void CgiPool::retire(EventPoller& poller, Pool& pool, size_t slot, bool killIt) {
+    Worker& worker = pool.workers[slot];
+    if (worker.pid == 0) return;
+    if (worker.writing) poller.remove(worker.in);
+    if (!worker.paused) poller.remove(worker.out);
+    pipes.erase(worker.in);
+    pipes.erase(worker.out);
+    close(worker.in);
+    close(worker.out);
+    if (killIt) kill(worker.pid, SIGKILL);
+    exited.push_back(worker.pid);
+    worker = Worker();
+}
+
+// Replaces a worker that died or broke the protocol, failing its request
+void CgiPool::crashed(EventPoller& poller, Pool& pool, size_t slot, std::vector<Update>& updates) {
+    Worker& worker = pool.workers[slot];
+    int owner = worker.owner;
+    bool warm = worker.served > 0;
+    std::cerr << "CGI pool worker " << worker.pid << " of " << pool.program << " stopped"
+              << (owner != -1 ? " during a request" : "") << std::endl;
+    retire(poller, pool, slot, true);
+    if (owner != -1) {
+        requests.erase(owner);
+        updates.push_back(Update(owner, true, true));
+    }
+    // One that never served a request probably cannot start; it is retried on demand, not in a loop
+    if (warm) vacated.push_back(std::make_pair(&pool, slot));
+}
+
+// Hands queued requests to idle workers, starting processes for empty slots
+void CgiPool::dispatch(EventPoller& poller, Pool& pool, unsigned long now) {
+    for (size_t slot = 0; slot < pool.workers.size() && !pool.queue.empty(); ++slot) {
+        Worker& worker = pool.workers[slot];
+        if (worker.pid == 0 && !spawn(poller, pool, slot)) continue;
+        if (worker.owner != -1) continue;
+
+        int owner = pool.queue.front();
+        pool.queue.pop_front();
+        unsigned long waited = now - requests[owner].queuedAt;
+        pool.stats.totalWaitMs += waited;
+        pool.stats.maxWaitMs = std::max(pool.stats.maxWaitMs, waited);
+        ++pool.stats.dispatched;
+        worker.owner = owner;
+        worker.sent = 0;
+        worker.line.clear();
+        worker.remaining = -1;
+        // A failed write shows up as EOF on the worker's stdout
+        flush(poller, worker);
+    }
+    if (pool.stats.dispatched >= pool.nextStatsLog) {
+        pool.nextStatsLog *= 2;
+        logStats(pool);
+    }
+}
+
+// Writes as much of the request frame as the pipe takes; false when the worker is gone
+bool CgiPool::flush(EventPoller& poller, Worker& worker) {
+    const Request& request = requests[worker.owner];
+    size_t total = request.frame.size() + request.bodyLength;
+    bool ok = true;
+    while (worker.sent < total) {
+        const char* data;
+        size_t length;
+        if (worker.sent < request.frame.size()) {
+            data = request.frame.data() + worker.sent;
+            length = request.frame.size() - worker.sent;
+        } else {
+            data = request.body + (worker.sent - request.frame.size());
+            length = total - worker.sent;
+        }
+        ssize_t written = write(worker.in, data, length);
+        if (written < 0) {
+            if (errno == EINTR) continue;
+            ok = errno == EAGAIN || errno == EWOULDBLOCK;
+            break;
+        }
+        worker.sent += written;
+    }
+    bool pending = ok && worker.sent < total;
+    if (pending != worker.writing) {
+        if (pending) poller.add(worker.in, EVENT_WRITE);
+        else poller.remove(worker.in);
+        worker.writing = pending;
+    }
+    return ok;
+}
+
+// Reads response frames into their requests' output; false on EOF or a protocol error
+bool CgiPool::receive(Worker& worker, std::vector<Update>& updates) {
+    char buffer[16384];
+    size_t total = 0;
+    while (true) {
+        ssize_t bytesRead = read(worker.out, buffer, sizeof(buffer));
+        if (bytesRead < 0) {
+            if (errno == EINTR) continue;
+            return errno == EAGAIN || errno == EWOULDBLOCK;
+        }
+        if (bytesRead == 0) return false;
+
+        size_t length = static_cast<size_t>(bytesRead);
+        size_t pos = 0;
+        while (pos < length) {
+            if (worker.owner == -1) return false; // output nobody asked for
+            if (worker.remaining < 0) {
+                const char* newline = static_cast<const char*>(memchr(buffer + pos, '\n', length - pos));
+                size_t take = newline != NULL ? newline - (buffer + pos) : length - pos;
+                worker.line.append(buffer + pos, take);
+                pos += take;
+                if (worker.line.size() > MAX_LENGTH_LINE) return false;
+                if (newline == NULL) break;
+                ++pos;
+                if (worker.line.empty() || worker.line.find_first_not_of("0123456789") != std::string::npos) {
+                    return false;
+                }
+                worker.remaining = std::strtol(worker.line.c_str(), NULL, 10);
+                worker.line.clear();
+            }
+            size_t take = std::min(static_cast<size_t>(worker.remaining), length - pos);
+            requests[worker.owner].output->append(buffer + pos, take);
+            pos += take;
+            worker.remaining -= take;
+            if (worker.remaining > 0) {
+                updates.push_back(Update(worker.owner, false, false));
+                continue;
+            }
+            updates.push_back(Update(worker.owner, true, false));
+            const Request& request = requests[worker.owner];
+            // Answering before reading the whole body leaves the rest in the pipe as a bogus next frame
+            bool inSync = worker.sent == request.frame.size() + request.bodyLength;
+            requests.erase(worker.owner);
+            worker.owner = -1;
+            worker.remaining = -1;
+            ++worker.served;
+            if (!inSync) return false;
+        }
+        total += length;
+        if (length < sizeof(buffer) || total >= READ_PER_EVENT) return true;
+    }
+}
+
+void CgiPool::reap() {
+    std::vector<pid_t> running;
+    for (size_t i = 0; i < exited.size(); ++i) {
+        if (waitpid(exited[i], NULL, WNOHANG) == 0) running.push_back(exited[i]);
+    }
+    exited.swap(running);
+}
+
+void CgiPool::logStats(const Pool& pool) const {
+    if (!DEBUG_LOG) return;
+    Stats current;
+    stats(pool.program, current);
+    std::cerr << "DEBUG[CGIPOOL]: " << pool.program << ": " << current.workers << " workers, " << current.busy
+              << " busy, " << current.queued << " queued (max " << current.maxQueued << "), wait avg "
+              << (current.dispatched ? current.totalWaitMs / current.dispatched : 0) << " ms max "
+              << current.maxWaitMs << " ms over " << current.dispatched << " requests, " << current.respawned
+              << " respawned" << std::endl;
+}
@@ -1,6 +1,30 @@
 #include "ConfigParser.hpp"
+#include "FastCgiClient.hpp"
 #include "Utils.hpp"
 
+// Parses a byte count with an optional k/m/g suffix ("8k", "100m")
+static bool parseSize(const std::string& value, long& out) {
+    char suffix = ' ';
+    std::string sizeStr = value;
+    if (!value.empty()) {
+        suffix = static_cast<char>(std::tolower(static_cast<unsigned char>(value[value.length() - 1])));
+        if (suffix == 'k' || suffix == 'm' || suffix == 'g') {
+            sizeStr.erase(sizeStr.length() - 1);
+        } else {
+            suffix = ' ';
+        }
+    }
+    long size_val = 0;
+    std::istringstream converter(sizeStr);
+    if (!(converter >> size_val) || size_val < 0) return false;
+
+    if (suffix == 'k') size_val *= 1024;
+    else if (suffix == 'm') size_val *= 1024 * 1024;
+    else if (suffix == 'g') size_val *= 1024 * 1024 * 1024;
+    out = size_val;
+    return true;
+}
+
 ConfigParser::ConfigParser(const std::string& configFile) : configFile(configFile) {
     // Constructor - configuration will be parsed when parse() is called
 }
@@ -19,9 +43,10 @@ void ConfigParser::parse() {
         if (line == "server {") {
             servers.push_back(ServerConfig());
             parseServerBlock(file, line);
+        } else if (line == "events {") {
+            parseEventsBlock(file, line);
         } else if (!line.empty()) {
-            // Global directives can be parsed here if any, or throw error for unexpected token
-             std::cerr << "Warning: Ignoring unexpected line outside of server block: " << line << std::endl;
+            parseGlobalDirective(line);
         }
     }
     file.close();
@@ -84,7 +109,11 @@ void ConfigParser::parseServerBlock(std::ifstream& file, std::string& line) {
                 if (!ports[i].empty()) currentServer.listenPorts.push_back(ports[i]);
             }
         } else if (directive == "server_name") {
-            currentServer.serverName = value;
+            std::vector<std::string> names = split(value, ' ');
+            for (size_t i = 0; i < names.size(); ++i) {
+                if (names[i] == "\"\"") currentServer.serverNames.push_back(""); // matches requests without a Host
+                else if (!names[i].empty()) currentServer.serverNames.push_back(names[i]);
+            }
         } else if (directive == "root") {
             currentServer.root = value;
             // Update default location's root if it hasn't been set by a specific location block yet
@@ -112,30 +141,15 @@ void ConfigParser::parseServerBlock(std::ifstream& file, std::string& line) {
                 }
             }
         } else if (directive == "client_max_body_size") {
-            try {
-                char suffix = ' ';
-                long size_val = 0;
-                std::string sizeStr = value;
-                if (!value.empty()) {
-                    suffix = static_cast<char>(std::tolower(static_cast<unsigned char>(value[value.length() - 1])));
-                    if (suffix == 'k' || suffix == 'm' || suffix == 'g') {
-                        sizeStr.erase(sizeStr.length() - 1);
-                    } else {
-                        suffix = ' ';
-                    }
-                }
-                std::istringstream converter(sizeStr);
-                if (!(converter >> size_val)) {
-                    throw std::invalid_argument("Invalid number format for size");
-                }
-
-                if (suffix == 'k') size_val *= 1024;
-                else if (suffix == 'm') size_val *= 1024 * 1024;
-                else if (suffix == 'g') size_val *= 1024 * 1024 * 1024;
-                currentServer.clientMaxBodySize = size_val;
-            } catch (const std::exception& e) {
+            if (!parseSize(value, currentServer.clientMaxBodySize)) {
                 std::cerr << "Warning: Invalid client_max_body_size '" << value << "'." << std::endl;
             }
+        } else if (directive == "client_body_buffer_size") {
+            if (!parseSize(value, currentServer.clientBodyBufferSize)) {
+                std::cerr << "Warning: Invalid client_body_buffer_size '" << value << "'." << std::endl;
+            }
+        } else if (directive == "client_body_temp_path") {
+            currentServer.clientBodyTempPath = value;
         } else if (directive == "location") {
             std::string locationPath;
             std::string modifier;
@@ -184,6 +198,7 @@ void ConfigParser::parseServerBlock(std::ifstream& file, std::string& line) {
 
             LocationConfig newLocation;
             newLocation.setPath(locationPath);
+            newLocation.setModifier(modifier);
             // Inherit server's root by default for the new location
             if (!currentServer.root.empty()) {
                 newLocation.setRoot(currentServer.root);
@@ -195,12 +210,18 @@ void ConfigParser::parseServerBlock(std::ifstream& file, std::string& line) {
 
             // std::cerr << "DEBUG: Parsing location block for path: '" << locationPath << "'" << std::endl;
             parseLocationBlock(file, line, newLocation, false);
-            currentServer.locations[locationPath] = newLocation;
+            if (modifier == "=") {
+                currentServer.exactLocations[locationPath] = newLocation;
+            } else if (newLocation.isRegex()) {
+                currentServer.regexLocations.push_back(newLocation);
+            } else {
+                currentServer.locations[locationPath] = newLocation;
+            }
             // std::cerr << "DEBUG: Added location '" << locationPath << "' with root '" << newLocation.getRoot() << "'" << std::endl;
         }
         // Default settings for the server (applied if no specific location matches)
         // These are parsed like location block directives but applied to currentServer.defaultLocationSettings
-        else if (directive == "autoindex" || directive == "allow_methods" || directive == "return" || directive == "cgi_pass" || directive == "upload_store" || directive == "index") {
+        else if (directive == "autoindex" || directive == "allow_methods" || directive == "return" || directive == "cgi_pass" || directive == "fastcgi_pass" || directive == "fastcgi_multiplex" || directive == "cgi_pool" || directive == "upload_store" || directive == "index") {
              // Re-process this line as if it's inside a "default" location block
              // This is a bit of a hack; ideally, parseLocationBlock would be more generic
              // or we'd have a separate function for server-level location-like directives.
@@ -213,6 +234,115 @@ void ConfigParser::parseServerBlock(std::ifstream& file, std::string& line) {
     }
 }
 
+void ConfigParser::parseGlobalDirective(const std::string& line) {
+    std::string directive = line;
+    std::string value;
+    size_t first_space = line.find_first_of(" \t");
+    if (first_space != std::string::npos) {
+        directive = line.substr(0, first_space);
+        value = trim(line.substr(first_space + 1));
+    }
+    size_t hashPos = value.find('#');
+    if (hashPos != std::string::npos) value = trim(value.substr(0, hashPos));
+    if (!value.empty() && value[value.length() - 1] == ';') {
+        value.erase(value.length() - 1);
+        value = trim(value);
+    }
+
+    if (directive == "worker_processes") {
+        if (value == "auto") {
+            global.workerProcesses = 0;
+            return;
+        }
+        int count = 0;
+        std::istringstream converter(value);
+        if (!(converter >> count) || count < 1) {
+            std::cerr << "Warning: Invalid worker_processes '" << value << "'." << std::endl;
+            return;
+        }
+        global.workerProcesses = count;
+    } else if (directive == "worker_threads") {
+        if (value == "auto") {
+            global.workerThreads = 0;
+            return;
+        }
+        int count = 0;
+        std::istringstream converter(value);
+        if (!(converter >> count) || count < 1) {
+            std::cerr << "Warning: Invalid worker_threads '" << value << "'." << std::endl;
+            return;
+        }
+        global.workerThreads = count;
+    } else if (directive == "worker_cpu_affinity") {
+        if (value == "auto" || value == "on") global.workerCpuAffinity = true;
+        else if (value == "off") global.workerCpuAffinity = false;
+        else std::cerr << "Warning: Invalid worker_cpu_affinity '" << value << "'." << std::endl;
+    } else if (directive == "static_file_cache") {
+        if (value == "off") global.staticFileCacheBytes = 0;
+        else if (!parseSize(value, global.staticFileCacheBytes)) {
+            std::cerr << "Warning: Invalid static_file_cache '" << value << "'." << std::endl;
+        }
+    } else if (directive == "open_file_cache") {
+        if (value == "off") {
+            global.openFileCacheEntries = 0;
+            return;
+        }
+        int count = 0;
+        std::istringstream converter(value);
+        if (!(converter >> count) || count < 1) {
+            std::cerr << "Warning: Invalid open_file_cache '" << value << "'." << std::endl;
+            return;
+        }
+        global.openFileCacheEntries = count;
+    } else if (directive == "open_file_cache_valid") {
+        int seconds = 0;
+        std::istringstream converter(value);
+        if (!(converter >> seconds) || seconds < 1) {
+            std::cerr << "Warning: Invalid open_file_cache_valid '" << value << "'." << std::endl;
+            return;
+        }
+        global.openFileCacheValidSec = seconds;
+    } else if (directive == "open_file_cache_inotify") {
+        if (value == "on") global.openFileCacheInotify = true;
+        else if (value == "off") global.openFileCacheInotify = false;
+        else std::cerr << "Warning: Invalid open_file_cache_inotify '" << value << "'." << std::endl;
+    } else {
+        std::cerr << "Warning: Ignoring unexpected line outside of server block: " << line << std::endl;
+    }
+}
+
+void ConfigParser::parseEventsBlock(std::ifstream& file, std::string& line) {
+    while (std::getline(file, line)) {
+        line = trim(line);
+        size_t hashPos = line.find('#');
+        if (hashPos != std::string::npos) line = trim(line.substr(0, hashPos));
+        if (line.empty()) continue;
+        if (line == "}") return;
+
+        std::string directive = line;
+        std::string value;
+        size_t first_space = line.find_first_of(" \t");
+        if (first_space != std::string::npos) {
+            directive = line.substr(0, first_space);
+            value = trim(line.substr(first_space + 1));
+        }
+        if (!value.empty() && value[value.length() - 1] == ';') {
+            value.erase(value.length() - 1);
+            value = trim(value);
+        }
+
+        if (directive == "use") {
+            if (value == "epoll" || value == "select") {
+                global.eventBackend = value;
+            } else {
+                std::cerr << "Warning: Unknown event backend '" << value << "' in events block." << std::endl;
+            }
+        } else {
+            std::cerr << "Warning: Unknown directive '" << directive << "' in events block." << std::endl;
+        }
+    }
+}
+
 void ConfigParser::parseLocationBlock(std::ifstream& file, std::string& line, LocationConfig& location, bool isDefaultSettingsParse) {
     // If isDefaultSettingsParse is true, 'line' contains the directive to parse directly.
     // Otherwise, we are inside a 'location {}' block and need to read lines until the matching '}'.
@@ -270,7 +400,17 @@ void ConfigParser::parseLocationBlock(std::ifstream& file, std::string& line, Lo
                 location.setIndex(indices[0]);
             }
         } else if (directive == "allow_methods" || directive == "methods") {
-            std::vector<std::string> methods = split(loc_value, ' ');
+            std::vector<std::string> names = split(loc_value, ' ');
+            unsigned methods = 0;
+            for (size_t i = 0; i < names.size(); ++i) {
+                if (names[i].empty()) continue;
+                HttpMethod method = parseHttpMethod(names[i]);
+                if (method == METHOD_UNKNOWN) {
+                    std::cerr << "Warning: Ignoring unknown method '" << names[i] << "' in location block for path '" << location.getPath() << "'." << std::endl;
+                    continue;
+                }
+                methods |= method;
+            }
             location.setMethods(methods);
         } else if (directive == "return") { 
             location.setRedirect(loc_value);
@@ -278,12 +418,38 @@ void ConfigParser::parseLocationBlock(std::ifstream& file, std::string& line, Lo
             location.setAutoindex(loc_value == "on");
         } else if (directive == "cgi_pass") {
             location.setCgiPass(loc_value);
+        } else if (directive == "fastcgi_pass") {
+            struct sockaddr_storage addr;
+            socklen_t addrLength;
+            if (FastCgiClient::parseAddress(loc_value, addr, addrLength)) {
+                location.setFastCgiPass(loc_value);
+            } else {
+                std::cerr << "Warning: Invalid fastcgi_pass '" << loc_value << "' in location block for path '" << location.getPath() << "'." << std::endl;
+            }
+        } else if (directive == "fastcgi_multiplex") {
+            int requests = 0;
+            std::istringstream converter(loc_value);
+            if (!(converter >> requests) || requests < 1) {
+                std::cerr << "Warning: Invalid fastcgi_multiplex '" << loc_value << "' in location block for path '" << location.getPath() << "'." << std::endl;
+            } else {
+                location.setFastCgiMultiplex(requests);
+            }
+        } else if (directive == "cgi_pool") {
+            // cgi_pool <workers> [max_requests]
+            int workers = 0;
+            int maxRequests = 0;
+            std::istringstream converter(loc_value);
+            if (!(converter >> workers) || workers < 1 || (!(converter >> maxRequests) && !converter.eof()) || maxRequests < 0) {
+                std::cerr << "Warning: Invalid cgi_pool '" << loc_value << "' in location block for path '" << location.getPath() << "'." << std::endl;
+            } else {
+                location.setCgiPool(workers, maxRequests);
+            }
         } else if (directive == "upload_store") {
             location.setUploadStore(loc_value);
         } else if (!isDefaultSettingsParse) {
             // Unknown directive inside a location block
             std::cerr << "Warning: Unknown directive '" << directive << "' in location block for path '" << location.getPath() << "'." << std::endl;
-        } else if (isDefaultSettingsParse && directive != "autoindex" && directive != "allow_methods" && directive != "return" && directive != "cgi_pass" && directive != "upload_store" && directive != "index") {
+        } else if (isDefaultSettingsParse && directive != "autoindex" && directive != "allow_methods" && directive != "return" && directive != "cgi_pass" && directive != "fastcgi_pass" && directive != "fastcgi_multiplex" && directive != "cgi_pool" && directive != "upload_store" && directive != "index") {
             std::cerr << "Warning: Unexpected directive '" << directive << "' while parsing default server settings." << std::endl;
         }
 
@@ -295,3 +461,7 @@ void ConfigParser::parseLocationBlock(std::ifstream& file, std::string& line, Lo
 const std::vector<ConfigParser::ServerConfig>& ConfigParser::getServers() const {
     return servers;
 }
+
+const ConfigParser::GlobalConfig& ConfigParser::getGlobal() const {
+    return global;
+}
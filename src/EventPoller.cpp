@@ -0,0 +1,169 @@
+#include "EventPoller.hpp"
+
+#include <fcntl.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+
+#ifndef WEBSERV_DEFAULT_EVENT_BACKEND
+#ifdef __linux__
+#define WEBSERV_DEFAULT_EVENT_BACKEND "epoll"
+#else
+#define WEBSERV_DEFAULT_EVENT_BACKEND "select"
+#endif
+#endif
+
+EventPoller* EventPoller::create(const std::string& backend) {
+    std::string wanted = backend.empty() ? WEBSERV_DEFAULT_EVENT_BACKEND : backend;
+#ifdef __linux__
+    if (wanted == "epoll") {
+        return new EpollPoller();
+    }
+#endif
+    if (wanted != "select") {
+        std::cerr << "Warning: event backend '" << wanted << "' is not available, using select" << std::endl;
+    }
+    return new SelectPoller();
+}
+
+// ---- select() backend -------------------------------------------------------
+
+SelectPoller::SelectPoller() {
+    FD_ZERO(&readSet);
+    FD_ZERO(&writeSet);
+}
+
+bool SelectPoller::add(int fd, int events) {
+    if (fd < 0 || fd >= FD_SETSIZE) {
+        std::cerr << "select backend cannot watch fd " << fd << " (FD_SETSIZE " << FD_SETSIZE << ")" << std::endl;
+        return false;
+    }
+    interest[fd] = 0;
+    return modify(fd, events);
+}
+
+bool SelectPoller::modify(int fd, int events) {
+    std::map<int, int>::iterator it = interest.find(fd);
+    if (it == interest.end()) return false;
+    it->second = events;
+    if (events & EVENT_READ) FD_SET(fd, &readSet); else FD_CLR(fd, &readSet);
+    if (events & EVENT_WRITE) FD_SET(fd, &writeSet); else FD_CLR(fd, &writeSet);
+    return true;
+}
+
+void SelectPoller::remove(int fd) {
+    std::map<int, int>::iterator it = interest.find(fd);
+    if (it == interest.end()) return;
+    FD_CLR(fd, &readSet);
+    FD_CLR(fd, &writeSet);
+    interest.erase(it);
+}
+
+int SelectPoller::wait(std::vector<PollEvent>& ready, int timeoutMs) {
+    ready.clear();
+    fd_set readFds = readSet;
+    fd_set writeFds = writeSet;
+    int fdmax = interest.empty() ? -1 : interest.rbegin()->first;
+
+    struct timeval tv;
+    struct timeval* tvp = NULL;
+    if (timeoutMs >= 0) {
+        tv.tv_sec = timeoutMs / 1000;
+        tv.tv_usec = (timeoutMs % 1000) * 1000;
+        tvp = &tv;
+    }
+    int nready = select(fdmax + 1, &readFds, &writeFds, NULL, tvp);
+    if (nready <= 0) return nready;
+
+    for (std::map<int, int>::const_iterator it = interest.begin(); it != interest.end(); ++it) {
+        int events = 0;
+        if (FD_ISSET(it->first, &readFds)) events |= EVENT_READ;
+        if (FD_ISSET(it->first, &writeFds)) events |= EVENT_WRITE;
+        if (events) ready.push_back(PollEvent(it->first, events));
+    }
+    return static_cast<int>(ready.size());
+}
+
+const char* SelectPoller::name() const {
+    return "select";
+}
+
+// ---- epoll backend ----------------------------------------------------------
+
+#ifdef __linux__
+static unsigned int toEpollMask(int events) {
+    unsigned int mask = 0;
+    if (events & EVENT_READ) mask |= EPOLLIN;
+    if (events & EVENT_WRITE) mask |= EPOLLOUT;
+    return mask;
+}
+
+EpollPoller::EpollPoller() : epfd(-1), registered(0) {
+    epfd = epoll_create(1024);
+    if (epfd != -1) {
+        int flags = fcntl(epfd, F_GETFD, 0);
+        if (flags != -1) fcntl(epfd, F_SETFD, flags | FD_CLOEXEC);
+    } else {
+        std::cerr << "epoll_create failed: " << strerror(errno) << std::endl;
+    }
+}
+
+EpollPoller::~EpollPoller() {
+    if (epfd != -1) close(epfd);
+}
+
+bool EpollPoller::add(int fd, int events) {
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = toEpollMask(events);
+    ev.data.fd = fd;
+    if (epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev) != 0) {
+        std::cerr << "epoll_ctl(ADD, " << fd << ") failed: " << strerror(errno) << std::endl;
+        return false;
+    }
+    ++registered;
+    return true;
+}
+
+bool EpollPoller::modify(int fd, int events) {
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = toEpollMask(events);
+    ev.data.fd = fd;
+    return epoll_ctl(epfd, EPOLL_CTL_MOD, fd, &ev) == 0;
+}
+
+void EpollPoller::remove(int fd) {
+    struct epoll_event ev; // non-NULL for pre-2.6.9 kernels
+    memset(&ev, 0, sizeof(ev));
+    if (epoll_ctl(epfd, EPOLL_CTL_DEL, fd, &ev) == 0 && registered > 0) --registered;
+}
+
+int EpollPoller::wait(std::vector<PollEvent>& ready, int timeoutMs) {
+    static const size_t MIN_BATCH = 64;
+    static const size_t MAX_BATCH = 4096;
+    size_t batch = registered < MIN_BATCH ? MIN_BATCH : (registered > MAX_BATCH ? MAX_BATCH : registered);
+    if (events.size() < batch) events.resize(batch);
+
+    ready.clear();
+    int nready = epoll_wait(epfd, &events[0], static_cast<int>(batch), timeoutMs);
+    if (nready <= 0) return nready;
+
+    ready.reserve(nready);
+    for (int i = 0; i < nready; ++i) {
+        int mask = 0;
+        if (events[i].events & EPOLLIN) mask |= EVENT_READ;
+        if (events[i].events & EPOLLOUT) mask |= EVENT_WRITE;
+        if (events[i].events & (EPOLLERR | EPOLLHUP)) mask |= EVENT_ERROR;
+        ready.push_back(PollEvent(events[i].data.fd, mask));
+    }
+    return nready;
+}
+
+const char* EpollPoller::name() const {
+    return "epoll";
+}
+#endif
@@ -0,0 +1,504 @@
+#include "FastCgiClient.hpp"
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+// Record types and flags of the FastCGI 1.0 specification
+enum {
+    FCGI_VERSION_1 = 1,
+    FCGI_BEGIN_REQUEST = 1,
+    FCGI_ABORT_REQUEST = 2,
+    FCGI_END_REQUEST = 3,
+    FCGI_PARAMS = 4,
+    FCGI_STDIN = 5,
+    FCGI_STDOUT = 6,
+    FCGI_STDERR = 7,
+    FCGI_RESPONDER = 1,
+    FCGI_KEEP_CONN = 1,
+    FCGI_REQUEST_COMPLETE = 0,
+    FCGI_CANT_MPX_CONN = 1
+};
+
+static const size_t HEADER_SIZE = 8;
+static const size_t MAX_RECORD_CONTENT = 65535;
+static const size_t STDIN_CHUNK = 32768;    // body bytes queued per request and round
+static const size_t SEND_LOW_WATER = 65536; // the send buffer is refilled below this
+static const size_t IDLE_PER_BACKEND = 16;  // keep-alive connections parked per address
+static const unsigned MAX_MULTIPLEX = 1024;
+static const int MAX_ATTEMPTS = 2;
+static const size_t READ_PER_EVENT = 256 * 1024; // more waits for the next poll, so a pause takes effect
+
+static void appendRecord(std::string& out, int type, unsigned id, const char* content, size_t length) {
+    size_t padding = (8 - length % 8) % 8;
+    char header[HEADER_SIZE];
+    header[0] = FCGI_VERSION_1;
+    header[1] = static_cast<char>(type);
+    header[2] = static_cast<char>((id >> 8) & 0xff);
+    header[3] = static_cast<char>(id & 0xff);
+    header[4] = static_cast<char>((length >> 8) & 0xff);
+    header[5] = static_cast<char>(length & 0xff);
+    header[6] = static_cast<char>(padding);
+    header[7] = 0;
+    out.append(header, HEADER_SIZE);
+    if (length > 0) out.append(content, length);
+    out.append(padding, '\0');
+}
+
+// Copies records built with request id 0, stamping id into each header
+static void appendWithId(std::string& out, const std::string& records, unsigned id) {
+    size_t pos = out.size();
+    out += records;
+    while (pos + HEADER_SIZE <= out.size()) {
+        out[pos + 2] = static_cast<char>((id >> 8) & 0xff);
+        out[pos + 3] = static_cast<char>(id & 0xff);
+        size_t length = (static_cast<unsigned char>(out[pos + 4]) << 8) | static_cast<unsigned char>(out[pos + 5]);
+        pos += HEADER_SIZE + length + static_cast<unsigned char>(out[pos + 6]);
+    }
+}
+
+static void appendLength(std::string& out, size_t length) {
+    if (length < 128) {
+        out += static_cast<char>(length);
+        return;
+    }
+    out += static_cast<char>(0x80 | ((length >> 24) & 0x7f));
+    out += static_cast<char>((length >> 16) & 0xff);
+    out += static_cast<char>((length >> 8) & 0xff);
+    out += static_cast<char>(length & 0xff);
+}
+
+FastCgiClient::Request::Request()
+    : multiplex(1),
+      stdinData(NULL),
+      stdinLength(0),
+      stdinQueued(0),
+      stdinClosed(false),
+      output(NULL),
+      fd(-1),
+      id(0),
+      responded(false),
+      paused(false),
+      attempts(0) {}
+
+FastCgiClient::Connection::Connection()
+    : connecting(false), reusable(true), capacity(1), served(0), outPos(0), inPos(0), nextId(1), mask(0) {}
+
+FastCgiClient::FastCgiClient() {}
+
+FastCgiClient::~FastCgiClient() {
+    for (std::map<int, Connection>::const_iterator it = connections.begin(); it != connections.end(); ++it) {
+        close(it->first);
+    }
+}
+
+bool FastCgiClient::parseAddress(const std::string& address, struct sockaddr_storage& addr, socklen_t& length) {
+    memset(&addr, 0, sizeof(addr));
+    if (address.compare(0, 5, "unix:") == 0) {
+        struct sockaddr_un* un = reinterpret_cast<struct sockaddr_un*>(&addr);
+        std::string path = address.substr(5);
+        if (path.empty() || path.size() >= sizeof(un->sun_path)) return false;
+        un->sun_family = AF_UNIX;
+        memcpy(un->sun_path, path.c_str(), path.size() + 1);
+        length = sizeof(struct sockaddr_un);
+        return true;
+    }
+
+    size_t colon = address.rfind(':');
+    std::string host = colon == std::string::npos ? "" : address.substr(0, colon);
+    std::string port = colon == std::string::npos ? address : address.substr(colon + 1);
+    if (host.empty() || host == "localhost") host = "127.0.0.1";
+    if (port.empty() || port.find_first_not_of("0123456789") != std::string::npos || port.size() > 5) return false;
+    long number = std::strtol(port.c_str(), NULL, 10);
+    if (number <= 0 || number > 65535) return false;
+
+    struct sockaddr_in* in = reinterpret_cast<struct sockaddr_in*>(&addr);
+    if (inet_pton(AF_INET, host.c_str(), &in->sin_addr) != 1) return false;
+    in->sin_family = AF_INET;
+    in->sin_port = htons(static_cast<unsigned short>(number));
+    length = sizeof(struct sockaddr_in);
+    return true;
+}
+
+bool FastCgiClient::begin(EventPoller& poller, int owner, const std::string& address, unsigned multiplex,
+                          const std::map<std::string, std::string>& params, const char* stdinData,
+                          size_t stdinLength, std::string* output) {
+    cancel(poller, owner);
+    Request& request = requests[owner];
+    request.address = address;
+    request.multiplex = std::max(1u, std::min(multiplex, MAX_MULTIPLEX));
+    request.stdinData = stdinData;
+    request.stdinLength = stdinLength;
+    request.output = output;
+
+    char body[8] = {0, FCGI_RESPONDER, FCGI_KEEP_CONN, 0, 0, 0, 0, 0};
+    appendRecord(request.head, FCGI_BEGIN_REQUEST, 0, body, sizeof(body));
+    // Pairs are never split across records; php-fpm decodes each record on its own
+    std::string pairs;
+    for (std::map<std::string, std::string>::const_iterator it = params.begin(); it != params.end(); ++it) {
+        std::string pair;
+        appendLength(pair, it->first.size());
+        appendLength(pair, it->second.size());
+        pair += it->first;
+        pair += it->second;
+        if (pair.size() > MAX_RECORD_CONTENT) {
+            std::cerr << "Warning: FastCGI param " << it->first << " is too long, not sent." << std::endl;
+            continue;
+        }
+        if (pairs.size() + pair.size() > MAX_RECORD_CONTENT) {
+            appendRecord(request.head, FCGI_PARAMS, 0, pairs.data(), pairs.size());
+            pairs.clear();
+        }
+        pairs += pair;
+    }
+    if (!pairs.empty()) appendRecord(request.head, FCGI_PARAMS, 0, pairs.data(), pairs.size());
+    appendRecord(request.head, FCGI_PARAMS, 0, "", 0);
+
+    if (!assign(poller, owner, request)) {
+        requests.erase(owner);
+        return false;
+    }
+    return true;
+}
+
+void FastCgiClient::cancel(EventPoller& poller, int owner) {
+    std::map<int, Request>::iterator it = requests.find(owner);
+    if (it == requests.end()) return;
+    int fd = it->second.fd;
+    unsigned short id = it->second.id;
+    requests.erase(it);
+    if (fd == -1) {
+        retries.erase(std::remove(retries.begin(), retries.end(), owner), retries.end());
+        return;
+    }
+
+    Connection& conn = connections[fd];
+    conn.ids[id] = -1;
+    for (std::map<unsigned short, int>::const_iterator slot = conn.ids.begin(); slot != conn.ids.end(); ++slot) {
+        if (slot->second >= 0) {
+            // Other requests share the connection: abort ours and drop its records until END_REQUEST
+            appendRecord(conn.out, FCGI_ABORT_REQUEST, id, "", 0);
+            watch(poller, fd, conn);
+            return;
+        }
+    }
+    closeConnection(poller, fd);
+}
+
+void FastCgiClient::pause(EventPoller& poller, int owner, bool paused) {
+    std::map<int, Request>::iterator it = requests.find(owner);
+    if (it == requests.end() || it->second.paused == paused) return;
+    it->second.paused = paused;
+    if (it->second.fd != -1) watch(poller, it->second.fd, connections[it->second.fd]);
+}
+
+void FastCgiClient::handleEvents(EventPoller& poller, const std::vector<PollEvent>& events,
+                                 std::vector<Update>& updates) {
+    for (size_t i = 0; i < events.size(); ++i) {
+        int fd = events[i].fd;
+        std::map<int, Connection>::iterator it = connections.find(fd);
+        if (it == connections.end()) continue;
+        Connection& conn = it->second;
+
+        if (conn.connecting) {
+            if (!(events[i].events & (EVENT_WRITE | EVENT_ERROR))) continue;
+            int error = 0;
+            socklen_t length = sizeof(error);
+            if (getsockopt(fd, SOL_SOCKET, SO_ERROR, &error, &length) == -1) error = errno;
+            if (error != 0) {
+                std::cerr << "FastCGI backend " << conn.address << ": " << strerror(error) << std::endl;
+                fail(poller, fd, updates);
+                continue;
+            }
+            conn.connecting = false;
+        }
+
+        bool open = true;
+        if (events[i].events & (EVENT_READ | EVENT_ERROR)) open = receive(fd, conn, updates);
+        if (open && (events[i].events & EVENT_WRITE)) open = flush(fd, conn);
+        if (!open) {
+            fail(poller, fd, updates);
+        } else if (conn.ids.empty()) {
+            release(poller, fd);
+        } else {
+            watch(poller, fd, conn);
+        }
+    }
+
+    // Retries open their connections only now, so a new socket never sees a stale event of this batch
+    std::vector<int> pending;
+    pending.swap(retries);
+    for (size_t i = 0; i < pending.size(); ++i) {
+        std::map<int, Request>::iterator it = requests.find(pending[i]);
+        if (it == requests.end() || assign(poller, it->first, it->second)) continue;
+        requests.erase(it);
+        updates.push_back(Update(pending[i], true, true));
+    }
+}
+
+int FastCgiClient::connectTo(const std::string& address, unsigned multiplex) {
+    struct sockaddr_storage addr;
+    socklen_t length;
+    if (!parseAddress(address, addr, length)) {
+        std::cerr << "FastCGI backend " << address << ": invalid address" << std::endl;
+        return -1;
+    }
+    // Close-on-exec at creation: with worker_threads a sibling thread may fork a CGI at any moment
+#ifdef __linux__
+    int fd = socket(addr.ss_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+#else
+    int fd = socket(addr.ss_family, SOCK_STREAM, 0);
+    if (fd != -1) {
+        fcntl(fd, F_SETFD, FD_CLOEXEC);
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+    }
+#endif
+    if (fd == -1) {
+        std::cerr << "FastCGI socket failed: " << strerror(errno) << std::endl;
+        return -1;
+    }
+    if (addr.ss_family == AF_INET) {
+        int on = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+    }
+    bool connecting = false;
+    if (connect(fd, reinterpret_cast<struct sockaddr*>(&addr), length) == -1) {
+        if (errno != EINPROGRESS) {
+            std::cerr << "FastCGI backend " << address << ": " << strerror(errno) << std::endl;
+            close(fd);
+            return -1;
+        }
+        connecting = true;
+    }
+
+    Connection& conn = connections[fd];
+    conn = Connection();
+    conn.address = address;
+    conn.connecting = connecting;
+    conn.capacity = multiplex;
+    pools[address].push_back(fd);
+    return fd;
+}
+
+bool FastCgiClient::assign(EventPoller& poller, int owner, Request& request) {
+    int fd = -1;
+    std::map<std::string, std::vector<int> >::const_iterator pool = pools.find(request.address);
+    for (size_t i = 0; pool != pools.end() && i < pool->second.size(); ++i) {
+        const Connection& candidate = connections[pool->second[i]];
+        if (candidate.reusable && candidate.ids.size() < candidate.capacity) {
+            fd = pool->second[i];
+            break;
+        }
+    }
+    if (fd == -1 && (fd = connectTo(request.address, request.multiplex)) == -1) return false;
+
+    Connection& conn = connections[fd];
+    while (conn.nextId == 0 || conn.ids.find(conn.nextId) != conn.ids.end()) ++conn.nextId;
+    request.fd = fd;
+    request.id = conn.nextId++;
+    request.stdinQueued = 0;
+    request.stdinClosed = false;
+    request.responded = false;
+    ++request.attempts;
+    conn.ids[request.id] = owner;
+    appendWithId(conn.out, request.head, request.id);
+    pump(conn);
+    // A socket that connected at once takes the request now; failures surface as its next event
+    if (!conn.connecting) flush(fd, conn);
+    watch(poller, fd, conn);
+    return true;
+}
+
+// Queues STDIN records round-robin over the connection's requests until the send buffer is full
+void FastCgiClient::pump(Connection& conn) {
+    bool progress = true;
+    while (progress && conn.out.size() - conn.outPos < SEND_LOW_WATER) {
+        progress = false;
+        for (std::map<unsigned short, int>::const_iterator it = conn.ids.begin(); it != conn.ids.end(); ++it) {
+            if (it->second < 0) continue;
+            Request& request = requests[it->second];
+            if (request.stdinClosed) continue;
+            size_t chunk = std::min(STDIN_CHUNK, request.stdinLength - request.stdinQueued);
+            // An empty record ends the stream
+            appendRecord(conn.out, FCGI_STDIN, it->first, request.stdinData + request.stdinQueued, chunk);
+            request.stdinQueued += chunk;
+            request.stdinClosed = chunk == 0;
+            progress = true;
+        }
+    }
+}
+
+void FastCgiClient::watch(EventPoller& poller, int fd, Connection& conn) {
+    // An idle connection is read to notice the backend closing it; aborted requests still send records
+    bool reading = conn.ids.empty();
+    for (std::map<unsigned short, int>::const_iterator it = conn.ids.begin(); it != conn.ids.end() && !reading; ++it) {
+        std::map<int, Request>::const_iterator request = requests.find(it->second);
+        reading = request == requests.end() || !request->second.paused;
+    }
+    int mask = reading ? EVENT_READ : 0;
+    if (conn.connecting || conn.outPos < conn.out.size()) mask |= EVENT_WRITE;
+    if (mask == conn.mask) return;
+    if (mask == 0) {
+        poller.remove(fd);
+        conn.mask = 0;
+    } else if (conn.mask == 0 ? poller.add(fd, mask) : poller.modify(fd, mask)) {
+        conn.mask = mask;
+    }
+}
+
+// Sends queued records; false when the connection broke
+bool FastCgiClient::flush(int fd, Connection& conn) {
+    int flags = 0;
+#ifdef MSG_NOSIGNAL
+    flags |= MSG_NOSIGNAL;
+#endif
+    while (true) {
+        if (conn.out.size() - conn.outPos < SEND_LOW_WATER) {
+            conn.out.erase(0, conn.outPos);
+            conn.outPos = 0;
+            pump(conn);
+        }
+        if (conn.outPos == conn.out.size()) return true;
+        ssize_t sent = send(fd, conn.out.data() + conn.outPos, conn.out.size() - conn.outPos, flags);
+        if (sent < 0) {
+            if (errno == EINTR) continue;
+            return errno == EAGAIN || errno == EWOULDBLOCK;
+        }
+        conn.outPos += sent;
+    }
+}
+
+// Reads what the backend sent and dispatches complete records; false once the connection is gone
+bool FastCgiClient::receive(int fd, Connection& conn, std::vector<Update>& updates) {
+    bool open = true;
+    char buffer[16384];
+    size_t total = 0;
+    while (true) {
+        ssize_t received = recv(fd, buffer, sizeof(buffer), 0);
+        if (received > 0) {
+            conn.in.append(buffer, received);
+            total += received;
+            if (static_cast<size_t>(received) < sizeof(buffer) || total >= READ_PER_EVENT) break;
+            continue;
+        }
+        if (received < 0 && errno == EINTR) continue;
+        if (received == 0 || (errno != EAGAIN && errno != EWOULDBLOCK)) open = false;
+        break;
+    }
+
+    // Records that arrived before a close still count
+    while (conn.in.size() - conn.inPos >= HEADER_SIZE) {
+        const unsigned char* header = reinterpret_cast<const unsigned char*>(conn.in.data()) + conn.inPos;
+        size_t length = (header[4] << 8) | header[5];
+        size_t total = HEADER_SIZE + length + header[6];
+        if (conn.in.size() - conn.inPos < total) break;
+        if (header[0] != FCGI_VERSION_1) {
+            std::cerr << "FastCGI backend " << conn.address << ": bad record version" << std::endl;
+            return false;
+        }
+        conn.inPos += total;
+        unsigned short id = static_cast<unsigned short>((header[2] << 8) | header[3]);
+        const char* content = reinterpret_cast<const char*>(header) + HEADER_SIZE;
+
+        std::map<unsigned short, int>::iterator slot = conn.ids.find(id);
+        if (slot == conn.ids.end()) continue; // management records, or a request already finished
+        int owner = slot->second;
+        if (header[1] == FCGI_END_REQUEST) {
+            if (length < 8) return false;
+            conn.ids.erase(slot);
+            if (owner < 0) continue;
+            Request& request = requests[owner];
+            // STDIN records still on their way would reach the backend after the request ended
+            if (!request.stdinClosed || conn.outPos < conn.out.size()) conn.reusable = false;
+            int status = static_cast<unsigned char>(content[4]);
+            if (status == FCGI_REQUEST_COMPLETE) {
+                ++conn.served;
+                requests.erase(owner);
+                updates.push_back(Update(owner, true, false));
+            } else if (status == FCGI_CANT_MPX_CONN) {
+                conn.capacity = 1;
+                retryOrFail(owner, true, updates);
+            } else {
+                std::cerr << "FastCGI backend " << conn.address << " refused request, status " << status << std::endl;
+                retryOrFail(owner, false, updates);
+            }
+            continue;
+        }
+        if (owner < 0) continue;
+        Request& request = requests[owner];
+        request.responded = true;
+        if (header[1] == FCGI_STDOUT) {
+            request.output->append(content, length);
+            updates.push_back(Update(owner, false, false));
+        } else if (header[1] == FCGI_STDERR && length > 0) {
+            std::string message(content, length);
+            while (!message.empty() && (message[message.size() - 1] == '\n' || message[message.size() - 1] == '\r')) {
+                message.erase(message.size() - 1);
+            }
+            std::cerr << "FastCGI stderr: " << message << std::endl;
+        }
+    }
+    conn.in.erase(0, conn.inPos);
+    conn.inPos = 0;
+    return open;
+}
+
+// Drops a broken connection; its requests are retried when it had been reused, else they fail
+void FastCgiClient::fail(EventPoller& poller, int fd, std::vector<Update>& updates) {
+    const Connection& conn = connections[fd];
+    bool reused = conn.served > 0;
+    std::vector<int> owners;
+    for (std::map<unsigned short, int>::const_iterator it = conn.ids.begin(); it != conn.ids.end(); ++it) {
+        if (it->second >= 0) owners.push_back(it->second);
+    }
+    closeConnection(poller, fd);
+    for (size_t i = 0; i < owners.size(); ++i) retryOrFail(owners[i], reused, updates);
+}
+
+void FastCgiClient::retryOrFail(int owner, bool retryable, std::vector<Update>& updates) {
+    Request& request = requests[owner];
+    request.fd = -1;
+    if (retryable && !request.responded && request.attempts < MAX_ATTEMPTS) {
+        retries.push_back(owner);
+        return;
+    }
+    requests.erase(owner);
+    updates.push_back(Update(owner, true, true));
+}
+
+// Parks a connection whose requests all finished, unless enough of its backend's already are
+void FastCgiClient::release(EventPoller& poller, int fd) {
+    Connection& conn = connections[fd];
+    size_t idle = 0;
+    const std::vector<int>& pool = pools[conn.address];
+    for (size_t i = 0; i < pool.size(); ++i) {
+        if (connections[pool[i]].ids.empty()) ++idle;
+    }
+    if (!conn.reusable || idle > IDLE_PER_BACKEND) {
+        closeConnection(poller, fd);
+    } else {
+        watch(poller, fd, conn);
+    }
+}
+
+void FastCgiClient::closeConnection(EventPoller& poller, int fd) {
+    std::map<int, Connection>::iterator it = connections.find(fd);
+    if (it == connections.end()) return;
+    std::map<std::string, std::vector<int> >::iterator pool = pools.find(it->second.address);
+    if (pool != pools.end()) {
+        pool->second.erase(std::remove(pool->second.begin(), pool->second.end(), fd), pool->second.end());
+        if (pool->second.empty()) pools.erase(pool);
+    }
+    if (it->second.mask != 0) poller.remove(fd);
+    connections.erase(it);
+    close(fd);
+}
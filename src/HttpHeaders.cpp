@@ -0,0 +1,175 @@
+#include "HttpHeaders.hpp"
+
+#include <cctype>
+#include <cstring>
+
+struct KnownHeaderName {
+    const char* name;
+    KnownHeader header;
+};
+
+// Perfect hash of the known names: (4 * first + 23 * last + length) % 32 over
+// the lowercase bytes is distinct for every one of them
+static const size_t HASH_SLOTS = 32;
+static const KnownHeaderName KNOWN_HEADERS[HASH_SLOTS] = {
+    {"range", HEADER_RANGE},                             // 0
+    {"content-disposition", HEADER_CONTENT_DISPOSITION}, // 1
+    {"transfer-encoding", HEADER_TRANSFER_ENCODING},     // 2
+    {NULL, HEADER_UNKNOWN},
+    {"origin", HEADER_ORIGIN},                           // 4
+    {"cookie", HEADER_COOKIE},                           // 5
+    {"expect", HEADER_EXPECT},                           // 6
+    {NULL, HEADER_UNKNOWN},
+    {"if-modified-since", HEADER_IF_MODIFIED_SINCE},     // 8
+    {"if-none-match", HEADER_IF_NONE_MATCH},             // 9
+    {"user-agent", HEADER_USER_AGENT},                   // 10
+    {"content-type", HEADER_CONTENT_TYPE},               // 11
+    {NULL, HEADER_UNKNOWN},
+    {"referer", HEADER_REFERER},                         // 13
+    {"upgrade", HEADER_UPGRADE},                         // 14
+    {NULL, HEADER_UNKNOWN},
+    {"host", HEADER_HOST},                               // 16
+    {NULL, HEADER_UNKNOWN},
+    {"content-length", HEADER_CONTENT_LENGTH},           // 18
+    {"authorization", HEADER_AUTHORIZATION},             // 19
+    {"accept-encoding", HEADER_ACCEPT_ENCODING},         // 20
+    {NULL, HEADER_UNKNOWN},
+    {"accept", HEADER_ACCEPT},                           // 22
+    {NULL, HEADER_UNKNOWN},
+    {"connection", HEADER_CONNECTION},                   // 24
+    {NULL, HEADER_UNKNOWN},
+    {NULL, HEADER_UNKNOWN},
+    {NULL, HEADER_UNKNOWN},
+    {NULL, HEADER_UNKNOWN},
+    {"x-filename", HEADER_X_FILENAME},                   // 29
+    {NULL, HEADER_UNKNOWN},
+    {"if-range", HEADER_IF_RANGE},                       // 31
+};
+
+static unsigned char lowerByte(char c) {
+    return static_cast<unsigned char>(tolower(static_cast<unsigned char>(c)));
+}
+
+static bool equalsIgnoreCase(const char* a, size_t aLength, const char* b, size_t bLength) {
+    if (aLength != bLength) return false;
+    for (size_t i = 0; i < aLength; ++i) {
+        if (lowerByte(a[i]) != lowerByte(b[i])) return false;
+    }
+    return true;
+}
+
+HttpHeaders::HttpHeaders() : head("") {
+    clear();
+}
+
+KnownHeader HttpHeaders::lookup(const char* name, size_t length) {
+    if (length == 0) return HEADER_UNKNOWN;
+    size_t slot = (4 * lowerByte(name[0]) + 23 * lowerByte(name[length - 1]) + length) % HASH_SLOTS;
+    const KnownHeaderName& candidate = KNOWN_HEADERS[slot];
+    if (candidate.name == NULL || !equalsIgnoreCase(candidate.name, strlen(candidate.name), name, length)) {
+        return HEADER_UNKNOWN;
+    }
+    return candidate.header;
+}
+
+const char* HttpHeaders::base(const Field& field) const {
+    return field.owned ? bytes.data() : head;
+}
+
+void HttpHeaders::attach(const char* bytesOfHead) {
+    head = bytesOfHead;
+}
+
+void HttpHeaders::append(const Field& field) {
+    fields.push_back(field);
+    KnownHeader header = lookup(base(field) + field.nameOffset, field.nameLength);
+    if (header != HEADER_UNKNOWN) known[header] = static_cast<int>(fields.size() - 1);
+}
+
+void HttpHeaders::add(size_t nameOffset, size_t nameLength, size_t valueOffset, size_t valueLength) {
+    Field field;
+    field.nameOffset = nameOffset;
+    field.nameLength = nameLength;
+    field.valueOffset = valueOffset;
+    field.valueLength = valueLength;
+    field.owned = false;
+    append(field);
+}
+
+void HttpHeaders::set(const std::string& name, const std::string& value) {
+    remove(name);
+    Field field;
+    field.nameOffset = bytes.size();
+    field.nameLength = name.size();
+    bytes += name;
+    field.valueOffset = bytes.size();
+    field.valueLength = value.size();
+    bytes += value;
+    field.owned = true;
+    append(field);
+}
+
+void HttpHeaders::remove(const std::string& name) {
+    size_t kept = 0;
+    for (size_t i = 0; i < fields.size(); ++i) {
+        const Field& field = fields[i];
+        if (!equalsIgnoreCase(base(field) + field.nameOffset, field.nameLength, name.data(), name.size())) {
+            fields[kept++] = field;
+        }
+    }
+    if (kept == fields.size()) return;
+    fields.resize(kept);
+    index();
+}
+
+void HttpHeaders::clear() {
+    bytes.clear();
+    fields.clear();
+    for (size_t i = 0; i < HEADER_UNKNOWN; ++i) known[i] = -1;
+}
+
+void HttpHeaders::index() {
+    for (size_t i = 0; i < HEADER_UNKNOWN; ++i) known[i] = -1;
+    for (size_t i = 0; i < fields.size(); ++i) {
+        KnownHeader header = lookup(base(fields[i]) + fields[i].nameOffset, fields[i].nameLength);
+        if (header != HEADER_UNKNOWN) known[header] = static_cast<int>(i);
+    }
+}
+
+int HttpHeaders::find(const char* name, size_t length) const {
+    KnownHeader header = lookup(name, length);
+    if (header != HEADER_UNKNOWN) return known[header];
+    for (size_t i = fields.size(); i > 0; --i) {
+        const Field& field = fields[i - 1];
+        if (equalsIgnoreCase(base(field) + field.nameOffset, field.nameLength, name, length)) {
+            return static_cast<int>(i - 1);
+        }
+    }
+    return -1;
+}
+
+StringRef HttpHeaders::get(KnownHeader header) const {
+    if (header == HEADER_UNKNOWN || known[header] < 0) return StringRef();
+    return value(known[header]);
+}
+
+StringRef HttpHeaders::get(const std::string& name) const {
+    int field = find(name.data(), name.size());
+    return field < 0 ? StringRef() : value(field);
+}
+
+bool HttpHeaders::has(KnownHeader header) const {
+    return header != HEADER_UNKNOWN && known[header] >= 0;
+}
+
+size_t HttpHeaders::count() const {
+    return fields.size();
+}
+
+StringRef HttpHeaders::name(size_t i) const {
+    return StringRef(base(fields[i]) + fields[i].nameOffset, fields[i].nameLength);
+}
+
+StringRef HttpHeaders::value(size_t i) const {
+    return StringRef(base(fields[i]) + fields[i].valueOffset, fields[i].valueLength);
+}
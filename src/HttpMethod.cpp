@@ -0,0 +1,40 @@
+#include "HttpMethod.hpp"
+
+#include <cstring>
+
+struct MethodName {
+    const char* name;
+    size_t length;
+    HttpMethod method;
+};
+
+// Alphabetical, the order Allow headers list them in
+static const MethodName METHOD_NAMES[] = {
+    {"CONNECT", 7, METHOD_CONNECT}, {"DELETE", 6, METHOD_DELETE}, {"GET", 3, METHOD_GET},
+    {"HEAD", 4, METHOD_HEAD},       {"OPTIONS", 7, METHOD_OPTIONS}, {"PATCH", 5, METHOD_PATCH},
+    {"POST", 4, METHOD_POST},       {"PUT", 3, METHOD_PUT},       {"TRACE", 5, METHOD_TRACE},
+};
+static const size_t METHOD_COUNT = sizeof(METHOD_NAMES) / sizeof(METHOD_NAMES[0]);
+
+HttpMethod parseHttpMethod(const char* token, size_t length) {
+    for (size_t i = 0; i < METHOD_COUNT; ++i) {
+        if (METHOD_NAMES[i].length == length && memcmp(METHOD_NAMES[i].name, token, length) == 0) {
+            return METHOD_NAMES[i].method;
+        }
+    }
+    return METHOD_UNKNOWN;
+}
+
+HttpMethod parseHttpMethod(const std::string& token) {
+    return parseHttpMethod(token.data(), token.size());
+}
+
+std::string renderAllowHeader(unsigned methods) {
+    std::string header;
+    for (size_t i = 0; i < METHOD_COUNT; ++i) {
+        if (!(methods & METHOD_NAMES[i].method)) continue;
+        if (!header.empty()) header += ", ";
+        header += METHOD_NAMES[i].name;
+    }
+    return header;
+}
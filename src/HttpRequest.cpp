@@ -1,175 +1,173 @@
 #include "HttpRequest.hpp"
-#include "Utils.hpp"
+#include "HttpScanner.hpp"
+
+#include <cstring>
+
+HttpRequest::HttpRequest() : head(""), headLength(0), methodId(METHOD_UNKNOWN) {}
+
+HttpRequest::HttpRequest(const HttpRequest& other)
+    : head(""),
+      headLength(other.headLength),
+      ownCopy(other.head, other.headLength),
+      method(other.method),
+      methodId(other.methodId),
+      path(other.path),
+      queryString(other.queryString),
+      version(other.version),
+      headers(other.headers),
+      body(other.body) {
+    attachHead(ownCopy.data());
+}
 
-HttpRequest::HttpRequest() {
-    // Initialize request data
+HttpRequest& HttpRequest::operator=(const HttpRequest& other) {
+    if (this != &other) {
+        headLength = other.headLength;
+        ownCopy.assign(other.head, other.headLength);
+        method = other.method;
+        methodId = other.methodId;
+        path = other.path;
+        queryString = other.queryString;
+        version = other.version;
+        headers = other.headers;
+        body = other.body;
+        attachHead(ownCopy.data());
+    }
+    return *this;
 }
 
-void HttpRequest::parseRequest(const std::string& request) {
-    method.clear(); path.clear(); version.clear(); headers.clear(); body.clear(); queryString.clear();
+static bool isBlank(char c) {
+    return c == ' ' || c == '\t';
+}
 
-    // Find header/body split
-    size_t headerEnd = request.find("\r\n\r\n");
-    size_t sepLen = 4;
-    if (headerEnd == std::string::npos) {
-        headerEnd = request.find("\n\n");
-        sepLen = (headerEnd == std::string::npos) ? 0 : 2;
+// "METHOD target VERSION"; the target is split into path and query string. The
+// method has to be a token and the target free of control characters.
+bool HttpRequest::parseRequestLine(const char* bytes, size_t offset, size_t length) {
+    method = path = queryString = version = Span();
+    methodId = METHOD_UNKNOWN;
+
+    size_t pos = offset;
+    size_t end = offset + length;
+    method.offset = pos;
+    method.length = HttpScanner::tokenLength(bytes + pos, end - pos);
+    pos += method.length;
+    if (method.length == 0 || pos == end || !isBlank(bytes[pos])) return false;
+    while (pos < end && isBlank(bytes[pos])) ++pos;
+
+    path.offset = pos;
+    path.length = HttpScanner::targetLength(bytes + pos, end - pos);
+    pos += path.length;
+    if (path.length == 0 || pos == end || !isBlank(bytes[pos])) return false;
+    while (pos < end && isBlank(bytes[pos])) ++pos;
+
+    version.offset = pos;
+    while (pos < end && !isBlank(bytes[pos])) ++pos;
+    version.length = pos - version.offset;
+    while (pos < end && isBlank(bytes[pos])) ++pos;
+    if (version.length == 0 || pos != end) return false;
+
+    methodId = parseHttpMethod(bytes + method.offset, method.length);
+    const char* query = static_cast<const char*>(memchr(bytes + path.offset, '?', path.length));
+    if (query != NULL) {
+        size_t queryOffset = query - bytes;
+        queryString.offset = queryOffset + 1;
+        queryString.length = path.offset + path.length - queryString.offset;
+        path.length = queryOffset - path.offset;
     }
+    headLength = end;
+    return true;
+}
 
-    std::string headSection;
-    if (headerEnd != std::string::npos) headSection = request.substr(0, headerEnd);
-    else headSection = request; // no body separator yet; parse what we can
-
-    // Parse request line
-    std::istringstream hs(headSection);
-    std::string requestLine;
-    if (std::getline(hs, requestLine)) {
-        if (!requestLine.empty() && requestLine[requestLine.size()-1] == '\r') requestLine.erase(requestLine.size()-1);
-        std::istringstream lineStream(requestLine);
-        std::string fullPath;
-        lineStream >> method >> fullPath >> version;
-        // Separate path and query string
-        size_t queryPos = fullPath.find('?');
-        if (queryPos != std::string::npos) {
-            path = fullPath.substr(0, queryPos);
-            queryString = fullPath.substr(queryPos + 1);
-        } else {
-            path = fullPath;
-            queryString = "";
-        }
-    }
+// "Name: value". False for a name that is not a token or is not followed
+// directly by the colon, and for control characters in the value (RFC 9112 5)
+bool HttpRequest::parseHeaderLine(const char* bytes, size_t offset, size_t length) {
+    headLength = offset + length;
+    const char* line = bytes + offset;
+    size_t nameLength = HttpScanner::tokenLength(line, length);
+    if (nameLength == 0 || nameLength == length || line[nameLength] != ':') return false;
+    const char* value = line + nameLength + 1;
+    const char* end = line + length;
+    while (value < end && isBlank(*value)) ++value;
+    if (HttpScanner::fieldValueLength(value, end - value) != static_cast<size_t>(end - value)) return false;
+    while (end > value && isBlank(end[-1])) --end;
+    headers.add(offset, nameLength, value - bytes, end - value);
+    return true;
+}
 
-    // Remaining lines in headSection are headers
-    std::string headersBlock;
-    // We need to pass the rest of the stream to parseHeaders, or extract the string.
-    // Since we already have the string in headSection, we can just find the first newline and substring.
-    size_t firstNewline = headSection.find('\n');
-    if (firstNewline != std::string::npos) {
-         headersBlock = headSection.substr(firstNewline + 1);
-         headers = parseHeaders(headersBlock);
-    }
+void HttpRequest::attachHead(const char* bytes) {
+    head = bytes;
+    headers.attach(bytes);
+}
 
-    // Exact body bytes after header separator
-    if (headerEnd != std::string::npos) {
-        body = request.substr(headerEnd + sepLen);
-    } else {
-        body.clear();
-    }
+void HttpRequest::ownHead() {
+    if (head == ownCopy.data()) return;
+    ownCopy.assign(head, headLength);
+    attachHead(ownCopy.data());
 }
 
-std::map<std::string, std::string> HttpRequest::parseHeaders(const std::string& headerBlock) {
-    std::map<std::string, std::string> headers;
-    std::istringstream hs(headerBlock);
-    std::string line;
-    while (std::getline(hs, line)) {
-        if (!line.empty() && line[line.size() - 1] == '\r') line.erase(line.size() - 1);
-        size_t colon = line.find(':');
-        if (colon == std::string::npos) continue;
-        std::string name = toLower(line.substr(0, colon));
-        std::string value = line.substr(colon + 1);
-        size_t first = value.find_first_not_of(" \t");
-        size_t last = value.find_last_not_of(" \t");
-        if (first != std::string::npos) value = value.substr(first, last - first + 1); else value = "";
-        headers[name] = value;
-    }
-    return headers;
+void HttpRequest::setHeader(const std::string& name, const std::string& value) {
+    headers.set(name, value);
 }
 
-std::string HttpRequest::getMethod() const {
-    return method;
+void HttpRequest::removeHeader(const std::string& name) {
+    headers.remove(name);
 }
 
-std::string HttpRequest::getPath() const {
-    return path;
+void HttpRequest::setBodySpool(size_t memoryLimit, const std::string& tempDir) {
+    body.setSpool(memoryLimit, tempDir);
 }
 
-std::string HttpRequest::getHeader(const std::string& headerName) const {
-    std::map<std::string, std::string>::const_iterator it = headers.find(headerName);
-    if (it != headers.end()) {
-        return it->second;
-    }
-    // case-insensitive lookup (headers are stored as lowercase)
-    std::string lower = toLower(headerName);
-    it = headers.find(lower);
-    if (it != headers.end()) {
-        return it->second;
-    }
-    return "";
+bool HttpRequest::appendBody(const char* data, size_t length) {
+    return body.append(data, length);
 }
 
-std::string HttpRequest::getBody() const {
-    return body;
+void HttpRequest::borrowBody(const char* data, size_t length) {
+    body.borrow(data, length);
 }
 
-std::string HttpRequest::getVersion() const {
-    return version;
+StringRef HttpRequest::view(const Span& span) const {
+    return StringRef(head + span.offset, span.length);
 }
 
-std::string HttpRequest::getQueryString() const {
-    return queryString;
+StringRef HttpRequest::getMethod() const {
+    return view(method);
 }
 
-const std::map<std::string, std::string>& HttpRequest::getHeaders() const {
-    return headers;
+HttpMethod HttpRequest::getMethodId() const {
+    return methodId;
 }
 
-bool HttpRequest::decodeChunkedBody(const std::string& data, size_t startPos, size_t& consumed, std::string& out) {
-    size_t pos = startPos;
-    out.clear();
-    while (true) {
-        size_t lineEnd = data.find("\r\n", pos);
-        if (lineEnd == std::string::npos) return false;
-        std::string sizeLine = data.substr(pos, lineEnd - pos);
-        size_t sc = sizeLine.find(';');
-        if (sc != std::string::npos) sizeLine = sizeLine.substr(0, sc);
-        size_t f = sizeLine.find_first_not_of(" \t");
-        size_t l = sizeLine.find_last_not_of(" \t");
-        if (f == std::string::npos) return false;
-        sizeLine = sizeLine.substr(f, l - f + 1);
-        unsigned long chunkSize = 0;
-        std::istringstream xs(sizeLine);
-        xs >> std::hex >> chunkSize;
-        if (xs.fail()) return false;
-        pos = lineEnd + 2;
-        if (chunkSize == 0) {
-            size_t trailerEnd = data.find("\r\n", pos);
-            if (trailerEnd == std::string::npos) return false;
-            consumed = trailerEnd + 2;
-            return true;
-        }
-        if (data.size() < pos + chunkSize + 2) return false;
-        out.append(data, pos, chunkSize);
-        pos += chunkSize;
-        if (!(data[pos] == '\r' && data[pos + 1] == '\n')) return false;
-        pos += 2;
-    }
+StringRef HttpRequest::getPath() const {
+    return view(path);
 }
 
-std::string HttpRequest::normalizeChunkedRequest(const std::string& buffer, size_t headerEnd, const std::string& decodedBody) {
-    std::string reqLine = buffer.substr(0, buffer.find("\r\n"));
-    std::string headersOnly = buffer.substr(buffer.find("\r\n") + 2, headerEnd - (buffer.find("\r\n") + 2));
-    std::istringstream hsin(headersOnly);
-    std::string line;
-    std::string rebuiltHeaders;
-    while (std::getline(hsin, line)) {
-        if (!line.empty() && line[line.size() - 1] == '\r') line.erase(line.size() - 1);
-        size_t colon = line.find(':');
-        if (colon == std::string::npos) continue;
-        std::string lower = toLower(line.substr(0, colon));
-        if (lower == "transfer-encoding" || lower == "content-length") continue;
-        rebuiltHeaders += line + "\r\n";
-    }
-    std::ostringstream cl;
-    cl << "Content-Length: " << decodedBody.size() << "\r\n";
-    rebuiltHeaders += cl.str();
-    return reqLine + "\r\n" + rebuiltHeaders + "\r\n" + decodedBody;
+StringRef HttpRequest::getQueryString() const {
+    return view(queryString);
+}
+
+StringRef HttpRequest::getVersion() const {
+    return view(version);
+}
+
+StringRef HttpRequest::getHeader(KnownHeader header) const {
+    return headers.get(header);
+}
+
+StringRef HttpRequest::getHeader(const std::string& headerName) const {
+    return headers.get(headerName);
+}
+
+const HttpHeaders& HttpRequest::getHeaders() const {
+    return headers;
+}
+
+const RequestBody& HttpRequest::getBody() const {
+    return body;
 }
 
 bool HttpRequest::wantsKeepAlive() const {
-    std::string connHeader = getHeader("connection");
-    std::string connLower = toLower(connHeader);
-    if (version == "HTTP/1.1") {
-        return (connLower != "close");
+    StringRef connection = headers.get(HEADER_CONNECTION);
+    if (getVersion() == "HTTP/1.1") {
+        return !connection.equalsIgnoreCase("close");
     }
-    return (connLower == "keep-alive");
+    return connection.equalsIgnoreCase("keep-alive");
 }
@@ -0,0 +1,287 @@
+#include "HttpRequestParser.hpp"
+#include "Utils.hpp"
+
+#include <cstdlib>
+#include <cstring>
+
+HttpRequestParser::HttpRequestParser() {
+    reset();
+}
+
+void HttpRequestParser::reset() {
+    state = STATE_REQUEST_LINE;
+    lineStart = 0;
+    pinned = 0;
+    scanPos = 0;
+    contentLength = 0;
+    chunkRemaining = 0;
+    bodyBytes = 0;
+    maxBodyBytes = static_cast<size_t>(-1);
+    memoryLimit = static_cast<size_t>(-1);
+    expectContinue = false;
+    streaming = false;
+    streamed.clear();
+    streamLimit = static_cast<size_t>(-1);
+    req = HttpRequest();
+}
+
+void HttpRequestParser::release(BufferChain& buffer) {
+    buffer.consume(pinned);
+    reset();
+}
+
+bool HttpRequestParser::headersComplete() const {
+    return state != STATE_REQUEST_LINE && state != STATE_HEADERS;
+}
+
+bool HttpRequestParser::expectsContinue() const {
+    return expectContinue;
+}
+
+HttpRequest& HttpRequestParser::request() {
+    return req;
+}
+
+// Digits only: a Content-Length that is not a plain decimal number cannot frame the body
+static bool parseContentLength(const StringRef& value, size_t& out) {
+    if (value.empty() || value.size() > 18) return false;
+    out = 0;
+    for (size_t i = 0; i < value.size(); ++i) {
+        if (value.data[i] < '0' || value.data[i] > '9') return false;
+        out = out * 10 + (value.data[i] - '0');
+    }
+    return true;
+}
+
+static int hexValue(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+// Longest chunk-size line (size plus extensions) accepted before giving up
+static const size_t MAX_CHUNK_LINE = 1024;
+
+bool HttpRequestParser::finishHeaders() {
+    expectContinue = req.getHeader(HEADER_EXPECT).containsIgnoreCase("100-continue");
+
+    // Transfer-Encoding overrides Content-Length (RFC 7230 3.3.3)
+    if (req.getHeader(HEADER_TRANSFER_ENCODING).containsIgnoreCase("chunked")) {
+        state = STATE_CHUNK_SIZE;
+        return true;
+    }
+    if (!req.getHeaders().has(HEADER_CONTENT_LENGTH)) {
+        state = STATE_DONE;
+        return true;
+    }
+    if (!parseContentLength(req.getHeader(HEADER_CONTENT_LENGTH), contentLength)) return false;
+    state = contentLength > 0 ? STATE_BODY : STATE_DONE;
+    return true;
+}
+
+bool HttpRequestParser::beginBody(size_t maxBody, size_t bodyMemoryLimit, const std::string& tempDir) {
+    maxBodyBytes = maxBody;
+    memoryLimit = bodyMemoryLimit;
+    req.setBodySpool(bodyMemoryLimit, tempDir);
+    return state != STATE_BODY || contentLength <= maxBodyBytes;
+}
+
+void HttpRequestParser::streamBody() {
+    streaming = true;
+}
+
+bool HttpRequestParser::streamingBody() const {
+    return streaming;
+}
+
+std::string& HttpRequestParser::streamedBody() {
+    return streamed;
+}
+
+void HttpRequestParser::limitStreamedBody(size_t limit) {
+    streamLimit = limit;
+}
+
+// Body bytes the next storeBody() may take
+size_t HttpRequestParser::streamRoom() const {
+    if (!streaming) return static_cast<size_t>(-1);
+    return streamed.size() < streamLimit ? streamLimit - streamed.size() : 0;
+}
+
+bool HttpRequestParser::storeBody(const char* data, size_t length) {
+    bodyBytes += length;
+    if (streaming) {
+        streamed.append(data, length);
+        return true;
+    }
+    return req.appendBody(data, length);
+}
+
+HttpRequestParser::Result HttpRequestParser::parse(BufferChain& buffer, size_t maxHeaderBytes) {
+    while (state == STATE_REQUEST_LINE || state == STATE_HEADERS) {
+        size_t available;
+        const char* data = buffer.data(available);
+        req.attachHead(data); // pullup() may have moved the head
+        const char* newline = NULL;
+        if (scanPos < available) {
+            newline = static_cast<const char*>(memchr(data + scanPos, '\n', available - scanPos));
+        }
+        if (newline == NULL) {
+            scanPos = available;
+            if (available < buffer.size() && available <= maxHeaderBytes) {
+                // The head continues in the next block; parsed lines stay where they are
+                buffer.pullup(maxHeaderBytes + 1);
+                continue;
+            }
+            return available > maxHeaderBytes ? PARSE_HEADER_TOO_LARGE : PARSE_INCOMPLETE;
+        }
+        size_t eol = newline - data;
+        if (eol >= maxHeaderBytes) return PARSE_HEADER_TOO_LARGE;
+
+        size_t lineEnd = eol;
+        if (lineEnd > lineStart && data[lineEnd - 1] == '\r') --lineEnd;
+        size_t start = lineStart;
+        size_t lineLength = lineEnd - lineStart;
+        lineStart = scanPos = eol + 1;
+
+        if (state == STATE_REQUEST_LINE) {
+            if (lineLength == 0) continue; // stray CRLF between pipelined requests
+            if (!req.parseRequestLine(data, start, lineLength)) return PARSE_ERROR;
+            state = STATE_HEADERS;
+        } else if (lineLength == 0) {
+            if (!finishHeaders()) return PARSE_ERROR;
+            pinned = lineStart;
+            return state == STATE_DONE ? PARSE_COMPLETE : PARSE_HEAD_COMPLETE;
+        } else {
+            if (!req.parseHeaderLine(data, start, lineLength)) return PARSE_ERROR;
+        }
+    }
+    if (state == STATE_DONE) return PARSE_COMPLETE;
+    if (pinned > 0) {
+        if (borrowBody(buffer)) return PARSE_COMPLETE;
+        // The body is streamed out of the buffer, so the head cannot stay there
+        req.ownHead();
+        buffer.consume(pinned);
+        pinned = 0;
+    }
+    return state == STATE_BODY ? parseBody(buffer) : parseChunked(buffer);
+}
+
+// A Content-Length body that is already buffered right behind the head and fits
+// in memory is used in place, pinned together with the head
+bool HttpRequestParser::borrowBody(BufferChain& buffer) {
+    size_t available;
+    const char* data = buffer.data(available);
+    if (state != STATE_BODY || available - pinned < contentLength || contentLength > memoryLimit) return false;
+    req.borrowBody(data + pinned, contentLength);
+    pinned += contentLength;
+    state = STATE_DONE;
+    return true;
+}
+
+// Moves whatever part of a Content-Length body is buffered into the request body
+HttpRequestParser::Result HttpRequestParser::parseBody(BufferChain& buffer) {
+    while (!buffer.empty()) {
+        size_t room = streamRoom();
+        if (room == 0) return PARSE_INCOMPLETE;
+        size_t available;
+        const char* data = buffer.data(available);
+        size_t missing = contentLength - bodyBytes;
+        size_t take = available < missing ? available : missing;
+        if (take > room) take = room;
+        if (!storeBody(data, take)) return PARSE_STORAGE_ERROR;
+        buffer.consume(take);
+        if (take == missing) {
+            state = STATE_DONE;
+            return PARSE_COMPLETE;
+        }
+    }
+    return PARSE_INCOMPLETE;
+}
+
+// The line at the front of the buffer, joined across blocks if needed. Returns
+// NULL while it is incomplete and sets tooLong when it exceeds maxLength.
+static const char* frontLine(BufferChain& buffer, size_t maxLength, size_t& eol, bool& tooLong) {
+    size_t available;
+    const char* data = buffer.data(available);
+    const char* newline = static_cast<const char*>(memchr(data, '\n', available));
+    if (newline == NULL && available < buffer.size() && available <= maxLength) {
+        buffer.pullup(maxLength + 1);
+        data = buffer.data(available);
+        newline = static_cast<const char*>(memchr(data, '\n', available));
+    }
+    tooLong = newline == NULL ? available > maxLength : static_cast<size_t>(newline - data) > maxLength;
+    if (newline == NULL || tooLong) return NULL;
+    eol = newline - data;
+    return data;
+}
+
+// Decodes chunked framing at the front of the buffer, appending each chunk to
+// the request body as soon as it arrives; every byte is looked at once
+HttpRequestParser::Result HttpRequestParser::parseChunked(BufferChain& buffer) {
+    while (true) {
+        if (state == STATE_CHUNK_SIZE || state == STATE_CHUNK_TRAILER) {
+            if (buffer.empty()) return PARSE_INCOMPLETE;
+            size_t eol;
+            bool tooLong;
+            const char* line = frontLine(buffer, MAX_CHUNK_LINE, eol, tooLong);
+            if (line == NULL) return tooLong ? PARSE_ERROR : PARSE_INCOMPLETE;
+
+            if (state == STATE_CHUNK_TRAILER) {
+                bool emptyLine = eol == 0 || (eol == 1 && line[0] == '\r');
+                buffer.consume(eol + 1);
+                if (!emptyLine) continue; // trailer fields are not used
+                // Handlers and CGI see a plain Content-Length body
+                req.removeHeader("transfer-encoding");
+                std::ostringstream length;
+                length << bodyBytes;
+                req.setHeader("content-length", length.str());
+                state = STATE_DONE;
+                return PARSE_COMPLETE;
+            }
+
+            size_t pos = 0;
+            size_t size = 0;
+            int digit;
+            while (pos < eol && (digit = hexValue(line[pos])) >= 0) {
+                if (size > (static_cast<size_t>(-1) >> 4)) return PARSE_ERROR;
+                size = size * 16 + digit;
+                ++pos;
+            }
+            if (pos == 0) return PARSE_ERROR;
+            // Only whitespace or a chunk extension may follow the size
+            while (pos < eol && (line[pos] == ' ' || line[pos] == '\t')) ++pos;
+            if (pos < eol && line[pos] != ';' && !(line[pos] == '\r' && pos + 1 == eol)) return PARSE_ERROR;
+            if (size > maxBodyBytes - bodyBytes) return PARSE_BODY_TOO_LARGE;
+            buffer.consume(eol + 1);
+            chunkRemaining = size;
+            state = size > 0 ? STATE_CHUNK_DATA : STATE_CHUNK_TRAILER;
+        } else if (state == STATE_CHUNK_DATA) {
+            size_t available;
+            const char* data = buffer.data(available);
+            size_t room = streamRoom();
+            if (available == 0 || room == 0) return PARSE_INCOMPLETE;
+            size_t take = available < chunkRemaining ? available : chunkRemaining;
+            if (take > room) take = room;
+            if (!storeBody(data, take)) return PARSE_STORAGE_ERROR;
+            buffer.consume(take);
+            chunkRemaining -= take;
+            if (chunkRemaining == 0) state = STATE_CHUNK_DATA_END;
+        } else if (state == STATE_CHUNK_DATA_END) {
+            size_t available;
+            const char* data = buffer.data(available);
+            if (available == 0) return PARSE_INCOMPLETE;
+            if (data[0] == '\r') {
+                if (buffer.size() < 2) return PARSE_INCOMPLETE;
+                buffer.consume(1);
+                data = buffer.data(available);
+            }
+            if (data[0] != '\n') return PARSE_ERROR;
+            buffer.consume(1);
+            state = STATE_CHUNK_SIZE;
+        } else {
+            return PARSE_COMPLETE;
+        }
+    }
+}
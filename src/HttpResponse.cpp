@@ -1,6 +1,32 @@
 #include "HttpResponse.hpp"
 
-HttpResponse::HttpResponse() : statusCode(200), body("") {}
+HttpResponse::HttpResponse() : statusCode(200), body(""), prepared(NULL) {}
+
+HttpResponse::HttpResponse(const HttpResponse& other)
+    : statusCode(other.statusCode), headers(other.headers), body(other.body), prepared(other.prepared) {
+    if (prepared != NULL) prepared->retain();
+}
+
+HttpResponse& HttpResponse::operator=(const HttpResponse& other) {
+    if (this != &other) {
+        setPrepared(other.prepared);
+        statusCode = other.statusCode;
+        headers = other.headers;
+        body = other.body;
+    }
+    return *this;
+}
+
+HttpResponse::~HttpResponse() {
+    if (prepared != NULL) prepared->release();
+}
+
+void HttpResponse::setPrepared(PreparedResponse* response) {
+    if (response != NULL) response->retain();
+    if (prepared != NULL) prepared->release();
+    prepared = response;
+    if (prepared != NULL) statusCode = 200;
+}
 
 void HttpResponse::setStatus(int code) {
     statusCode = code;
@@ -14,28 +40,70 @@ void HttpResponse::setBody(const std::string& responseBody) {
     body = responseBody;
 }
 
-std::string HttpResponse::generateResponse(bool isHead) {
-    std::ostringstream responseStream;
-    responseStream << "HTTP/1.1 " << statusCode << " " << getStatusMessage(statusCode) << "\r\n";
+void HttpResponse::swapBody(std::string& responseBody) {
+    body.swap(responseBody);
+}
+
+static void appendNumber(std::string& out, size_t value) {
+    char digits[24];
+    size_t pos = sizeof(digits);
+    do {
+        digits[--pos] = static_cast<char>('0' + value % 10);
+        value /= 10;
+    } while (value > 0);
+    out.append(digits + pos, sizeof(digits) - pos);
+}
+
+void HttpResponse::serialize(OutputQueue& out, bool isHead) {
+    if (prepared != NULL) {
+        std::map<std::string, std::string>::const_iterator connection = headers.find("Connection");
+        bool close = connection != headers.end() && connection->second == "close";
+        const std::string& head = close ? prepared->closeHead : prepared->keepAliveHead;
+        out.appendShared(prepared, head.data(), head.size());
+        if (!isHead) out.appendShared(prepared, prepared->body.data(), prepared->body.size());
+        return;
+    }
 
     // Set Content-Length based on body size, unless it's already set (e.g. for CGI)
     if (headers.find("Content-Length") == headers.end()) {
-        std::ostringstream oss;
-        oss << body.size();
-        setHeader("Content-Length", oss.str());
+        std::string length;
+        appendNumber(length, body.size());
+        setHeader("Content-Length", length);
     }
 
+    std::string head = buildHead();
+    out.adopt(head);
+    if (!isHead) out.adopt(body);
+}
+
+void HttpResponse::serializeHead(OutputQueue& out) {
+    std::string head = buildHead();
+    out.adopt(head);
+}
+
+std::string HttpResponse::buildHead() const {
+    std::string statusMessage = getStatusMessage(statusCode);
+    size_t headSize = 32 + statusMessage.size();
     std::map<std::string, std::string>::const_iterator it;
     for (it = headers.begin(); it != headers.end(); ++it) {
-        responseStream << it->first << ": " << it->second << "\r\n";
+        headSize += it->first.size() + it->second.size() + 4;
     }
-    responseStream << "\r\n";
 
-    if (!isHead) {
-        responseStream << body;
+    std::string head;
+    head.reserve(headSize);
+    head += "HTTP/1.1 ";
+    appendNumber(head, statusCode);
+    head += ' ';
+    head += statusMessage;
+    head += "\r\n";
+    for (it = headers.begin(); it != headers.end(); ++it) {
+        head += it->first;
+        head += ": ";
+        head += it->second;
+        head += "\r\n";
     }
-    
-    return responseStream.str();
+    head += "\r\n";
+    return head;
 }
 
 std::string HttpResponse::getStatusMessage(int statusCode) {
@@ -96,12 +164,3 @@ void HttpResponse::setDefaultErrorBody() {
     body = "<html><body><h1>" + getStatusMessage(statusCode) + "</h1></body></html>";
     setHeader("Content-Type", "text/html");
 }
-
-void HttpResponse::setAllowHeader(const std::set<std::string>& methods) {
-    std::string allowHeader;
-    for (std::set<std::string>::const_iterator it = methods.begin(); it != methods.end(); ++it) {
-        if (!allowHeader.empty()) allowHeader += ", ";
-        allowHeader += *it;
-    }
-    setHeader("Allow", allowHeader);
-}
@@ -0,0 +1,227 @@
+#include "HttpScanner.hpp"
+
+#include <cstring>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define HTTPSCANNER_X86 1
+#include <immintrin.h>
+#endif
+
+enum { CLASS_TOKEN = 1, CLASS_VALUE = 2, CLASS_TARGET = 4 };
+
+static unsigned char byteClass[256];
+// Nibble tables for tchar: a byte is one when lowNibble[lo] & highNibble[hi] is non-zero
+static unsigned char tokenLowNibble[16];
+static unsigned char tokenHighNibble[16];
+
+static bool buildTables() {
+    const char* tokenSymbols = "!#$%&'*+-.^_`|~";
+    for (int c = 0; c < 256; ++c) {
+        bool token = (c >= '0' && c <= '9') || (c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z') ||
+                     (c != 0 && strchr(tokenSymbols, c) != NULL);
+        unsigned char cls = 0;
+        if (token) cls |= CLASS_TOKEN;
+        if (c == '\t' || (c >= 0x20 && c != 0x7f)) cls |= CLASS_VALUE;
+        if (c > 0x20 && c != 0x7f) cls |= CLASS_TARGET;
+        byteClass[c] = cls;
+        if (token) tokenLowNibble[c & 0x0f] |= static_cast<unsigned char>(1 << (c >> 4));
+    }
+    for (int h = 0; h < 8; ++h) tokenHighNibble[h] = static_cast<unsigned char>(1 << h);
+    return true;
+}
+
+static size_t scalarScan(const char* data, size_t length, unsigned char cls) {
+    size_t i = 0;
+    while (i < length && (byteClass[static_cast<unsigned char>(data[i])] & cls)) ++i;
+    return i;
+}
+
+static size_t scalarToken(const char* data, size_t length) {
+    return scalarScan(data, length, CLASS_TOKEN);
+}
+
+static size_t scalarValue(const char* data, size_t length) {
+    return scalarScan(data, length, CLASS_VALUE);
+}
+
+static size_t scalarTarget(const char* data, size_t length) {
+    return scalarScan(data, length, CLASS_TARGET);
+}
+
+#ifdef HTTPSCANNER_X86
+// SSE4.2: pcmpestri finds the first byte inside a set of ranges, as in
+// picohttpparser; tchar has too many ranges for it and uses pshufb nibble lookups
+// The 16-byte loops are always inlined so that, inside the AVX2 functions, they are
+// VEX-encoded too; mixing in legacy SSE encodings there costs a transition penalty
+#define SSE_BLOCKS __attribute__((target("sse4.2"), always_inline)) static inline
+
+SSE_BLOCKS size_t sseRanges(const char* data, size_t length, const char* ranges,
+                                                          int rangesLength) {
+    __m128i set = _mm_loadu_si128(reinterpret_cast<const __m128i*>(ranges));
+    size_t i = 0;
+    for (; i + 16 <= length; i += 16) {
+        __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+        int hit = _mm_cmpestri(set, rangesLength, block, 16,
+                               _SIDD_UBYTE_OPS | _SIDD_CMP_RANGES | _SIDD_LEAST_SIGNIFICANT);
+        if (hit != 16) return i + hit;
+    }
+    return i;
+}
+
+// Ranges are padded to 16 bytes since pcmpestri always loads a full register
+static const char VALUE_STOP_RANGES[16] = "\x00\x08\x0a\x1f\x7f\x7f";
+static const char TARGET_STOP_RANGES[16] = "\x00\x20\x7f\x7f";
+
+SSE_BLOCKS size_t sseValueBlocks(const char* data, size_t length) {
+    size_t i = sseRanges(data, length, VALUE_STOP_RANGES, 6);
+    return i + scalarValue(data + i, length - i);
+}
+
+SSE_BLOCKS size_t sseTargetBlocks(const char* data, size_t length) {
+    size_t i = sseRanges(data, length, TARGET_STOP_RANGES, 4);
+    return i + scalarTarget(data + i, length - i);
+}
+
+SSE_BLOCKS size_t sseTokenBlocks(const char* data, size_t length) {
+    const __m128i low = _mm_loadu_si128(reinterpret_cast<const __m128i*>(tokenLowNibble));
+    const __m128i high = _mm_loadu_si128(reinterpret_cast<const __m128i*>(tokenHighNibble));
+    const __m128i nibble = _mm_set1_epi8(0x0f);
+    size_t i = 0;
+    for (; i + 16 <= length; i += 16) {
+        __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+        __m128i lo = _mm_shuffle_epi8(low, _mm_and_si128(block, nibble));
+        __m128i hi = _mm_shuffle_epi8(high, _mm_and_si128(_mm_srli_epi16(block, 4), nibble));
+        int bad = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_and_si128(lo, hi), _mm_setzero_si128()));
+        if (bad != 0) return i + __builtin_ctz(bad);
+    }
+    return i + scalarToken(data + i, length - i);
+}
+
+__attribute__((target("sse4.2"))) static size_t sseValue(const char* data, size_t length) {
+    return sseValueBlocks(data, length);
+}
+
+__attribute__((target("sse4.2"))) static size_t sseTarget(const char* data, size_t length) {
+    return sseTargetBlocks(data, length);
+}
+
+__attribute__((target("sse4.2"))) static size_t sseToken(const char* data, size_t length) {
+    return sseTokenBlocks(data, length);
+}
+
+// AVX2: 32-byte compares for the control-character stops, the same nibble lookup for tchar
+__attribute__((target("avx2,sse4.2"))) static size_t avxValue(const char* data, size_t length) {
+    const __m256i space = _mm256_set1_epi8(0x20);
+    const __m256i tab = _mm256_set1_epi8('\t');
+    const __m256i del = _mm256_set1_epi8(0x7f);
+    size_t i = 0;
+    for (; i + 32 <= length; i += 32) {
+        __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+        __m256i printable = _mm256_cmpeq_epi8(_mm256_max_epu8(block, space), block); // >= 0x20
+        __m256i ok = _mm256_andnot_si256(_mm256_cmpeq_epi8(block, del),
+                                         _mm256_or_si256(printable, _mm256_cmpeq_epi8(block, tab)));
+        unsigned bad = ~static_cast<unsigned>(_mm256_movemask_epi8(ok));
+        if (bad != 0) return i + __builtin_ctz(bad);
+    }
+    return i + sseValueBlocks(data + i, length - i); // short fields end within 32 bytes
+}
+
+__attribute__((target("avx2,sse4.2"))) static size_t avxTarget(const char* data, size_t length) {
+    const __m256i aboveSpace = _mm256_set1_epi8(0x21);
+    const __m256i del = _mm256_set1_epi8(0x7f);
+    size_t i = 0;
+    for (; i + 32 <= length; i += 32) {
+        __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+        __m256i visible = _mm256_cmpeq_epi8(_mm256_max_epu8(block, aboveSpace), block); // >= 0x21
+        __m256i ok = _mm256_andnot_si256(_mm256_cmpeq_epi8(block, del), visible);
+        unsigned bad = ~static_cast<unsigned>(_mm256_movemask_epi8(ok));
+        if (bad != 0) return i + __builtin_ctz(bad);
+    }
+    return i + sseTargetBlocks(data + i, length - i); // short fields end within 32 bytes
+}
+
+__attribute__((target("avx2,sse4.2"))) static size_t avxToken(const char* data, size_t length) {
+    const __m256i low = _mm256_broadcastsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(tokenLowNibble)));
+    const __m256i high =
+        _mm256_broadcastsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(tokenHighNibble)));
+    const __m256i nibble = _mm256_set1_epi8(0x0f);
+    size_t i = 0;
+    for (; i + 32 <= length; i += 32) {
+        __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+        __m256i lo = _mm256_shuffle_epi8(low, _mm256_and_si256(block, nibble));
+        __m256i hi = _mm256_shuffle_epi8(high, _mm256_and_si256(_mm256_srli_epi16(block, 4), nibble));
+        unsigned bad = static_cast<unsigned>(
+            _mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_and_si256(lo, hi), _mm256_setzero_si256())));
+        if (bad != 0) return i + __builtin_ctz(bad);
+    }
+    return i + sseTokenBlocks(data + i, length - i); // short fields end within 32 bytes
+}
+#endif
+
+struct ScanFunctions {
+    size_t (*token)(const char*, size_t);
+    size_t (*value)(const char*, size_t);
+    size_t (*target)(const char*, size_t);
+};
+
+static const ScanFunctions SCALAR_FUNCTIONS = {scalarToken, scalarValue, scalarTarget};
+#ifdef HTTPSCANNER_X86
+static const ScanFunctions SSE42_FUNCTIONS = {sseToken, sseValue, sseTarget};
+static const ScanFunctions AVX2_FUNCTIONS = {avxToken, avxValue, avxTarget};
+#endif
+
+static HttpScanner::Level bestLevel() {
+    if (HttpScanner::supported(HttpScanner::LEVEL_AVX2)) return HttpScanner::LEVEL_AVX2;
+    if (HttpScanner::supported(HttpScanner::LEVEL_SSE42)) return HttpScanner::LEVEL_SSE42;
+    return HttpScanner::LEVEL_SCALAR;
+}
+
+// Set during static initialization, before any thread exists
+static const bool tablesBuilt = buildTables();
+static HttpScanner::Level activeLevel = HttpScanner::LEVEL_SCALAR;
+static const ScanFunctions* active = &SCALAR_FUNCTIONS;
+static const bool levelChosen = HttpScanner::setLevel(bestLevel());
+
+bool HttpScanner::supported(Level level) {
+#ifdef HTTPSCANNER_X86
+    __builtin_cpu_init();
+    if (level == LEVEL_AVX2) return __builtin_cpu_supports("avx2");
+    if (level == LEVEL_SSE42) return __builtin_cpu_supports("sse4.2");
+#endif
+    return level == LEVEL_SCALAR;
+}
+
+bool HttpScanner::setLevel(Level level) {
+    (void)tablesBuilt;
+    (void)levelChosen;
+    if (!supported(level)) return false;
+    activeLevel = level;
+    active = &SCALAR_FUNCTIONS;
+#ifdef HTTPSCANNER_X86
+    if (level == LEVEL_AVX2) active = &AVX2_FUNCTIONS;
+    if (level == LEVEL_SSE42) active = &SSE42_FUNCTIONS;
+#endif
+    return true;
+}
+
+HttpScanner::Level HttpScanner::level() {
+    return activeLevel;
+}
+
+const char* HttpScanner::levelName(Level level) {
+    if (level == LEVEL_AVX2) return "avx2";
+    if (level == LEVEL_SSE42) return "sse4.2";
+    return "scalar";
+}
+
+size_t HttpScanner::tokenLength(const char* data, size_t length) {
+    return active->token(data, length);
+}
+
+size_t HttpScanner::fieldValueLength(const char* data, size_t length) {
+    return active->value(data, length);
+}
+
+size_t HttpScanner::targetLength(const char* data, size_t length) {
+    return active->target(data, length);
+}
@@ -1,11 +1,9 @@
 #include "LocationConfig.hpp"
 #include <vector>
 
-LocationConfig::LocationConfig() : autoindex(false) {
-    // Default constructor implementation
-    // Initialize methods to common defaults if desired, e.g., GET, HEAD
-    // methods.push_back("GET");
-    // methods.push_back("HEAD");
+LocationConfig::LocationConfig() : autoindex(false), fastCgiMultiplex(1), cgiPoolSize(0), cgiPoolMaxRequests(0) {
+    // Without allow_methods a location serves GET, HEAD and OPTIONS
+    setMethods(0);
 }
 
 LocationConfig::~LocationConfig() {
@@ -20,12 +18,34 @@ std::string LocationConfig::getPath() const {
     return this->path;
 }
 
-void LocationConfig::setMethods(const std::vector<std::string>& methods) {
-    this->methods = methods;
+void LocationConfig::setModifier(const std::string& modifier) {
+    this->modifier = modifier;
 }
 
-const std::vector<std::string>& LocationConfig::getMethods() const {
-    return this->methods;
+const std::string& LocationConfig::getModifier() const {
+    return this->modifier;
+}
+
+bool LocationConfig::isRegex() const {
+    return modifier == "~" || modifier == "~*";
+}
+
+void LocationConfig::setMethods(unsigned methods) {
+    this->methods = methods != 0 ? methods : (METHOD_GET | METHOD_HEAD | METHOD_OPTIONS);
+    allowHeader = renderAllowHeader(this->methods);
+    optionsAllowHeader = renderAllowHeader(this->methods | METHOD_OPTIONS);
+}
+
+bool LocationConfig::allowsMethod(HttpMethod method) const {
+    return (methods & method) != 0;
+}
+
+const std::string& LocationConfig::getAllowHeader() const {
+    return allowHeader;
+}
+
+const std::string& LocationConfig::getOptionsAllowHeader() const {
+    return optionsAllowHeader;
 }
 
 void LocationConfig::setRoot(const std::string& root) {
@@ -36,6 +56,14 @@ std::string LocationConfig::getRoot() const {
     return this->root;
 }
 
+void LocationConfig::setRootDirectory(const RootDirectory& directory) {
+    this->rootDirectory = directory;
+}
+
+const RootDirectory& LocationConfig::getRootDirectory() const {
+    return this->rootDirectory;
+}
+
 void LocationConfig::setIndex(const std::string& index) {
     this->index = index;
 }
@@ -68,6 +96,35 @@ std::string LocationConfig::getCgiPass() const {
     return this->cgiPass;
 }
 
+void LocationConfig::setFastCgiPass(const std::string& address) {
+    this->fastCgiPass = address;
+}
+
+const std::string& LocationConfig::getFastCgiPass() const {
+    return this->fastCgiPass;
+}
+
+void LocationConfig::setFastCgiMultiplex(unsigned requests) {
+    this->fastCgiMultiplex = requests;
+}
+
+unsigned LocationConfig::getFastCgiMultiplex() const {
+    return this->fastCgiMultiplex;
+}
+
+void LocationConfig::setCgiPool(unsigned workers, unsigned maxRequests) {
+    this->cgiPoolSize = workers;
+    this->cgiPoolMaxRequests = maxRequests;
+}
+
+unsigned LocationConfig::getCgiPoolSize() const {
+    return this->cgiPoolSize;
+}
+
+unsigned LocationConfig::getCgiPoolMaxRequests() const {
+    return this->cgiPoolMaxRequests;
+}
+
 void LocationConfig::setUploadStore(const std::string& uploadStore) {
     this->uploadStore = uploadStore;
 }
@@ -85,7 +142,7 @@ std::string LocationConfig::getRedirect() const {
 }
 
 bool LocationConfig::isCgiPath(const std::string& requestPath) const {
-    if (!cgiPass.empty()) return true;
+    if (!cgiPass.empty() || !fastCgiPass.empty()) return true;
     if (requestPath.find("/cgi-bin/") != std::string::npos) return true;
     if (requestPath.find(".php") != std::string::npos) return true;
     if (requestPath.find(".py") != std::string::npos) return true;
@@ -0,0 +1,100 @@
+#include "LocationRouter.hpp"
+
+#include <iostream>
+
+LocationRouter::LocationRouter() : nodes(1), fallback(NULL) {}
+
+void LocationRouter::build(const std::map<std::string, LocationConfig>& prefixLocations,
+                           const std::map<std::string, LocationConfig>& exactLocations,
+                           const std::vector<LocationConfig>& regexLocations,
+                           const LocationConfig& fallbackLocation) {
+    nodes.assign(1, Node());
+    exact.clear();
+    regexes = RegexSet();
+    regexTargets.clear();
+    fallback = &fallbackLocation;
+    for (std::map<std::string, LocationConfig>::const_iterator it = prefixLocations.begin();
+         it != prefixLocations.end(); ++it) {
+        insert(it->first, &it->second);
+    }
+    for (std::map<std::string, LocationConfig>::const_iterator it = exactLocations.begin();
+         it != exactLocations.end(); ++it) {
+        exact[it->first] = &it->second;
+    }
+    for (size_t i = 0; i < regexLocations.size(); ++i) {
+        const LocationConfig& location = regexLocations[i];
+        std::string error;
+        if (!regexes.add(location.getPath(), location.getModifier() == "~*", error)) {
+            std::cerr << "Warning: Ignoring location " << location.getModifier() << " '" << location.getPath()
+                      << "': " << error << "." << std::endl;
+            continue;
+        }
+        regexTargets.push_back(&location);
+    }
+    regexes.compile();
+}
+
+void LocationRouter::insert(const std::string& path, const LocationConfig* location) {
+    size_t current = 0;
+    size_t pos = 0;
+    while (pos < path.size()) {
+        std::map<char, size_t>::iterator edge = nodes[current].children.find(path[pos]);
+        if (edge == nodes[current].children.end()) {
+            Node leaf;
+            leaf.label = path.substr(pos);
+            leaf.location = location;
+            nodes.push_back(leaf);
+            nodes[current].children[path[pos]] = nodes.size() - 1;
+            return;
+        }
+        size_t child = edge->second;
+        const std::string& label = nodes[child].label;
+        size_t common = 0;
+        while (common < label.size() && pos + common < path.size() && label[common] == path[pos + common]) ++common;
+        if (common < label.size()) {
+            // Split the edge: a new node takes the shared part, the old child keeps the rest
+            Node middle;
+            middle.label = label.substr(0, common);
+            middle.children[label[common]] = child;
+            nodes[child].label.erase(0, common);
+            nodes.push_back(middle);
+            nodes[current].children[path[pos]] = nodes.size() - 1;
+            child = nodes.size() - 1;
+        }
+        current = child;
+        pos += common;
+    }
+    nodes[current].location = location;
+}
+
+const LocationConfig& LocationRouter::match(const std::string& path) const {
+    std::map<std::string, const LocationConfig*>::const_iterator hit = exact.find(path);
+    if (hit != exact.end()) return *hit->second;
+    int regex = regexes.firstMatch(path);
+    if (regex >= 0) return *regexTargets[regex];
+
+    const LocationConfig* best = nodes[0].location != NULL ? nodes[0].location : fallback;
+    size_t current = 0;
+    size_t pos = 0;
+    while (true) {
+        char next = pos < path.size() ? path[pos] : '/';
+        std::map<char, size_t>::const_iterator edge = nodes[current].children.find(next);
+        if (edge == nodes[current].children.end()) break;
+        const Node& child = nodes[edge->second];
+        size_t remaining = path.size() - pos;
+        if (remaining >= child.label.size()) {
+            if (path.compare(pos, child.label.size(), child.label) != 0) break;
+            pos += child.label.size();
+            current = edge->second;
+            if (child.location != NULL) best = child.location;
+            continue;
+        }
+        // "/dir/" also serves "/dir": the label is the rest of the path plus a slash
+        if (child.location != NULL && child.label.size() == remaining + 1 &&
+            child.label.compare(0, remaining, path, pos, remaining) == 0 && child.label[remaining] == '/') {
+            best = child.location;
+        }
+        break;
+    }
+    return *best;
+}
@@ -0,0 +1,191 @@
+#include "OpenFileCache.hpp"
+
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/inotify.h>
+#endif
+
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+#ifdef __linux__
+static const uint32_t WATCH_MASK = IN_ATTRIB | IN_CLOSE_WRITE | IN_CREATE | IN_DELETE | IN_DELETE_SELF |
+                                   IN_MODIFY | IN_MOVE | IN_MOVE_SELF | IN_ONLYDIR;
+#endif
+
+// The directory whose contents decide the entry: the directory itself for
+// directory entries, the parent for files and missing paths
+static std::string dependencyDirectory(const OpenFileCache::Entry& entry) {
+    std::string dir = entry.path;
+    while (dir.size() > 1 && dir[dir.size() - 1] == '/') dir.erase(dir.size() - 1);
+    if (dir.empty() || (entry.error == 0 && S_ISDIR(entry.st.st_mode))) return dir;
+    size_t slash = dir.rfind('/');
+    if (slash == std::string::npos) return "";
+    dir.erase(slash == 0 ? 1 : slash);
+    return dir;
+}
+
+OpenFileCache::Entry::Entry() : error(0), fd(-1) {
+    memset(&st, 0, sizeof(st));
+    memset(&indexSt, 0, sizeof(indexSt));
+}
+
+OpenFileCache::OpenFileCache() : maxEntries(0), validMs(0), inotifyFd(-1) {}
+
+OpenFileCache::~OpenFileCache() {
+    clear();
+    if (scratch.fd != -1) close(scratch.fd);
+    if (inotifyFd != -1) close(inotifyFd);
+}
+
+void OpenFileCache::configure(size_t entries, unsigned long valid, bool useInotify) {
+    clear();
+    maxEntries = entries;
+    validMs = valid;
+#ifdef __linux__
+    if (useInotify && maxEntries > 0 && inotifyFd == -1) {
+        inotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (inotifyFd == -1) {
+            std::cerr << "inotify unavailable (" << strerror(errno)
+                      << "), open file cache relies on open_file_cache_valid" << std::endl;
+        }
+    }
+#else
+    (void)useInotify;
+#endif
+}
+
+int OpenFileCache::eventFd() const {
+    return inotifyFd;
+}
+
+void OpenFileCache::processEvents() {
+#ifdef __linux__
+    char buffer[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    while (true) {
+        ssize_t length = read(inotifyFd, buffer, sizeof(buffer));
+        if (length < 0 && errno == EINTR) continue;
+        if (length <= 0) return;
+        for (char* p = buffer; p < buffer + length;) {
+            const struct inotify_event* event = reinterpret_cast<const struct inotify_event*>(p);
+            p += sizeof(struct inotify_event) + event->len;
+            if (event->mask & IN_Q_OVERFLOW) {
+                clear();
+                continue;
+            }
+            std::map<int, std::set<Key> >::iterator w = watchers.find(event->wd);
+            if (w == watchers.end()) continue;
+            // erase() edits the watcher set, so walk a copy
+            std::set<Key> stale = w->second;
+            for (std::set<Key>::const_iterator k = stale.begin(); k != stale.end(); ++k) {
+                std::map<Key, Slot>::iterator it = slots.find(*k);
+                if (it != slots.end()) erase(it);
+            }
+        }
+    }
+#endif
+}
+
+int OpenFileCache::watchDirectory(const std::string& directory) {
+#ifdef __linux__
+    if (inotifyFd == -1 || directory.empty()) return -1;
+    return inotify_add_watch(inotifyFd, directory.c_str(), WATCH_MASK);
+#else
+    (void)directory;
+    return -1;
+#endif
+}
+
+const OpenFileCache::Entry* OpenFileCache::find(const void* scope, const std::string& uri, unsigned long now) {
+    if (maxEntries == 0) return NULL;
+    std::map<Key, Slot>::iterator it = slots.find(Key(scope, uri));
+    if (it == slots.end()) return NULL;
+    if (now >= it->second.expires) {
+        erase(it);
+        return NULL;
+    }
+    lru.splice(lru.begin(), lru, it->second.lruPos);
+    return &it->second.entry;
+}
+
+const OpenFileCache::Entry& OpenFileCache::insert(const void* scope, const std::string& uri, const Entry& entry,
+                                                  unsigned long now) {
+    if (maxEntries == 0) {
+        if (scratch.fd != -1) close(scratch.fd);
+        scratch = entry;
+        return scratch;
+    }
+    Key key(scope, uri);
+    std::map<Key, Slot>::iterator old = slots.find(key);
+    if (old != slots.end()) erase(old);
+    while (slots.size() >= maxEntries && !lru.empty()) erase(slots.find(lru.back()));
+
+    Slot& slot = slots[key];
+    slot.entry = entry;
+    slot.expires = now + validMs;
+    slot.directory = dependencyDirectory(entry);
+    if (!slot.directory.empty()) directories[slot.directory].insert(key);
+    slot.watch = watchDirectory(slot.directory);
+    if (slot.watch != -1) watchers[slot.watch].insert(key);
+    lru.push_front(key);
+    slot.lruPos = lru.begin();
+    return slot.entry;
+}
+
+void OpenFileCache::erase(std::map<Key, Slot>::iterator it) {
+    Slot& slot = it->second;
+    if (slot.entry.fd != -1) close(slot.entry.fd);
+    std::map<std::string, std::set<Key> >::iterator d = directories.find(slot.directory);
+    if (d != directories.end()) {
+        d->second.erase(it->first);
+        if (d->second.empty()) directories.erase(d);
+    }
+    if (slot.watch != -1) {
+        std::map<int, std::set<Key> >::iterator w = watchers.find(slot.watch);
+        if (w != watchers.end()) {
+            w->second.erase(it->first);
+            if (w->second.empty()) {
+#ifdef __linux__
+                inotify_rm_watch(inotifyFd, slot.watch);
+#endif
+                watchers.erase(w);
+            }
+        }
+    }
+    lru.erase(slot.lruPos);
+    slots.erase(it);
+}
+
+void OpenFileCache::eraseDirectory(const std::string& directory) {
+    std::map<std::string, std::set<Key> >::iterator d = directories.find(directory);
+    if (d == directories.end()) return;
+    // erase() edits the directory's set, so walk a copy
+    std::set<Key> stale = d->second;
+    for (std::set<Key>::const_iterator k = stale.begin(); k != stale.end(); ++k) {
+        std::map<Key, Slot>::iterator it = slots.find(*k);
+        if (it != slots.end()) erase(it);
+    }
+}
+
+void OpenFileCache::invalidate(const std::string& path) {
+    std::string target = path;
+    while (target.size() > 1 && target[target.size() - 1] == '/') target.erase(target.size() - 1);
+    size_t slash = target.rfind('/');
+    if (slash != std::string::npos) eraseDirectory(target.substr(0, slash == 0 ? 1 : slash));
+    eraseDirectory(target);
+    // A removed directory takes its whole tree along: the keys from "dir/" up
+    // to "dir0" ('0' follows '/')
+    std::string below = target == "/" ? target : target + "/";
+    std::string past = below.substr(0, below.size() - 1) + "0";
+    for (;;) {
+        std::map<std::string, std::set<Key> >::iterator d = directories.lower_bound(below);
+        if (d == directories.end() || d->first >= past) break;
+        eraseDirectory(std::string(d->first));
+    }
+}
+
+void OpenFileCache::clear() {
+    while (!slots.empty()) erase(slots.begin());
+}
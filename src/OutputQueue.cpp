@@ -0,0 +1,140 @@
+#include "OutputQueue.hpp"
+
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+#include <cerrno>
+
+// iovecs handed to one sendmsg(); well below IOV_MAX everywhere
+static const size_t MAX_IOV = 64;
+// Copies are merged into the last segment while it stays this small
+static const size_t COALESCE_BYTES = 4096;
+
+SharedBytes::SharedBytes() : refs(1) {}
+
+SharedBytes::~SharedBytes() {}
+
+void SharedBytes::retain() {
+    ++refs;
+}
+
+void SharedBytes::release() {
+    if (--refs == 0) delete this;
+}
+
+OutputQueue::OutputQueue() : headOffset(0), pendingBytes(0) {}
+
+OutputQueue::OutputQueue(const OutputQueue& other) : headOffset(0), pendingBytes(0) {
+    *this = other;
+}
+
+OutputQueue& OutputQueue::operator=(const OutputQueue& other) {
+    if (this == &other) return *this;
+    clear();
+    segments = other.segments;
+    for (std::deque<Segment>::iterator it = segments.begin(); it != segments.end(); ++it) {
+        if (it->owner != NULL) it->owner->retain();
+    }
+    headOffset = other.headOffset;
+    pendingBytes = other.pendingBytes;
+    return *this;
+}
+
+OutputQueue::~OutputQueue() {
+    clear();
+}
+
+void OutputQueue::append(const char* data, size_t length) {
+    if (length == 0) return;
+    if (!segments.empty() && segments.back().owner == NULL &&
+        segments.back().bytes.size() + length <= COALESCE_BYTES) {
+        segments.back().bytes.append(data, length);
+    } else {
+        segments.push_back(Segment());
+        segments.back().bytes.assign(data, length);
+    }
+    pendingBytes += length;
+}
+
+void OutputQueue::append(const std::string& data) {
+    append(data.data(), data.size());
+}
+
+void OutputQueue::adopt(std::string& data) {
+    if (data.empty()) return;
+    pendingBytes += data.size();
+    segments.push_back(Segment());
+    segments.back().bytes.swap(data);
+}
+
+void OutputQueue::appendShared(SharedBytes* owner, const char* data, size_t length) {
+    if (length == 0) return;
+    owner->retain();
+    segments.push_back(Segment());
+    segments.back().owner = owner;
+    segments.back().shared = data;
+    segments.back().sharedLength = length;
+    pendingBytes += length;
+}
+
+void OutputQueue::popFront() {
+    if (segments.front().owner != NULL) segments.front().owner->release();
+    segments.pop_front();
+    headOffset = 0;
+}
+
+void OutputQueue::clear() {
+    while (!segments.empty()) popFront();
+    pendingBytes = 0;
+}
+
+bool OutputQueue::empty() const {
+    return pendingBytes == 0;
+}
+
+size_t OutputQueue::size() const {
+    return pendingBytes;
+}
+
+size_t OutputQueue::flush(int fd, bool more) {
+    int flags = 0;
+#ifdef MSG_NOSIGNAL
+    flags |= MSG_NOSIGNAL;
+#endif
+#ifdef MSG_MORE
+    if (more) flags |= MSG_MORE;
+#else
+    (void)more;
+#endif
+    size_t total = 0;
+    while (!segments.empty()) {
+        struct iovec iov[MAX_IOV];
+        size_t count = 0;
+        for (std::deque<Segment>::iterator it = segments.begin(); it != segments.end() && count < MAX_IOV; ++it) {
+            size_t skip = count == 0 ? headOffset : 0;
+            iov[count].iov_base = const_cast<char*>(it->data() + skip);
+            iov[count].iov_len = it->size() - skip;
+            ++count;
+        }
+        struct msghdr msg = msghdr();
+        msg.msg_iov = iov;
+        msg.msg_iovlen = count;
+        ssize_t sent = sendmsg(fd, &msg, flags);
+        if (sent < 0 && errno == EINTR) continue;
+        if (sent <= 0) break;
+
+        total += sent;
+        pendingBytes -= sent;
+        size_t left = sent;
+        while (left > 0) {
+            size_t inFront = segments.front().size() - headOffset;
+            if (left < inFront) {
+                headOffset += left;
+                break;
+            }
+            left -= inFront;
+            popFront();
+        }
+    }
+    return total;
+}
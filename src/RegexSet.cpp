@@ -0,0 +1,553 @@
+#include "RegexSet.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <climits>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+
+// Bounds on what one server's patterns may cost
+static const int MAX_REPEAT = 1000;
+static const size_t MAX_NFA_STATES = 100000;
+static const size_t MAX_DFA_STATES = 4096; // beyond this the NFA is simulated instead
+
+// Parses one pattern into a syntax tree, then emits it into the owner's NFA
+class RegexSet::Parser {
+public:
+    Parser(RegexSet& regexSet, const std::string& source, bool ignoreCase)
+        : owner(regexSet), pattern(source), pos(0), caseInsensitive(ignoreCase) {}
+
+    // Start state of the pattern, leading to accept; -1 with error set on failure
+    int compile(int accept, std::string& error) {
+        if (pattern.compare(0, 4, "(?i)") == 0) {
+            caseInsensitive = true;
+            pos = 4;
+        }
+        int root = parseAlternation();
+        if (message.empty() && pos < pattern.size()) fail("unbalanced ')'");
+        if (!message.empty()) {
+            error = message;
+            return -1;
+        }
+        int entry = emit(root, accept);
+        if (owner.states.size() > MAX_NFA_STATES) {
+            error = "pattern too large";
+            return -1;
+        }
+        return entry;
+    }
+
+private:
+    enum Kind { NODE_SET, NODE_CONCAT, NODE_ALTERNATE, NODE_REPEAT, NODE_BOL, NODE_EOL, NODE_EMPTY };
+    struct Node {
+        Kind kind;
+        CharSet set;
+        std::vector<int> children;
+        int min;
+        int max; // -1 for unbounded
+
+        explicit Node(Kind k) : kind(k), min(0), max(0) { memset(set.bits, 0, sizeof(set.bits)); }
+    };
+
+    int add(const Node& node) {
+        nodes.push_back(node);
+        return static_cast<int>(nodes.size()) - 1;
+    }
+
+    int fail(const std::string& reason) {
+        if (message.empty()) message = reason;
+        return add(Node(NODE_EMPTY));
+    }
+
+    bool atEnd() const { return pos >= pattern.size(); }
+
+    static void setBit(CharSet& set, unsigned char c) { set.bits[c >> 3] |= static_cast<unsigned char>(1 << (c & 7)); }
+    static void setRange(CharSet& set, unsigned char lo, unsigned char hi) {
+        for (int c = lo; c <= hi; ++c) setBit(set, static_cast<unsigned char>(c));
+    }
+
+    void foldCase(CharSet& set) const {
+        if (!caseInsensitive) return;
+        for (int c = 'a'; c <= 'z'; ++c) {
+            unsigned char upper = static_cast<unsigned char>(c - 'a' + 'A');
+            if (set.has(static_cast<unsigned char>(c)) || set.has(upper)) {
+                setBit(set, static_cast<unsigned char>(c));
+                setBit(set, upper);
+            }
+        }
+    }
+
+    // \d \w \s and their negations; false when c is no class shorthand
+    static bool shorthand(char c, CharSet& set) {
+        CharSet named;
+        memset(named.bits, 0, sizeof(named.bits));
+        char lower = static_cast<char>(tolower(static_cast<unsigned char>(c)));
+        if (lower == 'd') {
+            setRange(named, '0', '9');
+        } else if (lower == 'w') {
+            setRange(named, '0', '9');
+            setRange(named, 'a', 'z');
+            setRange(named, 'A', 'Z');
+            setBit(named, '_');
+        } else if (lower == 's') {
+            const char* spaces = " \t\n\r\f\v";
+            for (const char* s = spaces; *s; ++s) setBit(named, static_cast<unsigned char>(*s));
+        } else {
+            return false;
+        }
+        bool negated = c != lower;
+        for (int i = 0; i < 32; ++i) set.bits[i] |= negated ? static_cast<unsigned char>(~named.bits[i]) : named.bits[i];
+        return true;
+    }
+
+    // The byte an escape stands for; -1 after reporting an unsupported one
+    int escapedByte(char c) {
+        switch (c) {
+            case 'n': return '\n';
+            case 't': return '\t';
+            case 'r': return '\r';
+            case 'f': return '\f';
+            case 'v': return '\v';
+            case 'x': {
+                int value = 0;
+                int digits = 0;
+                while (digits < 2 && !atEnd() && isxdigit(static_cast<unsigned char>(pattern[pos]))) {
+                    char h = pattern[pos++];
+                    value = value * 16 + (isdigit(static_cast<unsigned char>(h)) ? h - '0' : tolower(h) - 'a' + 10);
+                    ++digits;
+                }
+                if (digits == 0) {
+                    fail("bad \\x escape");
+                    return -1;
+                }
+                return value;
+            }
+            default:
+                if (isdigit(static_cast<unsigned char>(c))) {
+                    fail("backreferences are not supported");
+                    return -1;
+                }
+                if (isalpha(static_cast<unsigned char>(c))) {
+                    fail(std::string("unsupported escape \\") + c);
+                    return -1;
+                }
+                return static_cast<unsigned char>(c);
+        }
+    }
+
+    int parseAlternation() {
+        int first = parseConcat();
+        if (atEnd() || pattern[pos] != '|') return first;
+        Node alternate(NODE_ALTERNATE);
+        alternate.children.push_back(first);
+        while (!atEnd() && pattern[pos] == '|' && message.empty()) {
+            ++pos;
+            alternate.children.push_back(parseConcat());
+        }
+        return add(alternate);
+    }
+
+    int parseConcat() {
+        Node concat(NODE_CONCAT);
+        while (!atEnd() && pattern[pos] != '|' && pattern[pos] != ')' && message.empty()) {
+            concat.children.push_back(parseRepeat());
+        }
+        if (concat.children.empty()) return add(Node(NODE_EMPTY));
+        if (concat.children.size() == 1) return concat.children[0];
+        return add(concat);
+    }
+
+    // {m}, {m,} or {m,n} at pos; false (pos unchanged) when it is a literal '{'
+    bool parseBounds(int& min, int& max) {
+        size_t p = pos + 1;
+        size_t digitsStart = p;
+        while (p < pattern.size() && isdigit(static_cast<unsigned char>(pattern[p]))) ++p;
+        if (p == digitsStart) return false;
+        min = atoi(pattern.substr(digitsStart, p - digitsStart).c_str());
+        max = min;
+        if (p < pattern.size() && pattern[p] == ',') {
+            ++p;
+            size_t maxStart = p;
+            while (p < pattern.size() && isdigit(static_cast<unsigned char>(pattern[p]))) ++p;
+            max = p == maxStart ? -1 : atoi(pattern.substr(maxStart, p - maxStart).c_str());
+        }
+        if (p >= pattern.size() || pattern[p] != '}') return false;
+        pos = p + 1;
+        return true;
+    }
+
+    int parseRepeat() {
+        int atom = parseAtom();
+        while (!atEnd() && message.empty()) {
+            int min;
+            int max;
+            char c = pattern[pos];
+            if (c == '*') {
+                min = 0; max = -1; ++pos;
+            } else if (c == '+') {
+                min = 1; max = -1; ++pos;
+            } else if (c == '?') {
+                min = 0; max = 1; ++pos;
+            } else if (c == '{' && parseBounds(min, max)) {
+                if (min > MAX_REPEAT || max > MAX_REPEAT || (max != -1 && max < min)) return fail("bad repetition bounds");
+            } else {
+                break;
+            }
+            // A lazy quantifier matches the same strings, only the captures differ
+            if (!atEnd() && pattern[pos] == '?') ++pos;
+            else if (!atEnd() && pattern[pos] == '+') return fail("possessive quantifiers are not supported");
+            Node repeat(NODE_REPEAT);
+            repeat.children.push_back(atom);
+            repeat.min = min;
+            repeat.max = max;
+            atom = add(repeat);
+        }
+        return atom;
+    }
+
+    int parseGroup() {
+        ++pos; // '('
+        if (pattern.compare(pos, 1, "?") == 0) {
+            if (pattern.compare(pos, 2, "?:") == 0) {
+                pos += 2;
+            } else if (pattern.compare(pos, 2, "?<") == 0 || pattern.compare(pos, 3, "?P<") == 0 ||
+                       pattern.compare(pos, 2, "?'") == 0) {
+                // Named group; the name only matters for captures
+                size_t close = pattern.find_first_of(">'", pos + 2);
+                if (close == std::string::npos || pattern.compare(pos, 3, "?<=") == 0 ||
+                    pattern.compare(pos, 3, "?<!") == 0) {
+                    return fail("lookbehind is not supported");
+                }
+                pos = close + 1;
+            } else {
+                return fail("unsupported group construct");
+            }
+        }
+        int inner = parseAlternation();
+        if (atEnd() || pattern[pos] != ')') return fail("missing ')'");
+        ++pos;
+        return inner;
+    }
+
+    int parseClass() {
+        ++pos; // '['
+        Node node(NODE_SET);
+        bool negated = false;
+        if (!atEnd() && pattern[pos] == '^') {
+            negated = true;
+            ++pos;
+        }
+        bool first = true;
+        while (!atEnd() && (pattern[pos] != ']' || first) && message.empty()) {
+            first = false;
+            int lo;
+            char c = pattern[pos++];
+            if (c == '\\') {
+                if (atEnd()) return fail("trailing '\\'");
+                char e = pattern[pos++];
+                if (shorthand(e, node.set)) continue;
+                lo = escapedByte(e);
+                if (lo < 0) return add(Node(NODE_EMPTY));
+            } else {
+                lo = static_cast<unsigned char>(c);
+            }
+            int hi = lo;
+            if (pos + 1 < pattern.size() && pattern[pos] == '-' && pattern[pos + 1] != ']') {
+                ++pos;
+                char h = pattern[pos++];
+                if (h == '\\') {
+                    if (atEnd()) return fail("trailing '\\'");
+                    hi = escapedByte(pattern[pos++]);
+                    if (hi < 0) return add(Node(NODE_EMPTY));
+                } else {
+                    hi = static_cast<unsigned char>(h);
+                }
+                if (hi < lo) return fail("bad class range");
+            }
+            setRange(node.set, static_cast<unsigned char>(lo), static_cast<unsigned char>(hi));
+        }
+        if (atEnd()) return fail("missing ']'");
+        ++pos; // ']'
+        foldCase(node.set);
+        if (negated) {
+            for (int i = 0; i < 32; ++i) node.set.bits[i] = static_cast<unsigned char>(~node.set.bits[i]);
+        }
+        return add(node);
+    }
+
+    int parseAtom() {
+        char c = pattern[pos];
+        switch (c) {
+            case '(': return parseGroup();
+            case '[': return parseClass();
+            case '*': case '+': case '?': return fail("nothing to repeat");
+            case '^': ++pos; return add(Node(NODE_BOL));
+            case '$': ++pos; return add(Node(NODE_EOL));
+            case '.': {
+                ++pos;
+                Node any(NODE_SET);
+                memset(any.set.bits, 0xff, sizeof(any.set.bits));
+                any.set.bits['\n' >> 3] &= static_cast<unsigned char>(~(1 << ('\n' & 7)));
+                return add(any);
+            }
+            default: break;
+        }
+        ++pos;
+        Node literal(NODE_SET);
+        if (c == '\\') {
+            if (atEnd()) return fail("trailing '\\'");
+            char e = pattern[pos++];
+            if (e == 'A') return add(Node(NODE_BOL));
+            if (e == 'z' || e == 'Z') return add(Node(NODE_EOL));
+            if (e == 'b' || e == 'B') return fail("word boundaries are not supported");
+            if (!shorthand(e, literal.set)) {
+                int byte = escapedByte(e);
+                if (byte < 0) return add(Node(NODE_EMPTY));
+                setBit(literal.set, static_cast<unsigned char>(byte));
+            }
+        } else {
+            setBit(literal.set, static_cast<unsigned char>(c));
+        }
+        foldCase(literal.set);
+        return add(literal);
+    }
+
+    // Emits node so that it continues into next; built back to front
+    int emit(int index, int next) {
+        if (owner.states.size() > MAX_NFA_STATES) return next;
+        const Node& node = nodes[index];
+        switch (node.kind) {
+            case NODE_SET: {
+                int state = owner.newState(STATE_CHAR);
+                owner.states[state].charSet = static_cast<int>(owner.charSets.size());
+                owner.charSets.push_back(node.set);
+                owner.states[state].next = next;
+                return state;
+            }
+            case NODE_CONCAT: {
+                int entry = next;
+                for (size_t i = node.children.size(); i-- > 0;) entry = emit(node.children[i], entry);
+                return entry;
+            }
+            case NODE_ALTERNATE: {
+                std::vector<int> alts;
+                for (size_t i = 0; i < node.children.size(); ++i) alts.push_back(emit(node.children[i], next));
+                int split = owner.newState(STATE_SPLIT);
+                owner.states[split].alts = alts;
+                return split;
+            }
+            case NODE_REPEAT: {
+                int entry = next;
+                if (node.max == -1) {
+                    // Loop: split -> (body -> split | next)
+                    int loop = owner.newState(STATE_SPLIT);
+                    int body = emit(node.children[0], loop);
+                    owner.states[loop].alts.push_back(body);
+                    owner.states[loop].alts.push_back(next);
+                    entry = loop;
+                } else {
+                    for (int i = node.min; i < node.max; ++i) {
+                        int body = emit(node.children[0], entry);
+                        int optional = owner.newState(STATE_SPLIT);
+                        owner.states[optional].alts.push_back(body);
+                        owner.states[optional].alts.push_back(entry);
+                        entry = optional;
+                    }
+                }
+                for (int i = 0; i < node.min; ++i) entry = emit(node.children[0], entry);
+                return entry;
+            }
+            case NODE_BOL:
+            case NODE_EOL: {
+                int state = owner.newState(node.kind == NODE_BOL ? STATE_BOL : STATE_EOL);
+                owner.states[state].next = next;
+                return state;
+            }
+            case NODE_EMPTY:
+                break;
+        }
+        return next;
+    }
+
+    RegexSet& owner;
+    const std::string& pattern;
+    size_t pos;
+    bool caseInsensitive;
+    std::vector<Node> nodes;
+    std::string message;
+};
+
+RegexSet::RegexSet() : start(-1), classCount(0) {
+    memset(byteClass, 0, sizeof(byteClass));
+}
+
+int RegexSet::newState(StateType type) {
+    states.push_back(State());
+    states.back().type = type;
+    return static_cast<int>(states.size()) - 1;
+}
+
+bool RegexSet::add(const std::string& pattern, bool caseInsensitive, std::string& error) {
+    size_t stateMark = states.size();
+    size_t setMark = charSets.size();
+    int accept = newState(STATE_ACCEPT);
+    states[accept].pattern = static_cast<int>(entries.size());
+    Parser parser(*this, pattern, caseInsensitive);
+    int entry = parser.compile(accept, error);
+    if (entry < 0) {
+        states.resize(stateMark);
+        charSets.resize(setMark);
+        return false;
+    }
+    entries.push_back(entry);
+    return true;
+}
+
+size_t RegexSet::size() const {
+    return entries.size();
+}
+
+bool RegexSet::empty() const {
+    return entries.empty();
+}
+
+// Adds every state reachable without consuming input; ^ only passes at the start
+// of the text and $ only at its end. Leaves the set sorted.
+void RegexSet::closure(std::vector<int>& set, bool atStart, bool atEnd) const {
+    std::vector<char> seen(states.size(), 0);
+    std::vector<int> stack(set);
+    set.clear();
+    while (!stack.empty()) {
+        int s = stack.back();
+        stack.pop_back();
+        if (s < 0 || seen[s]) continue;
+        seen[s] = 1;
+        set.push_back(s);
+        const State& state = states[s];
+        if (state.type == STATE_SPLIT) {
+            stack.insert(stack.end(), state.alts.begin(), state.alts.end());
+        } else if ((state.type == STATE_BOL && atStart) || (state.type == STATE_EOL && atEnd)) {
+            stack.push_back(state.next);
+        }
+    }
+    std::sort(set.begin(), set.end());
+}
+
+int RegexSet::lowestAccept(const std::vector<int>& set) const {
+    int lowest = INT_MAX;
+    for (size_t i = 0; i < set.size(); ++i) {
+        if (states[set[i]].type == STATE_ACCEPT) lowest = std::min(lowest, states[set[i]].pattern);
+    }
+    return lowest;
+}
+
+void RegexSet::compile() {
+    dfa.clear();
+    if (entries.empty()) return;
+
+    // Unanchored search: a ".*" loop feeds every pattern at each position
+    start = newState(STATE_SPLIT);
+    int any = newState(STATE_CHAR);
+    CharSet all;
+    memset(all.bits, 0xff, sizeof(all.bits));
+    states[any].charSet = static_cast<int>(charSets.size());
+    charSets.push_back(all);
+    states[any].next = start;
+    states[start].alts = entries;
+    states[start].alts.push_back(any);
+
+    // Bytes no pattern tells apart share a DFA column
+    memset(byteClass, 0, sizeof(byteClass));
+    classCount = 1;
+    for (size_t i = 0; i < charSets.size(); ++i) {
+        std::map<std::pair<int, bool>, int> split;
+        int count = 0;
+        unsigned char refined[256];
+        for (int c = 0; c < 256; ++c) {
+            std::pair<int, bool> key(byteClass[c], charSets[i].has(static_cast<unsigned char>(c)));
+            std::map<std::pair<int, bool>, int>::iterator it = split.find(key);
+            if (it == split.end()) it = split.insert(std::make_pair(key, count++)).first;
+            refined[c] = static_cast<unsigned char>(it->second);
+        }
+        memcpy(byteClass, refined, sizeof(byteClass));
+        classCount = count;
+    }
+
+    if (!buildDfa()) dfa.clear();
+}
+
+// Subset construction over byte classes; false when it exceeds MAX_DFA_STATES
+bool RegexSet::buildDfa() {
+    std::vector<unsigned char> representative(classCount);
+    for (int c = 255; c >= 0; --c) representative[byteClass[c]] = static_cast<unsigned char>(c);
+
+    std::map<std::vector<int>, int> ids;
+    std::vector<std::vector<int> > sets;
+    std::vector<int> initial(1, start);
+    closure(initial, true, false);
+    ids[initial] = 0;
+    sets.push_back(initial);
+
+    for (size_t d = 0; d < sets.size(); ++d) {
+        if (sets.size() > MAX_DFA_STATES) return false;
+        DfaState state;
+        state.firstAccept = lowestAccept(sets[d]);
+        std::vector<int> ending(sets[d]);
+        closure(ending, false, true);
+        state.firstAcceptAtEnd = lowestAccept(ending);
+        state.next.resize(classCount);
+        for (int k = 0; k < classCount; ++k) {
+            std::vector<int> target;
+            for (size_t i = 0; i < sets[d].size(); ++i) {
+                const State& s = states[sets[d][i]];
+                if (s.type == STATE_CHAR && charSets[s.charSet].has(representative[k])) target.push_back(s.next);
+            }
+            closure(target, false, false);
+            std::map<std::vector<int>, int>::iterator it = ids.find(target);
+            if (it == ids.end()) {
+                it = ids.insert(std::make_pair(target, static_cast<int>(sets.size()))).first;
+                sets.push_back(target);
+            }
+            state.next[k] = it->second;
+        }
+        dfa.push_back(state);
+    }
+    return true;
+}
+
+// Set-of-states simulation for pattern sets whose DFA would be too large
+int RegexSet::simulate(const char* text, size_t length) const {
+    std::vector<int> current(1, start);
+    closure(current, true, length == 0);
+    int best = lowestAccept(current);
+    for (size_t pos = 0; pos < length && best != 0; ++pos) {
+        unsigned char c = static_cast<unsigned char>(text[pos]);
+        std::vector<int> next;
+        for (size_t i = 0; i < current.size(); ++i) {
+            const State& s = states[current[i]];
+            if (s.type == STATE_CHAR && charSets[s.charSet].has(c)) next.push_back(s.next);
+        }
+        closure(next, false, pos + 1 == length);
+        best = std::min(best, lowestAccept(next));
+        current.swap(next);
+    }
+    return best == INT_MAX ? -1 : best;
+}
+
+int RegexSet::firstMatch(const std::string& text) const {
+    return firstMatch(text.data(), text.size());
+}
+
+int RegexSet::firstMatch(const char* text, size_t length) const {
+    if (entries.empty()) return -1;
+    if (dfa.empty()) return simulate(text, length);
+    int state = 0;
+    int best = dfa[0].firstAccept;
+    for (size_t pos = 0; pos < length && best != 0; ++pos) {
+        state = dfa[state].next[byteClass[static_cast<unsigned char>(text[pos])]];
+        best = std::min(best, dfa[state].firstAccept);
+    }
+    best = std::min(best, dfa[state].firstAcceptAtEnd);
+    return best == INT_MAX ? -1 : best;
+}
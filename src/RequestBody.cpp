@@ -0,0 +1,191 @@
+#include "RequestBody.hpp"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/sendfile.h>
+#endif
+
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+static const size_t COPY_CHUNK_BYTES = 64 * 1024;
+
+static bool writeFully(int fd, const char* data, size_t length) {
+    while (length > 0) {
+        ssize_t n = write(fd, data, length);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        data += n;
+        length -= n;
+    }
+    return true;
+}
+
+RequestBody::RequestBody()
+    : borrowed(NULL), borrowedSize(0), fileFd(-1), fileSize(0), memoryLimit(static_cast<size_t>(-1)), mapping(NULL),
+      mappingSize(0) {}
+
+RequestBody::RequestBody(const RequestBody& other)
+    : buffer(other.borrowed != NULL ? std::string(other.borrowed, other.borrowedSize) : other.buffer),
+      borrowed(NULL),
+      borrowedSize(0),
+      fileFd(-1),
+      fileSize(other.fileSize),
+      memoryLimit(other.memoryLimit),
+      tempDir(other.tempDir),
+      mapping(NULL),
+      mappingSize(0) {
+    if (other.fileFd != -1) fileFd = fcntl(other.fileFd, F_DUPFD_CLOEXEC, 0);
+}
+
+RequestBody& RequestBody::operator=(const RequestBody& other) {
+    if (this != &other) {
+        clear();
+        if (other.borrowed != NULL) buffer.assign(other.borrowed, other.borrowedSize);
+        else buffer = other.buffer;
+        fileSize = other.fileSize;
+        memoryLimit = other.memoryLimit;
+        tempDir = other.tempDir;
+        if (other.fileFd != -1) fileFd = fcntl(other.fileFd, F_DUPFD_CLOEXEC, 0);
+    }
+    return *this;
+}
+
+RequestBody::~RequestBody() {
+    clear();
+}
+
+void RequestBody::setSpool(size_t limit, const std::string& dir) {
+    memoryLimit = limit;
+    tempDir = dir.empty() ? "/tmp" : dir;
+}
+
+void RequestBody::clear() {
+    unmap();
+    if (fileFd != -1) close(fileFd);
+    fileFd = -1;
+    fileSize = 0;
+    buffer.clear();
+    borrowed = NULL;
+    borrowedSize = 0;
+}
+
+void RequestBody::unmap() const {
+    if (mapping != NULL) munmap(mapping, mappingSize);
+    mapping = NULL;
+    mappingSize = 0;
+}
+
+// Moves the in-memory part to a new temporary file that is unlinked right away,
+// so it disappears with its last descriptor even if the server is killed
+bool RequestBody::spill() {
+    std::string pattern = tempDir + "/webserv_body_XXXXXX";
+    std::vector<char> path(pattern.begin(), pattern.end());
+    path.push_back('\0');
+    int fd = mkstemp(&path[0]);
+    if (fd == -1) {
+        std::cerr << "Cannot create request body file in " << tempDir << ": " << strerror(errno) << std::endl;
+        return false;
+    }
+    unlink(&path[0]);
+    fcntl(fd, F_SETFD, FD_CLOEXEC);
+    if (!writeFully(fd, buffer.data(), buffer.size())) {
+        std::cerr << "Cannot write request body file: " << strerror(errno) << std::endl;
+        close(fd);
+        return false;
+    }
+    fileFd = fd;
+    fileSize = buffer.size();
+    std::string().swap(buffer);
+    return true;
+}
+
+void RequestBody::borrow(const char* data, size_t length) {
+    clear();
+    borrowed = data;
+    borrowedSize = length;
+}
+
+bool RequestBody::append(const char* data, size_t length) {
+    if (length == 0) return true;
+    if (borrowed != NULL) {
+        buffer.assign(borrowed, borrowedSize);
+        borrowed = NULL;
+        borrowedSize = 0;
+    }
+    if (fileFd == -1) {
+        if (buffer.size() + length <= memoryLimit) {
+            buffer.append(data, length);
+            return true;
+        }
+        if (!spill()) return false;
+    }
+    unmap();
+    if (!writeFully(fileFd, data, length)) {
+        std::cerr << "Cannot write request body file: " << strerror(errno) << std::endl;
+        return false;
+    }
+    fileSize += length;
+    return true;
+}
+
+size_t RequestBody::size() const {
+    if (fileFd != -1) return fileSize;
+    return borrowed != NULL ? borrowedSize : buffer.size();
+}
+
+bool RequestBody::empty() const {
+    return size() == 0;
+}
+
+bool RequestBody::inFile() const {
+    return fileFd != -1;
+}
+
+int RequestBody::fd() const {
+    return fileFd;
+}
+
+const char* RequestBody::data() const {
+    if (borrowed != NULL) return borrowed;
+    if (fileFd == -1 || fileSize == 0) return buffer.data();
+    if (mapping == NULL) {
+        void* addr = mmap(NULL, fileSize, PROT_READ, MAP_PRIVATE, fileFd, 0);
+        if (addr == MAP_FAILED) {
+            std::cerr << "Cannot map request body file: " << strerror(errno) << std::endl;
+            return NULL;
+        }
+        mapping = addr;
+        mappingSize = fileSize;
+    }
+    return static_cast<const char*>(mapping);
+}
+
+bool RequestBody::writeTo(int outFd) const {
+    if (fileFd == -1) return writeFully(outFd, data(), size());
+
+    off_t offset = 0;
+#ifdef __linux__
+    while (static_cast<size_t>(offset) < fileSize) {
+        ssize_t n = sendfile(outFd, fileFd, &offset, fileSize - offset);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break; // fall back to read/write below
+    }
+    if (static_cast<size_t>(offset) >= fileSize) return true;
+#endif
+    char chunk[COPY_CHUNK_BYTES];
+    while (static_cast<size_t>(offset) < fileSize) {
+        ssize_t n = pread(fileFd, chunk, sizeof(chunk), offset);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0 || !writeFully(outFd, chunk, n)) return false;
+        offset += n;
+    }
+    return true;
+}
@@ -1,20 +1,44 @@
 #include "Server.hpp"
 #include "Utils.hpp"
 
+#include <sys/resource.h>
+#ifdef __linux__
+#include <linux/openat2.h>
+#include <sys/sendfile.h>
+#include <sys/syscall.h>
+#endif
+
 // Event loop tuning knobs
-static const int SELECT_TIMEOUT_SEC = 1;
-static const int CLIENT_TIMEOUT_SEC = 30;
-static const int CGI_TIMEOUT_SEC = 120;
+static const long CGI_REAP_POLL_MS = 10; // while a CGI closed stdout but has not exited yet
+static const unsigned long CLIENT_TIMEOUT_SEC = 30;    // no progress while receiving a body or sending
+static const unsigned long HEADER_TIMEOUT_SEC = 30;    // whole request head, counted from its first byte
+static const unsigned long KEEPALIVE_TIMEOUT_SEC = 30; // idle connection between requests
+static const unsigned long CGI_TIMEOUT_SEC = 120;
 static const size_t MAX_HEADER_BYTES = 32 * 1024;
 static const size_t MAX_REQUEST_BYTES = 200 * 1024 * 1024;
-static const size_t FILE_CHUNK_BYTES = 16 * 1024;
+// Body bytes read per readiness event before the parser moves them out of inBuffer
+static const size_t BODY_READ_BATCH = 256 * 1024;
+// Parsed body bytes waiting for a CGI's stdin before more of a streamed body is parsed
+static const size_t CGI_STDIN_BUFFER_BYTES = 64 * 1024;
+static const size_t SENDFILE_CHUNK_BYTES = 1024 * 1024; // per sendfile() call
+// Streamed CGI output queued for a client above which the script's stdout is not read,
+// and the level it must drain to before reading resumes
+static const size_t CGI_STREAM_HIGH_WATER = 256 * 1024;
+static const size_t CGI_STREAM_LOW_WATER = 64 * 1024;
 
 // ---- internal helpers ----------------------------------------------------
 
+// Each fd owns one timer per kind in the TimerWheel
+enum { TIMER_CLIENT = 0, TIMER_CGI = 1, TIMER_KINDS = 2 };
+
+static int timerKey(int fd, int kind) {
+    return fd * TIMER_KINDS + kind;
+}
+
 static bool needsWrite(const ClientState& st) {
-    if (st.outOffset < st.outBuffer.size()) return true;
+    if (!st.output.empty()) return true;
     if (st.fileStream.active) {
-        if (!st.fileStream.pendingChunk.empty()) return true;
+        if (!st.fileStream.pending.empty()) return true;
         if (st.fileStream.offset < st.fileStream.size) return true;
     }
     return false;
@@ -27,23 +51,106 @@ static void clearFileStream(FileStreamState& fs) {
     fs.size = 0;
     fs.active = false;
     fs.isHead = false;
-    fs.pendingChunk.clear();
+    fs.useSendfile = true;
+    fs.pending.clear();
+}
+
+// True when path is root itself or lies below it
+static bool isBeneath(const std::string& path, const std::string& root) {
+    if (path.compare(0, root.size(), root) != 0) return false;
+    return path.size() == root.size() || root[root.size() - 1] == '/' || path[root.size()] == '/';
+}
+
+// Canonical form of a path that may not exist yet: its deepest existing ancestor
+// resolved, the missing components appended as they are
+static std::string canonicalPath(const std::string& path) {
+    char canonical[PATH_MAX];
+    if (realpath(path.c_str(), canonical) != NULL) return canonical;
+    std::string trimmed = path;
+    while (trimmed.size() > 1 && trimmed[trimmed.size() - 1] == '/') trimmed.erase(trimmed.size() - 1);
+    size_t slash = trimmed.find_last_of('/');
+    std::string name = slash == std::string::npos ? trimmed : trimmed.substr(slash + 1);
+    if (name.empty() || name == "." || name == "..") return path;
+    std::string parent = slash == std::string::npos ? "." : slash == 0 ? "/" : trimmed.substr(0, slash);
+    std::string base = canonicalPath(parent);
+    if (base.empty() || base[0] != '/') return path;
+    return base + (base[base.size() - 1] == '/' ? "" : "/") + name;
+}
+
+// Canonicalizes and opens a configured root; the descriptor lives as long as the server.
+// A root created later still gets the absolute path the upload handlers write to.
+static RootDirectory openRootDirectory(const std::string& root, std::vector<int>& opened) {
+    RootDirectory directory;
+    directory.path = canonicalPath(root);
+    directory.fd = open(directory.path.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (directory.fd != -1) opened.push_back(directory.fd);
+    return directory;
+}
+
+// Sends as much of a streamed file as the socket takes, straight from the page
+// cache with sendfile(); files sendfile() refuses go through a pooled block instead.
+// Returns false when the connection has to be dropped.
+static bool pumpFileStream(int sock, FileStreamState& fs, bool& progressed) {
+#ifdef __linux__
+    while (fs.useSendfile && fs.pending.empty() && fs.offset < fs.size) {
+        size_t want = static_cast<size_t>(fs.size - fs.offset);
+        if (want > SENDFILE_CHUNK_BYTES) want = SENDFILE_CHUNK_BYTES;
+        ssize_t n = sendfile(sock, fs.fd, &fs.offset, want);
+        if (n > 0) {
+            progressed = true;
+        } else if (n == 0) {
+            fs.size = fs.offset; // file shrank since it was opened
+        } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            return true;
+        } else if (errno == EINVAL || errno == ENOSYS) {
+            fs.useSendfile = false;
+        } else if (errno != EINTR) {
+            return false;
+        }
+    }
+#else
+    fs.useSendfile = false;
+#endif
+    if (fs.pending.empty() && fs.offset < fs.size) {
+        size_t space;
+        char* dest = fs.pending.reserve(space);
+        if (static_cast<off_t>(space) > fs.size - fs.offset) space = fs.size - fs.offset;
+        ssize_t r = pread(fs.fd, dest, space, fs.offset);
+        fs.pending.commit(r > 0 ? r : 0);
+        if (r < 0) return false;
+        if (r == 0) fs.size = fs.offset;
+        fs.offset += r;
+    }
+    while (!fs.pending.empty()) {
+        size_t length;
+        const char* data = fs.pending.data(length);
+        ssize_t sent = send(sock, data, length, 0);
+        if (sent <= 0) break;
+        fs.pending.consume(sent);
+        progressed = true;
+    }
+    return true;
 }
 
-static void cleanupCgi(int fd, std::map<int, CgiState>& cgiStates);
-static void closeClientFd(int fd, fd_set& mr, fd_set& mw, std::map<int, ClientState>& clients, std::map<int, CgiState>& cgiStates);
+static void raiseFdLimit() {
+    struct rlimit rl;
+    if (getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur < rl.rlim_max) {
+        rl.rlim_cur = rl.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &rl);
+    }
+}
 
 void Server::buildPortMapping(std::set<int>& portsToBind) {
     portsToBind.clear();
-    portToConfigs.clear();
+    portToHosts.clear();
 
     if (serverConfigs.empty()) {
-        for (std::vector<std::string>::const_iterator it = currentConfig.listenPorts.begin();
-             it != currentConfig.listenPorts.end(); ++it) {
+        for (std::vector<std::string>::const_iterator it = currentConfig->listenPorts.begin();
+             it != currentConfig->listenPorts.end(); ++it) {
             int port = atoi(it->c_str());
             if (port > 0 && port <= 65535) {
                 portsToBind.insert(port);
-                portToConfigs[port].push_back(&currentConfig);
+                portToHosts[port].add(currentConfig);
             }
         }
     } else {
@@ -53,35 +160,54 @@ void Server::buildPortMapping(std::set<int>& portsToBind) {
                 int port = atoi(it->c_str());
                 if (port > 0 && port <= 65535) {
                     portsToBind.insert(port);
-                    portToConfigs[port].push_back(&serverConfigs[i]);
+                    portToHosts[port].add(&serverConfigs[i]);
                 }
             }
         }
     }
+    for (std::map<int, ServerNameTable>::iterator it = portToHosts.begin(); it != portToHosts.end(); ++it) {
+        it->second.compile();
+    }
 }
 
-bool Server::bindListeningSockets(const std::set<int>& portsToBind) {
+bool Server::bindListeningSockets(const std::set<int>& portsToBind, bool reusePort) {
     socketPortMap.clear();
     serverSockets.clear();
 
     for (std::set<int>::const_iterator it = portsToBind.begin(); it != portsToBind.end(); ++it) {
         int port = *it;
 
+        // Close-on-exec, or cgi_pool workers would keep the port open for their whole lifetime
+#ifdef __linux__
+        int serverSocket = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+#else
         int serverSocket = socket(AF_INET, SOCK_STREAM, 0);
+        if (serverSocket >= 0) {
+            fcntl(serverSocket, F_SETFD, FD_CLOEXEC);
+            fcntl(serverSocket, F_SETFL, fcntl(serverSocket, F_GETFL, 0) | O_NONBLOCK);
+        }
+#endif
         if (serverSocket < 0) {
             std::cerr << "Error creating socket for port " << port << ": " << strerror(errno) << std::endl;
             continue;
         }
 
-        int flags = fcntl(serverSocket, F_GETFL, 0);
-        if (flags != -1) fcntl(serverSocket, F_SETFL, flags | O_NONBLOCK);
-
         int optval = 1;
         if (setsockopt(serverSocket, SOL_SOCKET, SO_REUSEADDR, &optval, sizeof(optval)) < 0) {
             std::cerr << "Error setting socket options: " << strerror(errno) << std::endl;
             close(serverSocket);
             continue;
         }
+#ifdef SO_REUSEPORT
+        // Each worker process binds its own listener; the kernel spreads connections across them
+        if (reusePort && setsockopt(serverSocket, SOL_SOCKET, SO_REUSEPORT, &optval, sizeof(optval)) < 0) {
+            std::cerr << "Error setting SO_REUSEPORT: " << strerror(errno) << std::endl;
+            close(serverSocket);
+            continue;
+        }
+#else
+        (void)reusePort;
+#endif
 
         struct sockaddr_in serverAddr;
         memset(&serverAddr, 0, sizeof(serverAddr));
@@ -95,7 +221,7 @@ bool Server::bindListeningSockets(const std::set<int>& portsToBind) {
             continue;
         }
 
-        if (listen(serverSocket, 128) < 0) {
+        if (listen(serverSocket, SOMAXCONN) < 0) {
             std::cerr << "Error listening on socket: " << strerror(errno) << std::endl;
             close(serverSocket);
             continue;
@@ -113,381 +239,628 @@ bool Server::bindListeningSockets(const std::set<int>& portsToBind) {
     return true;
 }
 
-void Server::initMasterFdSets(fd_set& master_read, fd_set& master_write, int& fdmax) const {
-    FD_ZERO(&master_read);
-    FD_ZERO(&master_write);
-    fdmax = 0;
-
+bool Server::registerListeningSockets(Reactor& reactor) {
     for (std::vector<int>::const_iterator it = serverSockets.begin(); it != serverSockets.end(); ++it) {
-        FD_SET(*it, &master_read);
-        if (*it > fdmax) fdmax = *it;
+        if (!reactor.poller->add(*it, EVENT_READ)) return false;
     }
+    return true;
 }
 
-void Server::buildFdSets(const fd_set& master_read, const fd_set& master_write,
-                         fd_set& read_fds, fd_set& write_fds, int fdmax, int& loopFdMax) {
-    read_fds = master_read;
-    write_fds = master_write;
-    loopFdMax = fdmax;
+// Sizes the per-loop file caches; the inotify descriptor is polled like any other fd
+bool Server::configureFileCaches(Reactor& reactor) {
+    reactor.fileCache.setCapacity(globalConfig.staticFileCacheBytes);
+    reactor.openFiles.configure(globalConfig.openFileCacheEntries,
+                                static_cast<unsigned long>(globalConfig.openFileCacheValidSec) * 1000,
+                                globalConfig.openFileCacheInotify);
+    int watchFd = reactor.openFiles.eventFd();
+    return watchFd == -1 || reactor.poller->add(watchFd, EVENT_READ);
+}
 
-    for (std::map<int, CgiState>::iterator cit = cgiStates.begin(); cit != cgiStates.end(); ++cit) {
-        if (cit->second.pipe_out != -1 && !cit->second.readComplete) {
-            FD_SET(cit->second.pipe_out, &read_fds);
-            if (cit->second.pipe_out > loopFdMax) loopFdMax = cit->second.pipe_out;
-        }
-        if (cit->second.pipe_in != -1 && !cit->second.writeComplete) {
-            FD_SET(cit->second.pipe_in, &write_fds);
-            if (cit->second.pipe_in > loopFdMax) loopFdMax = cit->second.pipe_in;
+// Pre-spawns the workers of every cgi_pool location so the first requests find them warm
+void Server::startCgiPools(Reactor& reactor) {
+    std::vector<const LocationConfig*> locations;
+    for (size_t i = 0; i < serverConfigs.size(); ++i) {
+        const ConfigParser::ServerConfig& config = serverConfigs[i];
+        locations.push_back(&config.defaultLocationSettings);
+        std::map<std::string, LocationConfig>::const_iterator it;
+        for (it = config.locations.begin(); it != config.locations.end(); ++it) locations.push_back(&it->second);
+        for (it = config.exactLocations.begin(); it != config.exactLocations.end(); ++it) locations.push_back(&it->second);
+        for (size_t j = 0; j < config.regexLocations.size(); ++j) locations.push_back(&config.regexLocations[j]);
+    }
+    for (size_t i = 0; i < locations.size(); ++i) {
+        const LocationConfig& location = *locations[i];
+        if (location.getCgiPoolSize() == 0 || location.getCgiPass().empty()) continue;
+        if (!reactor.cgiPool.prepare(*reactor.poller, location.getCgiPass(), location.getCgiPoolSize(),
+                                     location.getCgiPoolMaxRequests())) {
+            std::cerr << "Warning: No cgi_pool worker could be started for " << location.getCgiPass() << std::endl;
         }
     }
 }
 
-void Server::handleClientTimeouts(std::map<int, ClientState>& clients,
-                                  fd_set& master_read, fd_set& master_write, time_t now) {
-    for (std::map<int, ClientState>::iterator it = clients.begin(); it != clients.end(); ) {
-        if (now - it->second.lastActivity > CLIENT_TIMEOUT_SEC) {
-            closeClientFd(it->first, master_read, master_write, clients, cgiStates);
-            it = clients.begin();
+// Re-syncs the poller interest and the connection deadline with the client's state
+void Server::refreshClient(Reactor& reactor, int fd, ClientState& state) {
+    bool writing = needsWrite(state);
+    // A body streaming into a CGI stays in the socket while the script is behind
+    bool readPaused = state.cgiBody && state.inBuffer.size() >= BODY_READ_BATCH;
+    int mask = readPaused ? 0 : EVENT_READ;
+    if (writing) mask |= EVENT_WRITE;
+    if (mask != state.pollMask && reactor.poller->modify(fd, mask)) {
+        state.pollMask = mask;
+    }
+
+    int key = timerKey(fd, TIMER_CLIENT);
+    if (writing || (state.readingBody && !readPaused)) {
+        reactor.timers.schedule(key, state.lastActivity + CLIENT_TIMEOUT_SEC * 1000);
+    } else if (reactor.cgiStates.find(fd) != reactor.cgiStates.end()) {
+        reactor.timers.cancel(key); // the CGI deadline governs until its response exists
+    } else if (!state.inBuffer.empty()) {
+        reactor.timers.schedule(key, state.requestStart + HEADER_TIMEOUT_SEC * 1000);
+    } else {
+        reactor.timers.schedule(key, state.lastActivity + KEEPALIVE_TIMEOUT_SEC * 1000);
+    }
+}
+
+void Server::armCgiTimer(Reactor& reactor, int clientFd, CgiState& cgi) {
+    reactor.timers.schedule(timerKey(clientFd, TIMER_CGI), cgi.lastIO + CGI_TIMEOUT_SEC * 1000);
+}
+
+void Server::watchCgiPipes(Reactor& reactor, int clientFd, CgiState& cgi) {
+    if (cgi.pipe_out != -1) {
+        reactor.poller->add(cgi.pipe_out, EVENT_READ);
+        reactor.cgiPipeOwners[cgi.pipe_out] = clientFd;
+    }
+    if (cgi.pipe_in != -1 && !cgi.writeComplete && cgi.bodyWritten < cgi.bodyToWrite.size()) {
+        reactor.poller->add(cgi.pipe_in, EVENT_WRITE);
+        reactor.cgiPipeOwners[cgi.pipe_in] = clientFd;
+    }
+}
+
+// Stops watching and closes one end of a CGI pipe
+void Server::unwatchCgiPipe(Reactor& reactor, int& pipeFd) {
+    if (pipeFd == -1) return;
+    std::map<int, int>::iterator it = reactor.cgiPipeOwners.find(pipeFd);
+    if (it != reactor.cgiPipeOwners.end()) {
+        reactor.poller->remove(pipeFd);
+        reactor.cgiPipeOwners.erase(it);
+    }
+    close(pipeFd);
+    pipeFd = -1;
+}
+
+// Backpressure for a streaming response: stops reading the CGI's stdout, the FastCGI
+// connection or the pool worker while the client is behind, so a large response waits
+// in the backend instead of in state.output
+void Server::throttleCgiOutput(Reactor& reactor, int clientFd, ClientState& state) {
+    std::map<int, CgiState>::iterator cit = reactor.cgiStates.find(clientFd);
+    if (cit == reactor.cgiStates.end()) return;
+    CgiState& cgi = cit->second;
+    if (cgi.backend == CGI_PROCESS && cgi.pipe_out == -1) return;
+
+    size_t queued = state.output.size();
+    if (!cgi.outputPaused && queued >= CGI_STREAM_HIGH_WATER) {
+        if (cgi.backend == CGI_FASTCGI) {
+            reactor.fastcgi.pause(*reactor.poller, clientFd, true);
+        } else if (cgi.backend == CGI_POOL) {
+            reactor.cgiPool.pause(*reactor.poller, clientFd, true);
         } else {
-            ++it;
+            reactor.poller->remove(cgi.pipe_out);
+            reactor.cgiPipeOwners.erase(cgi.pipe_out);
         }
+        reactor.timers.cancel(timerKey(clientFd, TIMER_CGI)); // the client's send deadline governs meanwhile
+        cgi.outputPaused = true;
+    } else if (cgi.outputPaused && queued <= CGI_STREAM_LOW_WATER) {
+        if (cgi.backend == CGI_FASTCGI) {
+            reactor.fastcgi.pause(*reactor.poller, clientFd, false);
+        } else if (cgi.backend == CGI_POOL) {
+            reactor.cgiPool.pause(*reactor.poller, clientFd, false);
+        } else {
+            if (!reactor.poller->add(cgi.pipe_out, EVENT_READ)) return;
+            reactor.cgiPipeOwners[cgi.pipe_out] = clientFd;
+        }
+        cgi.lastIO = monotonicMillis();
+        armCgiTimer(reactor, clientFd, cgi);
+        cgi.outputPaused = false;
     }
 }
 
-void Server::handleCgiTimeouts(std::map<int, ClientState>& clients,
-                               fd_set& master_write, int& fdmax, time_t now) {
-    for (std::map<int, CgiState>::iterator cit = cgiStates.begin(); cit != cgiStates.end(); ) {
-        if (now - cit->second.lastIO > CGI_TIMEOUT_SEC) {
-            HttpResponse response;
-            serveErrorPage(response, 504, *cit->second.config);
-            int clientFd = cit->first;
-            if (clients.find(clientFd) != clients.end()) {
-                clients[clientFd].outBuffer = response.generateResponse(cit->second.isHead);
-                clients[clientFd].outOffset = 0;
-                FD_SET(clientFd, &master_write);
-                if (clientFd > fdmax) fdmax = clientFd;
-            }
-            cleanupCgi(clientFd, cgiStates);
-            cit = cgiStates.begin();
-        } else {
-            ++cit;
+void Server::handleExpiredTimers(Reactor& reactor, unsigned long now) {
+    std::vector<int> expired;
+    reactor.timers.expire(now, expired);
+    for (size_t i = 0; i < expired.size(); ++i) {
+        int fd = expired[i] / TIMER_KINDS;
+        if (expired[i] % TIMER_KINDS == TIMER_CLIENT) {
+            if (reactor.clients.find(fd) != reactor.clients.end()) closeClientFd(reactor, fd);
+            continue;
+        }
+        std::map<int, CgiState>::iterator cit = reactor.cgiStates.find(fd);
+        if (cit == reactor.cgiStates.end()) continue;
+        if (cit->second.streaming) {
+            endCgiRequest(reactor, fd, true); // too late for a 504
+            continue;
+        }
+        HttpResponse response;
+        serveErrorPage(response, 504, *cit->second.config);
+        bool isHead = cit->second.isHead;
+        cleanupCgi(reactor, fd);
+        std::map<int, ClientState>::iterator client = reactor.clients.find(fd);
+        if (client != reactor.clients.end()) {
+            queueFinalResponse(client->second, response, isHead, false);
+            refreshClient(reactor, fd, client->second);
         }
     }
 }
 
-void Server::acceptConnections(fd_set& master_read, int& fdmax,
-                               std::map<int, ClientState>& clients, time_t now) {
-    for (std::vector<int>::const_iterator it = serverSockets.begin(); it != serverSockets.end(); ++it) {
-        if (FD_ISSET(*it, &master_read)) {
-            while (true) {
-                struct sockaddr_in clientAddr;
-                socklen_t clientLen = sizeof(clientAddr);
-                int clientSocket = accept(*it, (struct sockaddr*)&clientAddr, &clientLen);
-                if (clientSocket < 0) {
-                    // Non-blocking accept has no more queued connections; log once and exit the loop
+void Server::acceptConnections(Reactor& reactor, const std::vector<PollEvent>& events, unsigned long now) {
+    for (size_t i = 0; i < events.size(); ++i) {
+        std::map<int, int>::const_iterator listener = socketPortMap.find(events[i].fd);
+        if (listener == socketPortMap.end() || !(events[i].events & EVENT_READ)) continue;
+        while (true) {
+            struct sockaddr_in clientAddr;
+            socklen_t clientLen = sizeof(clientAddr);
+            // Close-on-exec at creation: with worker_threads a reactor thread may fork a CGI at any moment
+#ifdef __linux__
+            int clientSocket = accept4(listener->first, (struct sockaddr*)&clientAddr, &clientLen,
+                                       SOCK_NONBLOCK | SOCK_CLOEXEC);
+#else
+            int clientSocket = accept(listener->first, (struct sockaddr*)&clientAddr, &clientLen);
+            if (clientSocket >= 0) {
+                fcntl(clientSocket, F_SETFD, FD_CLOEXEC);
+                fcntl(clientSocket, F_SETFL, fcntl(clientSocket, F_GETFL, 0) | O_NONBLOCK);
+            }
+#endif
+            if (clientSocket < 0) {
+                // Non-blocking accept has no more queued connections
+                if (errno != EAGAIN && errno != EWOULDBLOCK) {
                     std::cerr << "Error accepting connection: " << strerror(errno) << std::endl;
-                    break;
                 }
-                int cflags = fcntl(clientSocket, F_GETFL, 0);
-                if (cflags != -1) fcntl(clientSocket, F_SETFL, cflags | O_NONBLOCK);
-                FD_SET(clientSocket, &master_read);
-                if (clientSocket > fdmax) fdmax = clientSocket;
-                ClientState cs;
-                cs.lastActivity = now;
-                cs.port = socketPortMap[*it];
-                clients[clientSocket] = cs;
+                break;
+            }
+            if (reactors.empty()) {
+                adoptClient(reactor, clientSocket, listener->second, now);
+            } else {
+                // worker_threads: this loop only accepts, the connection lives on a reactor thread
+                handOff(leastLoadedReactor(), Handoff(clientSocket, listener->second, now));
             }
         }
     }
 }
 
-void Server::processCgiIo(fd_set& read_fds, fd_set& write_fds,
-                          fd_set& master_write, int& fdmax,
-                          std::map<int, ClientState>& clients) {
-    for (std::map<int, CgiState>::iterator cit = cgiStates.begin(); cit != cgiStates.end(); ) {
+// Starts tracking a connected socket on this loop
+void Server::adoptClient(Reactor& reactor, int fd, int port, unsigned long lastActivity) {
+    if (!reactor.poller->add(fd, EVENT_READ)) {
+        close(fd);
+        return;
+    }
+    ClientState& cs = reactor.clients[fd];
+    cs = ClientState();
+    cs.lastActivity = lastActivity;
+    cs.port = port;
+    refreshClient(reactor, fd, cs);
+}
+
+void Server::scheduleClient(Reactor& reactor, int fd, ClientState& state) {
+    if (state.queued) return;
+    state.queued = true;
+    reactor.readyQueue.push_back(fd);
+}
+
+void Server::processCgiIo(Reactor& reactor, const std::vector<PollEvent>& events) {
+    for (size_t i = 0; i < events.size(); ++i) {
+        std::map<int, int>::const_iterator owner = reactor.cgiPipeOwners.find(events[i].fd);
+        if (owner == reactor.cgiPipeOwners.end()) continue;
+        int clientFd = owner->second;
+        std::map<int, CgiState>::iterator cit = reactor.cgiStates.find(clientFd);
+        if (cit == reactor.cgiStates.end()) continue;
         CgiState& cgi = cit->second;
-        int clientFd = cit->first;
-        if (cgi.pipe_in != -1 && FD_ISSET(cgi.pipe_in, &write_fds)) {
-            handleCgiWrite(clientFd, cgi);
-        }
-        if (cgi.pipe_out != -1 && FD_ISSET(cgi.pipe_out, &read_fds)) {
-            handleCgiRead(clientFd, cgi);
-        }
-        if (cgi.readComplete) {
-            int status;
-            pid_t result = waitpid(cgi.pid, &status, WNOHANG);
-            if (result != 0) {
-                std::string response;
-                finalizeCgiRequest(clientFd, cgi, status, response);
-                if (clients.find(clientFd) != clients.end()) {
-                    clients[clientFd].outBuffer = response;
-                    clients[clientFd].outOffset = 0;
-                    clients[clientFd].keepAlive = false;
-                    FD_SET(clientFd, &master_write);
-                    if (clientFd > fdmax) fdmax = clientFd;
+        if (events[i].fd == cgi.pipe_in) {
+            if (events[i].events & EVENT_ERROR) {
+                // Script closed its stdin early; stop feeding it
+                unwatchCgiPipe(reactor, cgi.pipe_in);
+                cgi.writeComplete = true;
+            } else {
+                std::map<int, ClientState>::iterator client = reactor.clients.find(clientFd);
+                if (client != reactor.clients.end() && client->second.cgiBody) {
+                    // Room in the pipe: more of the streamed body can be parsed
+                    if (!feedCgiBody(reactor, clientFd, client->second)) continue;
+                    refreshClient(reactor, clientFd, client->second);
+                } else {
+                    handleCgiWrite(reactor, clientFd, cgi);
                 }
-                std::map<int, CgiState>::iterator next = cit;
-                ++next;
-                cleanupCgi(clientFd, cgiStates);
-                cit = next;
-                continue;
             }
+        } else if (events[i].fd == cgi.pipe_out) {
+            handleCgiRead(reactor, clientFd, cgi);
+            if (cgi.readComplete) reactor.cgiExitPending.push_back(clientFd);
+            else if (!streamCgiOutput(reactor, clientFd, cgi)) continue;
+        }
+        armCgiTimer(reactor, clientFd, cgi);
+    }
+
+    // Reap only scripts whose stdout reached EOF; the child may exit a little later
+    std::vector<int> stillRunning;
+    for (size_t i = 0; i < reactor.cgiExitPending.size(); ++i) {
+        int clientFd = reactor.cgiExitPending[i];
+        std::map<int, CgiState>::iterator cit = reactor.cgiStates.find(clientFd);
+        if (cit == reactor.cgiStates.end() || !cit->second.readComplete) continue;
+        CgiState& cgi = cit->second;
+        int status;
+        pid_t result = waitpid(cgi.pid, &status, WNOHANG);
+        if (result == 0) {
+            stillRunning.push_back(clientFd);
+            continue;
         }
-        ++cit;
+        finalizeCgiRequest(reactor, clientFd, cgi, status);
     }
+    reactor.cgiExitPending.swap(stillRunning);
 }
 
-void Server::processClientReads(fd_set& read_fds, fd_set& master_read, fd_set& master_write,
-                                int& fdmax, std::map<int, ClientState>& clients,
-                                time_t now) {
-    for (std::map<int, ClientState>::iterator it = clients.begin(); it != clients.end(); ) {
-        int fd = it->first;
+void Server::processFastCgiIo(Reactor& reactor, const std::vector<PollEvent>& events) {
+    std::vector<FastCgiClient::Update> updates;
+    reactor.fastcgi.handleEvents(*reactor.poller, events, updates);
+    unsigned long now = monotonicMillis();
+    for (size_t i = 0; i < updates.size(); ++i) {
+        applyBackendUpdate(reactor, CGI_FASTCGI, updates[i].owner, updates[i].finished, updates[i].failed, now);
+    }
+}
+
+void Server::processCgiPoolIo(Reactor& reactor, const std::vector<PollEvent>& events) {
+    std::vector<CgiPool::Update> updates;
+    unsigned long now = monotonicMillis();
+    reactor.cgiPool.handleEvents(*reactor.poller, events, updates, now);
+    for (size_t i = 0; i < updates.size(); ++i) {
+        applyBackendUpdate(reactor, CGI_POOL, updates[i].owner, updates[i].finished, updates[i].failed, now);
+    }
+}
+
+// Output from a FastCGI backend or a pool worker: progress is streamed to the client
+// and pushes the CGI deadline back
+void Server::applyBackendUpdate(Reactor& reactor, CgiBackend backend, int clientFd, bool finished, bool failed,
+                                unsigned long now) {
+    std::map<int, CgiState>::iterator cit = reactor.cgiStates.find(clientFd);
+    if (cit == reactor.cgiStates.end() || cit->second.backend != backend) return;
+    CgiState& cgi = cit->second;
+    cgi.lastIO = now;
+    if (finished) {
+        endCgiRequest(reactor, clientFd, failed);
+    } else if (streamCgiOutput(reactor, clientFd, cgi)) {
+        armCgiTimer(reactor, clientFd, cgi);
+    }
+}
+
+// Queues the response of a finished CGI or FastCGI request and releases its state
+void Server::completeCgiRequest(Reactor& reactor, int clientFd, HttpResponse& response) {
+    const CgiState& cgi = reactor.cgiStates[clientFd];
+    bool keepAlive = cgi.request.wantsKeepAlive();
+    bool isHead = cgi.isHead;
+    std::map<int, ClientState>::iterator client = reactor.clients.find(clientFd);
+    if (client != reactor.clients.end() && client->second.cgiBody) {
+        keepAlive = false; // the script answered before reading the whole body
+        response.setHeader("Connection", "close");
+    }
+    cleanupCgi(reactor, clientFd);
+    if (client != reactor.clients.end()) {
+        ClientState& state = client->second;
+        queueFinalResponse(state, response, isHead, keepAlive);
+        refreshClient(reactor, clientFd, state);
+        // Pipelined requests were held back until this response existed
+        if (!state.inBuffer.empty()) scheduleClient(reactor, clientFd, state);
+    }
+}
+
+void Server::processClientReads(Reactor& reactor, const std::vector<PollEvent>& events, unsigned long now) {
+    for (size_t i = 0; i < events.size(); ++i) {
+        if (!(events[i].events & (EVENT_READ | EVENT_ERROR))) continue;
+        int fd = events[i].fd;
+        std::map<int, ClientState>::iterator it = reactor.clients.find(fd);
+        if (it == reactor.clients.end()) continue;
         ClientState& state = it->second;
         bool closed = false;
+        bool received = false;
 
-        if (FD_ISSET(fd, &read_fds)) {
-            char buffer[8192];
-            while (true) {
-                ssize_t bytesRead = recv(fd, buffer, sizeof(buffer), 0);
-                if (bytesRead > 0) {
-                    state.inBuffer.append(buffer, bytesRead);
-                    state.lastActivity = now;
-                    if (state.inBuffer.size() > MAX_REQUEST_BYTES) {
-                        HttpResponse resp;
-                        resp.setStatus(413);
-                        serveErrorPage(resp, 413, selectConfig(state.port, ""));
-                        state.keepAlive = false;
-                        state.outBuffer = resp.generateResponse(false);
-                        state.outOffset = 0;
-                        FD_SET(fd, &master_write);
-                        break;
-                    }
-                } else if (bytesRead == 0) {
-                    std::map<int, ClientState>::iterator next = it;
-                    ++next;
-                    closeClientFd(fd, master_read, master_write, clients, cgiStates);
-                    it = next;
-                    closed = true;
-                    break;
-                } else {
-                    // On non-blocking sockets, a negative read here simply defers to the next select cycle
+        while (true) {
+            // recv() lands directly in the tail block of the input chain
+            bool wasEmpty = state.inBuffer.empty();
+            size_t space;
+            char* dest = state.inBuffer.reserve(space);
+            ssize_t bytesRead = recv(fd, dest, space, 0);
+            state.inBuffer.commit(bytesRead > 0 ? bytesRead : 0);
+            if (bytesRead > 0) {
+                if (wasEmpty) state.requestStart = now;
+                state.lastActivity = now;
+                received = true;
+                if (state.inBuffer.size() > MAX_REQUEST_BYTES && !state.closing) {
+                    HttpResponse resp;
+                    resp.setStatus(413);
+                    serveErrorPage(resp, 413, selectConfig(state.port, StringRef()));
+                    queueFinalResponse(state, resp, false, false);
+                    refreshClient(reactor, fd, state);
                     break;
                 }
+                if (state.readingBody && state.inBuffer.size() >= BODY_READ_BATCH) break;
+            } else if (bytesRead == 0 || (events[i].events & EVENT_ERROR)) {
+                closeClientFd(reactor, fd);
+                closed = true;
+                break;
+            } else {
+                // On non-blocking sockets, a negative read here simply defers to the next readiness event
+                break;
             }
         }
 
         if (closed) continue;
+        if (received) scheduleClient(reactor, fd, state);
+        refreshClient(reactor, fd, state);
+    }
+}
+
+void Server::processReadyClients(Reactor& reactor) {
+    // Only connections with fresh input or resumable work are parsed; idle ones cost nothing
+    while (!reactor.readyQueue.empty()) {
+        int fd = reactor.readyQueue.front();
+        reactor.readyQueue.pop_front();
+        std::map<int, ClientState>::iterator it = reactor.clients.find(fd);
+        if (it == reactor.clients.end() || !it->second.queued) continue;
+        it->second.queued = false;
+        processBufferedRequests(reactor, fd, it->second);
+        refreshClient(reactor, fd, it->second);
+    }
+}
+
+void Server::queueFinalResponse(ClientState& state, HttpResponse& response, bool isHead, bool keepAlive) {
+    response.serialize(state.output, isHead);
+    state.keepAlive = keepAlive;
+    if (!keepAlive) state.closing = true;
+}
+
+// POST bodies for a forked CGI are fed to it as they arrive instead of being buffered first
+bool Server::startsBodyStreamingCgi(const ConfigParser::ServerConfig& config, const HttpRequest& request) const {
+    if (request.getMethodId() != METHOD_POST) return false;
+    const std::string path = request.getPath().str();
+    const LocationConfig& locConfig = findLocationConfig(config, path);
+    return locConfig.isCgiPath(path) && locConfig.getFastCgiPass().empty() &&
+           (locConfig.getCgiPoolSize() == 0 || locConfig.getCgiPass().empty());
+}
 
-        bool parsed = true;
-        while (parsed) {
-            parsed = false;
-            size_t headerEnd = state.inBuffer.find("\r\n\r\n");
-            size_t sepLen = 4;
-            if (headerEnd == std::string::npos) {
-                headerEnd = state.inBuffer.find("\n\n");
-                sepLen = 2;
+// Parses the streamed body of the connection's CGI request into the script's stdin,
+// decoding no more than keeps CGI_STDIN_BUFFER_BYTES waiting for the pipe; the rest
+// stays in inBuffer, whose reads pause at BODY_READ_BATCH. Returns false when the
+// request ended (the CGI is gone).
+bool Server::feedCgiBody(Reactor& reactor, int fd, ClientState& state) {
+    std::map<int, CgiState>::iterator cit = reactor.cgiStates.find(fd);
+    if (cit == reactor.cgiStates.end()) return false;
+    CgiState& cgi = cit->second;
+    HttpRequestParser& parser = state.parser;
+    while (true) {
+        bool starved = false; // the parser used up what the connection delivered so far
+        while (state.cgiBody && cgi.bodyToWrite.size() - cgi.bodyWritten < CGI_STDIN_BUFFER_BYTES) {
+            size_t room = CGI_STDIN_BUFFER_BYTES - (cgi.bodyToWrite.size() - cgi.bodyWritten);
+            parser.limitStreamedBody(room);
+            HttpRequestParser::Result result = parser.parse(state.inBuffer, MAX_HEADER_BYTES);
+            std::string& decoded = parser.streamedBody();
+            bool filled = decoded.size() >= room;
+            if (cgi.writeComplete) {
+                decoded.clear(); // the script closed its stdin
+            } else if (cgi.bodyToWrite.empty()) {
+                cgi.bodyToWrite.swap(decoded);
+            } else {
+                cgi.bodyToWrite.append(decoded);
+                decoded.clear();
             }
-            if (headerEnd == std::string::npos) {
-                if (state.inBuffer.size() > MAX_HEADER_BYTES) {
-                    HttpResponse resp;
-                    resp.setStatus(431);
-                    serveErrorPage(resp, 431, selectConfig(state.port, ""));
-                    state.keepAlive = false;
-                    state.outBuffer = resp.generateResponse(false);
-                    state.outOffset = 0;
-                    FD_SET(fd, &master_write);
-                }
+            if (result == HttpRequestParser::PARSE_INCOMPLETE) {
+                if (filled) continue; // stopped at the stdin buffer limit, not for lack of input
+                starved = true;
                 break;
             }
 
-            size_t bodyStart = headerEnd + sepLen;
-            std::string headerBlock = state.inBuffer.substr(0, headerEnd);
-            std::map<std::string, std::string> headers = HttpRequest::parseHeaders(headerBlock);
-            std::string hostHeader = headers["host"];
-            bool hasContentLength = headers.find("content-length") != headers.end();
-            size_t contentLength = 0;
-            if (hasContentLength) {
-                std::istringstream iss(headers["content-length"]);
-                iss >> contentLength;
+            state.cgiBody = false;
+            state.readingBody = false;
+            if (result != HttpRequestParser::PARSE_COMPLETE) {
+                int status = result == HttpRequestParser::PARSE_BODY_TOO_LARGE ? 413 : 400;
+                std::cerr << "Streamed request body of client " << fd << " rejected with " << status << std::endl;
+                if (cgi.streaming) {
+                    endCgiRequest(reactor, fd, true);
+                } else {
+                    HttpResponse resp;
+                    resp.setStatus(status);
+                    serveErrorPage(resp, status, *cgi.config);
+                    cleanupCgi(reactor, fd);
+                    queueFinalResponse(state, resp, false, false);
+                }
+                return false;
             }
-            bool isChunked = headers.find("transfer-encoding") != headers.end() &&
-                             headers["transfer-encoding"].find("chunked") != std::string::npos;
-            state.expectContinue = headers.find("expect") != headers.end() &&
-                                   headers["expect"].find("100-continue") != std::string::npos;
-
-            const ConfigParser::ServerConfig& cfg = selectConfig(state.port, hostHeader);
+            cgi.bodyPending = false;
+            // The body is consumed, so the next pipelined request can be parsed once this one is answered
+            parser.release(state.inBuffer);
+            state.requestStart = state.lastActivity;
+            state.sentContinue = false;
+        }
+        handleCgiWrite(reactor, fd, cgi);
+        // Go on while the pipe takes everything and buffered body is left to parse
+        if (starved || !state.cgiBody || cgi.writeComplete || !cgi.bodyToWrite.empty()) break;
+    }
+    return true;
+}
 
-            if (state.expectContinue && !state.sentContinue) {
+void Server::processBufferedRequests(Reactor& reactor, int fd, ClientState& state) {
+    if (state.cgiBody) feedCgiBody(reactor, fd, state);
+    // Responses must leave in request order, so a pipelined request waits while an
+    // earlier one is still producing (CGI) or streaming (file) its response.
+    while (!state.closing && !state.fileStream.active && reactor.cgiStates.find(fd) == reactor.cgiStates.end()) {
+        HttpRequestParser& parser = state.parser;
+        HttpRequestParser::Result result = parser.parse(state.inBuffer, MAX_HEADER_BYTES);
+        if (result == HttpRequestParser::PARSE_HEAD_COMPLETE) {
+            // The virtual host decides where a large body is spooled
+            const ConfigParser::ServerConfig& bodyCfg = selectConfig(state.port, parser.request().getHeader(HEADER_HOST));
+            if (parser.beginBody(MAX_REQUEST_BYTES, bodyCfg.clientBodyBufferSize, bodyCfg.clientBodyTempPath)) {
+                if (startsBodyStreamingCgi(bodyCfg, parser.request())) parser.streamBody();
+                result = parser.parse(state.inBuffer, MAX_HEADER_BYTES);
+            } else {
+                result = HttpRequestParser::PARSE_BODY_TOO_LARGE;
+            }
+        }
+        state.readingBody = result == HttpRequestParser::PARSE_INCOMPLETE && parser.headersComplete();
+
+        if (result != HttpRequestParser::PARSE_INCOMPLETE && result != HttpRequestParser::PARSE_COMPLETE) {
+            int status = 400;
+            if (result == HttpRequestParser::PARSE_HEADER_TOO_LARGE) status = 431;
+            else if (result == HttpRequestParser::PARSE_BODY_TOO_LARGE) status = 413;
+            else if (result == HttpRequestParser::PARSE_STORAGE_ERROR) status = 500;
+            HttpResponse resp;
+            resp.setStatus(status);
+            serveErrorPage(resp, status, selectConfig(state.port, parser.request().getHeader(HEADER_HOST)));
+            queueFinalResponse(state, resp, false, false);
+            break;
+        }
+        // A streamed body (not one borrowed whole from the buffer) starts its CGI right away
+        bool cgiStarted = false;
+        if (parser.streamingBody() && parser.request().getBody().empty()) {
+            HttpRequest& req = parser.request();
+            const ConfigParser::ServerConfig& cfg = selectConfig(state.port, req.getHeader(HEADER_HOST));
+            const LocationConfig& locConfig = findLocationConfig(cfg, req.getPath().str());
+            std::string cgiEffectiveRoot = !locConfig.getRoot().empty() ? locConfig.getRoot() : cfg.root;
+            if (!startCgiRequest(reactor, fd, req, cfg, locConfig, cgiEffectiveRoot, false, true)) {
+                HttpResponse resp;
+                resp.setStatus(500);
+                serveErrorPage(resp, 500, cfg);
+                queueFinalResponse(state, resp, false, false); // the unread body rules out another request
+                break;
+            }
+            state.cgiBody = true;
+            cgiStarted = true;
+            if (!feedCgiBody(reactor, fd, state)) break;
+        }
+        if (result == HttpRequestParser::PARSE_INCOMPLETE || cgiStarted) {
+            if (state.readingBody && parser.expectsContinue() && !state.sentContinue) {
                 HttpResponse continueResp;
                 continueResp.setStatus(100);
-                state.outBuffer += continueResp.generateResponse(false);
-                state.outOffset = 0;
+                continueResp.serialize(state.output);
                 state.sentContinue = true;
-                FD_SET(fd, &master_write);
-            }
-
-            std::string normalizedRequest;
-            size_t consumed = 0;
-            if (isChunked) {
-                size_t consumedEnd = 0;
-                if (!HttpRequest::decodeChunkedBody(state.inBuffer, bodyStart, consumedEnd, state.chunkDecoded)) {
-                    break;
-                }
-                normalizedRequest = HttpRequest::normalizeChunkedRequest(state.inBuffer, headerEnd, state.chunkDecoded);
-                consumed = consumedEnd;
-            } else if (hasContentLength) {
-                size_t have = state.inBuffer.size() > bodyStart ? state.inBuffer.size() - bodyStart : 0;
-                if (have < contentLength) break;
-                consumed = bodyStart + contentLength;
-                normalizedRequest = state.inBuffer.substr(0, consumed);
-            } else {
-                consumed = bodyStart;
-                normalizedRequest = state.inBuffer.substr(0, consumed);
             }
+            break;
+        }
 
-            try {
-                HttpRequest req;
-                req.parseRequest(normalizedRequest);
-                HttpResponse resp;
-                bool responseReady = false;
-                dispatchRequest(fd, req, resp, cfg, responseReady, state);
-                if (responseReady) {
-                    state.keepAlive = req.wantsKeepAlive();
-                    resp.setHeader("Connection", state.keepAlive ? "keep-alive" : "close");
-                    state.outBuffer += resp.generateResponse(req.getMethod() == "HEAD");
-                    state.outOffset = 0;
-                    FD_SET(fd, &master_write);
-                    if (fd > fdmax) fdmax = fd;
-                }
-            } catch (const std::exception& e) {
-                HttpResponse err;
-                err.setStatus(400);
-                serveErrorPage(err, 400, cfg);
-                state.keepAlive = false;
-                state.outBuffer += err.generateResponse(false);
-                state.outOffset = 0;
-                FD_SET(fd, &master_write);
+        HttpRequest& req = parser.request();
+        const ConfigParser::ServerConfig& cfg = selectConfig(state.port, req.getHeader(HEADER_HOST));
+        try {
+            HttpResponse resp;
+            bool responseReady = false;
+            dispatchRequest(reactor, fd, req, resp, cfg, responseReady, state);
+            if (responseReady) {
+                bool keepAlive = req.wantsKeepAlive();
+                resp.setHeader("Connection", keepAlive ? "keep-alive" : "close");
+                queueFinalResponse(state, resp, req.getMethodId() == METHOD_HEAD, keepAlive);
             }
-
-            if (consumed >= state.inBuffer.size()) state.inBuffer.clear();
-            else state.inBuffer.erase(0, consumed);
-            state.expectContinue = false;
-            state.sentContinue = false;
-            state.chunkDecoded.clear();
-            parsed = true;
+        } catch (const std::exception& e) {
+            HttpResponse err;
+            err.setStatus(400);
+            serveErrorPage(err, 400, cfg);
+            queueFinalResponse(state, err, false, false);
         }
 
-        ++it;
+        // The response is queued, so the request's bytes can leave inBuffer
+        parser.release(state.inBuffer);
+        state.requestStart = state.lastActivity;
+        state.sentContinue = false;
     }
 }
 
-void Server::processClientWrites(fd_set& write_fds, fd_set& master_read, fd_set& master_write,
-                                 std::map<int, ClientState>& clients, time_t now) {
-    for (std::map<int, ClientState>::iterator it = clients.begin(); it != clients.end(); ) {
-        int fd = it->first;
+void Server::processClientWrites(Reactor& reactor, const std::vector<PollEvent>& events, unsigned long now) {
+    for (size_t i = 0; i < events.size(); ++i) {
+        if (!(events[i].events & (EVENT_WRITE | EVENT_ERROR))) continue;
+        int fd = events[i].fd;
+        std::map<int, ClientState>::iterator it = reactor.clients.find(fd);
+        // Skip clients closed earlier in this iteration or not waiting to write
+        if (it == reactor.clients.end() || !(it->second.pollMask & EVENT_WRITE)) continue;
         ClientState& st = it->second;
-        bool closed = false;
 
-        if (FD_ISSET(fd, &write_fds)) {
-            while (st.outOffset < st.outBuffer.size()) {
-                ssize_t sent = send(fd, st.outBuffer.c_str() + st.outOffset, st.outBuffer.size() - st.outOffset, 0);
-                if (sent > 0) {
-                    st.outOffset += sent;
-                    st.lastActivity = now;
-                } else {
-                    break;
-                }
-            }
-            if (closed) continue;
+        // Headers and bodies go out together; MSG_MORE holds the last packet for the file that follows
+        if (!st.output.empty() && st.output.flush(fd, st.fileStream.active) > 0) st.lastActivity = now;
 
-            if (st.outOffset >= st.outBuffer.size()) {
-                st.outBuffer.clear();
-                st.outOffset = 0;
+        if (st.fileStream.active && st.output.empty()) {
+            bool progressed = false;
+            if (!pumpFileStream(fd, st.fileStream, progressed)) {
+                closeClientFd(reactor, fd);
+                continue;
             }
-
-            if (st.fileStream.active && st.outBuffer.empty()) {
-                if (st.fileStream.pendingChunk.empty() && st.fileStream.offset < st.fileStream.size) {
-                    char fbuf[FILE_CHUNK_BYTES];
-                    ssize_t r = read(st.fileStream.fd, fbuf, FILE_CHUNK_BYTES);
-                    if (r > 0) {
-                        st.fileStream.pendingChunk.assign(fbuf, r);
-                        st.fileStream.offset += r;
-                    } else if (r == 0) {
-                        clearFileStream(st.fileStream);
-                    } else {
-                        std::map<int, ClientState>::iterator next = it;
-                        ++next;
-                        closeClientFd(fd, master_read, master_write, clients, cgiStates);
-                        it = next;
-                        closed = true;
-                    }
-                }
-                if (closed) continue;
-
-                while (!st.fileStream.pendingChunk.empty()) {
-                    ssize_t sent = send(fd, st.fileStream.pendingChunk.c_str(), st.fileStream.pendingChunk.size(), 0);
-                    if (sent > 0) {
-                        st.fileStream.pendingChunk.erase(0, sent);
-                        st.lastActivity = now;
-                    } else {
-                        break;
-                    }
-                }
-                if (st.fileStream.pendingChunk.empty() && st.fileStream.offset >= st.fileStream.size) {
-                    clearFileStream(st.fileStream);
-                }
+            if (progressed) st.lastActivity = now;
+            if (st.fileStream.pending.empty() && st.fileStream.offset >= st.fileStream.size) {
+                clearFileStream(st.fileStream);
             }
+        }
+        if (!reactor.cgiStates.empty()) throttleCgiOutput(reactor, fd, st);
 
-            if (!needsWrite(st)) {
-                FD_CLR(fd, &master_write);
-                if (!st.keepAlive) {
-                    std::map<int, ClientState>::iterator next = it;
-                    ++next;
-                    closeClientFd(fd, master_read, master_write, clients, cgiStates);
-                    it = next;
-                    closed = true;
-                }
+        if (!needsWrite(st)) {
+            // An interim 100 Continue drains without a final response, so only a
+            // connection marked closing is torn down here
+            if (st.closing) {
+                closeClientFd(reactor, fd);
+                continue;
             }
+            if (!st.inBuffer.empty()) scheduleClient(reactor, fd, st);
         }
-
-        if (closed) continue;
-
-        ++it;
+        refreshClient(reactor, fd, st);
     }
 }
 
-static void cleanupCgi(int fd, std::map<int, CgiState>& cgiStates) {
-    std::map<int, CgiState>::iterator cgit = cgiStates.find(fd);
-    if (cgit != cgiStates.end()) {
-        if (cgit->second.pipe_in != -1) close(cgit->second.pipe_in);
-        if (cgit->second.pipe_out != -1) close(cgit->second.pipe_out);
-        kill(cgit->second.pid, SIGKILL);
-        waitpid(cgit->second.pid, NULL, WNOHANG);
-        cgiStates.erase(cgit);
+void Server::cleanupCgi(Reactor& reactor, int clientFd) {
+    std::map<int, CgiState>::iterator cgit = reactor.cgiStates.find(clientFd);
+    if (cgit != reactor.cgiStates.end()) {
+        reactor.timers.cancel(timerKey(clientFd, TIMER_CGI));
+        unwatchCgiPipe(reactor, cgit->second.pipe_in);
+        unwatchCgiPipe(reactor, cgit->second.pipe_out);
+        if (cgit->second.backend == CGI_FASTCGI) {
+            reactor.fastcgi.cancel(*reactor.poller, clientFd);
+        } else if (cgit->second.backend == CGI_POOL) {
+            reactor.cgiPool.cancel(*reactor.poller, clientFd); // kills a worker still running it
+        } else {
+            kill(cgit->second.pid, SIGKILL);
+            waitpid(cgit->second.pid, NULL, WNOHANG);
+        }
+        reactor.cgiStates.erase(cgit);
+    }
+    std::map<int, ClientState>::iterator client = reactor.clients.find(clientFd);
+    if (client != reactor.clients.end() && client->second.cgiBody) {
+        // The rest of the streamed body has nowhere to go, so the connection ends
+        ClientState& state = client->second;
+        state.cgiBody = false;
+        state.readingBody = false;
+        state.keepAlive = false;
+        state.closing = true;
     }
 }
 
-static void closeClientFd(int fd, fd_set& mr, fd_set& mw, std::map<int, ClientState>& clients, std::map<int, CgiState>& cgiStates) {
-    cleanupCgi(fd, cgiStates);
-    std::map<int, ClientState>::iterator it = clients.find(fd);
-    if (it != clients.end()) {
+void Server::closeClientFd(Reactor& reactor, int fd) {
+    cleanupCgi(reactor, fd);
+    reactor.timers.cancel(timerKey(fd, TIMER_CLIENT));
+    std::map<int, ClientState>::iterator it = reactor.clients.find(fd);
+    if (it != reactor.clients.end()) {
         clearFileStream(it->second.fileStream);
-        clients.erase(it);
+        reactor.clients.erase(it);
     }
+    reactor.poller->remove(fd);
     close(fd);
-    FD_CLR(fd, &mr);
-    FD_CLR(fd, &mw);
+}
+
+// Forgets an idle connection without closing it, so another loop can adopt it
+void Server::detachClient(Reactor& reactor, int fd) {
+    reactor.timers.cancel(timerKey(fd, TIMER_CLIENT));
+    reactor.clients.erase(fd);
+    reactor.poller->remove(fd);
 }
 
 // ---- end helpers ---------------------------------------------------------
 
-Server::Server(const std::string& configFile) {
+Server::Server(const std::string& configFile) : currentConfig(NULL) {
     configPath = configFile;
     parseConfig(configFile);
     if (serverConfigs.empty()) {
         throw std::runtime_error("No server configurations loaded.");
     }
-    currentConfig = serverConfigs[0];
+    currentConfig = &serverConfigs[0];
+}
+
+Server::~Server() {
+    for (size_t i = 0; i < reactors.size(); ++i) delete reactors[i];
+    for (size_t i = 0; i < rootFds.size(); ++i) close(rootFds[i]);
 }
 
 
@@ -496,52 +869,149 @@ void Server::parseConfig(const std::string& configFile) {
         ConfigParser parser(configFile);
         parser.parse();
         serverConfigs = parser.getServers();
+        globalConfig = parser.getGlobal();
         if (serverConfigs.empty()) {
             std::cerr << "Warning: Configuration file parsed, but no server blocks were found or successfully parsed." << std::endl;
         }
+        openRootDirectories();
+        for (size_t i = 0; i < serverConfigs.size(); ++i) compileLocations(serverConfigs[i]);
     } catch (const std::exception& e) {
         std::cerr << "Failed to parse config file: " << e.what() << std::endl;
     }
 }
 
-std::pair<std::string, const LocationConfig*> Server::matchLocation(const ConfigParser::ServerConfig& serverConfig, const std::string& path) const {
-    std::string bestMatchPath;
-    const LocationConfig* bestMatchConfig = &serverConfig.defaultLocationSettings;
+const LocationConfig& Server::findLocationConfig(const ConfigParser::ServerConfig& serverConfig, const std::string& path) const {
+    return serverConfig.locationRouter.match(path);
+}
 
-    for (std::map<std::string, LocationConfig>::const_iterator it = serverConfig.locations.begin(); it != serverConfig.locations.end(); ++it) {
-        const std::string& locationPath = it->first;
-        bool matches = false;
+// Builds a server's location router; must run again on any copy of a ServerConfig
+void Server::compileLocations(ConfigParser::ServerConfig& config) {
+    config.locationRouter.build(config.locations, config.exactLocations, config.regexLocations,
+                                config.defaultLocationSettings);
+}
 
-        if (path.find(locationPath) == 0) {
-            matches = true;
-        } else if (!locationPath.empty() && locationPath[locationPath.size() - 1] == '/') {
-            std::string pathWithSlash = path;
-            if (pathWithSlash.empty() || pathWithSlash[pathWithSlash.size() - 1] != '/') {
-                pathWithSlash += '/';
-            }
-            if (pathWithSlash.find(locationPath) == 0) {
-                matches = true;
-            }
-            std::string locationWithoutSlash = locationPath.substr(0, locationPath.size() - 1);
-            if (path == locationWithoutSlash) {
-                matches = true;
-            }
+
+// Canonicalizes every server and location root once, so requests resolve beneath
+// an open directory instead of calling realpath() on the roots each time
+void Server::openRootDirectories() {
+    for (size_t i = 0; i < serverConfigs.size(); ++i) {
+        ConfigParser::ServerConfig& config = serverConfigs[i];
+        config.rootDirectory = openRootDirectory(config.root, rootFds);
+        LocationConfig& fallback = config.defaultLocationSettings;
+        if (!fallback.getRoot().empty()) fallback.setRootDirectory(openRootDirectory(fallback.getRoot(), rootFds));
+        for (std::map<std::string, LocationConfig>::iterator it = config.locations.begin(); it != config.locations.end(); ++it) {
+            if (!it->second.getRoot().empty()) it->second.setRootDirectory(openRootDirectory(it->second.getRoot(), rootFds));
         }
-        if (matches && locationPath.length() > bestMatchPath.length()) {
-            bestMatchPath = locationPath;
-            bestMatchConfig = &it->second;
+        for (std::map<std::string, LocationConfig>::iterator it = config.exactLocations.begin(); it != config.exactLocations.end(); ++it) {
+            if (!it->second.getRoot().empty()) it->second.setRootDirectory(openRootDirectory(it->second.getRoot(), rootFds));
+        }
+        for (size_t j = 0; j < config.regexLocations.size(); ++j) {
+            LocationConfig& location = config.regexLocations[j];
+            if (!location.getRoot().empty()) location.setRootDirectory(openRootDirectory(location.getRoot(), rootFds));
         }
     }
+}
 
-    return std::make_pair(bestMatchPath, bestMatchConfig);
+// Picks the root a request path is served from and the path below it: a prefix
+// location with its own root serves what follows its prefix, anything else is
+// looked up under its root with the full path.
+const RootDirectory& Server::mapRequestPath(const ConfigParser::ServerConfig& config, const LocationConfig& location,
+                                            const std::string& uri, std::string& sub) const {
+    const std::string prefix = location.getPath();
+    const RootDirectory& root = location.getRoot().empty() ? config.rootDirectory : location.getRootDirectory();
+    if (location.getRoot().empty() || prefix.empty() || location.isRegex()) {
+        sub = uri;
+    } else if (uri.length() < prefix.length()) {
+        sub.clear();
+    } else {
+        sub = uri.substr(prefix.length());
+        // A file-like location ("/favicon.ico") names the file itself
+        if (sub.empty() && uri == prefix && prefix[prefix.size() - 1] != '/') sub = uri;
+    }
+    size_t start = sub.find_first_not_of('/');
+    sub.erase(0, start == std::string::npos ? sub.size() : start);
+    return root;
 }
 
-const LocationConfig& Server::findLocationConfig(const ConfigParser::ServerConfig& serverConfig, const std::string& path) const {
-    return *(matchLocation(serverConfig, path).second);
+// Looks sub up without leaving root: one openat2(RESOLVE_BENEATH) from the root's
+// descriptor where the kernel has it, else (or when that refuses) realpath()
+// checked against the canonical root. Fills path (empty when sub escapes the root or contains ".."), error (errno,
+// 0 when the file exists) and st; with openFile a regular file is opened for reading.
+void Server::lookupBeneath(const RootDirectory& root, const std::string& sub, OpenFileCache::Entry& file,
+                           bool openFile) {
+    file.error = 0;
+    file.fd = -1;
+    if (sub.find("..") != std::string::npos) {
+        file.path.clear();
+        return;
+    }
+    file.path = root.path;
+    if (!sub.empty()) {
+        if (file.path.empty() || file.path[file.path.size() - 1] != '/') file.path += '/';
+        file.path += sub;
+    }
+
+#if defined(__linux__) && defined(SYS_openat2)
+    if (root.fd != -1) {
+        struct open_how how;
+        memset(&how, 0, sizeof(how));
+        how.flags = openFile ? O_RDONLY | O_NONBLOCK | O_CLOEXEC : O_PATH | O_CLOEXEC;
+        how.resolve = RESOLVE_BENEATH;
+        const char* relative = sub.empty() ? "." : sub.c_str();
+        int fd = static_cast<int>(syscall(SYS_openat2, root.fd, relative, &how, sizeof(how)));
+        if (fd == -1 && errno == EACCES && openFile) {
+            // Unreadable but present: still report what it is
+            how.flags = O_PATH | O_CLOEXEC;
+            fd = static_cast<int>(syscall(SYS_openat2, root.fd, relative, &how, sizeof(how)));
+            openFile = false;
+        }
+        if (fd != -1) {
+            if (fstat(fd, &file.st) != 0) file.error = errno;
+            if (openFile && file.error == 0 && S_ISREG(file.st.st_mode)) {
+                file.fd = fd;
+            } else {
+                close(fd);
+            }
+            return;
+        }
+        // EXDEV also covers absolute symlinks that still point inside the root, so
+        // let the realpath() check below decide; ENOSYS/EPERM mean no openat2()
+        if (errno != EXDEV && errno != ENOSYS && errno != EPERM) {
+            file.error = errno;
+            return;
+        }
+    }
+#endif
+
+    char resolved[PATH_MAX];
+    if (realpath(file.path.c_str(), resolved) != NULL) {
+        if (!isBeneath(resolved, root.path)) {
+            std::cerr << "Security Error: Resolved path '" << resolved << "' escaped canonical base path '"
+                      << root.path << "'." << std::endl;
+            file.path.clear();
+            return;
+        }
+        file.path = resolved;
+    }
+    if (stat(file.path.c_str(), &file.st) != 0) {
+        file.error = errno;
+        return;
+    }
+    if (openFile && S_ISREG(file.st.st_mode)) file.fd = open(file.path.c_str(), O_RDONLY | O_CLOEXEC);
 }
 
+// Filesystem path of a request path beneath its root; empty when it would escape
+std::string Server::resolveRequestPath(const ConfigParser::ServerConfig& config, const LocationConfig& location,
+                                       const std::string& uri) const {
+    std::string sub;
+    const RootDirectory& root = mapRequestPath(config, location, uri, sub);
+    OpenFileCache::Entry file;
+    lookupBeneath(root, sub, file, false);
+    return file.path;
+}
 
-std::string Server::resolvePath(const ConfigParser::ServerConfig& config, const std::string& basePath, const std::string& relativePath) const {
+// Joins relativePath below a runtime directory (upload stores and the like)
+std::string Server::resolvePath(const std::string& basePath, const std::string& relativePath) const {
     if (relativePath.find("..") != std::string::npos) {
         return "";
     }
@@ -552,41 +1022,8 @@ std::string Server::resolvePath(const ConfigParser::ServerConfig& config, const
         realBasePath[sizeof(realBasePath)-1] = '\0';
     }
     std::string canonicalBasePath(realBasePath);
-    std::string joinPath = relativePath;
-    if (!relativePath.empty() && relativePath[0] == '/') {
-        std::pair<std::string, const LocationConfig*> match = matchLocation(config, relativePath);
-        const std::string& bestMatchPath = match.first;
-        const LocationConfig* bestMatchConfig = match.second;
-        
-        if (!bestMatchPath.empty()) {
-            if (!bestMatchConfig->getRoot().empty()) {
-                canonicalBasePath = bestMatchConfig->getRoot();
-                char realRoot[PATH_MAX];
-                if (realpath(canonicalBasePath.c_str(), realRoot) != NULL) {
-                   canonicalBasePath = std::string(realRoot);
-                }
-                
-                std::string sub;
-                if (relativePath.length() < bestMatchPath.length()) {
-                    sub = "";
-                } else {
-                    sub = relativePath.substr(bestMatchPath.length());
-                }
-                while (!sub.empty() && sub[0] == '/') sub = sub.substr(1);
-                joinPath = sub;
-            }
-        }
-
-        // If the matched location path is an exact file (no trailing slash) and there is
-        // no remaining subpath, use the request path (without the leading slash) so we
-        // resolve to the file instead of the directory root.
-        if (joinPath.empty() &&
-            !bestMatchPath.empty() &&
-            bestMatchPath == relativePath &&
-            bestMatchPath[bestMatchPath.size() - 1] != '/') {
-            joinPath = relativePath.substr(1);
-        }
-    }
+    size_t start = relativePath.find_first_not_of('/');
+    std::string joinPath = start == std::string::npos ? "" : relativePath.substr(start);
 
     std::string fullPath = canonicalBasePath;
     if (!fullPath.empty() && fullPath[fullPath.length() - 1] != '/') {
@@ -598,24 +1035,20 @@ std::string Server::resolvePath(const ConfigParser::ServerConfig& config, const
     char resolved_path[PATH_MAX];
     if (realpath(fullPath.c_str(), resolved_path) != NULL) {
         std::string finalPath(resolved_path);
-        if (finalPath.rfind(canonicalBasePath, 0) == 0) {
+        if (isBeneath(finalPath, canonicalBasePath)) {
             return finalPath;
         }
         std::cerr << "Security Error: Resolved path '" << finalPath << "' escaped canonical base path '" << canonicalBasePath << "'." << std::endl;
         return "";
-    } else {
-        if (fullPath.rfind(canonicalBasePath, 0) == 0) {
-            return fullPath;
-        }
-        return "";
     }
+    return fullPath;
 }
 
 void Server::serveErrorPage(HttpResponse& response, int statusCode, const ConfigParser::ServerConfig& config) {
     std::map<int, std::string>::const_iterator it = config.errorPages.find(statusCode);
     std::string errorPagePath;
     if (it != config.errorPages.end()) {
-        errorPagePath = resolvePath(config, config.root, it->second);
+        errorPagePath = resolveRequestPath(config, findLocationConfig(config, it->second), it->second);
     }
     if (!errorPagePath.empty()) {
         std::ifstream errFile(errorPagePath.c_str());
@@ -633,86 +1066,46 @@ void Server::serveErrorPage(HttpResponse& response, int statusCode, const Config
     response.setDefaultErrorBody();
 }
 
-std::set<std::string> Server::getAllowedMethodsForPath(const std::string& path, const ConfigParser::ServerConfig& config) const {
-    const LocationConfig& location = findLocationConfig(config, path);
-    if (!location.getMethods().empty()) {
-        const std::vector<std::string>& methods = location.getMethods();
-        return std::set<std::string>(methods.begin(), methods.end());
+const ConfigParser::ServerConfig& Server::selectConfig(int port, const StringRef& hostHeader) const {
+    std::map<int, ServerNameTable>::const_iterator it = portToHosts.find(port);
+    if (it == portToHosts.end()) {
+        return *currentConfig; 
     }
-    std::set<std::string> defaultMethods;
-    defaultMethods.insert("GET");
-    defaultMethods.insert("HEAD");
-    defaultMethods.insert("OPTIONS");
-    return defaultMethods;
+    return *it->second.match(hostHeader);
 }
 
-const ConfigParser::ServerConfig& Server::selectConfig(int port, const std::string& hostHeader) const {
-    std::map<int, std::vector<const ConfigParser::ServerConfig*> >::const_iterator it = portToConfigs.find(port);
-    if (it == portToConfigs.end() || it->second.empty()) {
-        return currentConfig; 
-    }
-    
-    const std::vector<const ConfigParser::ServerConfig*>& configs = it->second;
-    
-    // Extract hostname from hostHeader (remove port if present)
-    std::string hostname = hostHeader;
-    size_t colon = hostname.find(':');
-    if (colon != std::string::npos) {
-        hostname = hostname.substr(0, colon);
-    }
-    
-    // RFC 7230 2.7.1: Host header is case-insensitive
-    hostname = toLower(hostname);
+void Server::start() {
+    std::set<int> portsToBind;
+    buildPortMapping(portsToBind);
 
-    // 1. Match server_name
-    for (size_t i = 0; i < configs.size(); ++i) {
-        if (toLower(configs[i]->serverName) == hostname) {
-             return *configs[i];
-        }
+    int workers = resolveWorkerCount();
+    if (workers > 1) {
+        runMaster(portsToBind, workers);
+        return;
     }
-    
-    // 2. Default to the first one for this port
-    return *configs[0];
+    runEventLoop(portsToBind, false);
 }
 
-void Server::start() {
-    std::map<int, ClientState> clients;
-
+bool Server::runEventLoop(const std::set<int>& portsToBind, bool reusePort) {
     try {
-        std::set<int> portsToBind;
-        buildPortMapping(portsToBind);
-
-        if (!bindListeningSockets(portsToBind)) return;
+        if (!bindListeningSockets(portsToBind, reusePort)) return false;
+        raiseFdLimit();
 
-        fd_set master_read, master_write;
-        int fdmax = 0;
-        initMasterFdSets(master_read, master_write, fdmax);
+        int threads = resolveThreadCount();
+        if (threads > 1) return runThreadedLoops(threads);
 
-        std::cout << "Server is running. Press Ctrl+C to stop." << std::endl;
-
-        while (true) {
-            fd_set read_fds;
-            fd_set write_fds;
-            int loopFdMax = 0;
-            buildFdSets(master_read, master_write, read_fds, write_fds, fdmax, loopFdMax);
-
-            struct timeval tv;
-            tv.tv_sec = SELECT_TIMEOUT_SEC;
-            tv.tv_usec = 0;
-            int nready = select(loopFdMax + 1, &read_fds, &write_fds, NULL, &tv);
-            if (nready == -1) {
-                std::cerr << "Error in select()" << std::endl;
-                break;
-            }
+        Reactor reactor(monotonicMillis());
+        reactor.poller = EventPoller::create(globalConfig.eventBackend);
+        if (!configureFileCaches(reactor) || !registerListeningSockets(reactor)) {
+            std::cerr << "Failed to register listening sockets with " << reactor.poller->name() << std::endl;
+            return false;
+        }
+        startCgiPools(reactor);
 
-            time_t now = time(NULL);
+        std::cout << "Server is running (" << reactor.poller->name() << ", pid " << getpid() << "). Press Ctrl+C to stop." << std::endl;
 
-            handleClientTimeouts(clients, master_read, master_write, now);
-            handleCgiTimeouts(clients, master_write, fdmax, now);
-            acceptConnections(master_read, fdmax, clients, now);
-            processCgiIo(read_fds, write_fds, master_write, fdmax, clients);
-            processClientReads(read_fds, master_read, master_write, fdmax, clients, now);
-            processClientWrites(write_fds, master_read, master_write, clients, now);
+        std::vector<PollEvent> events;
+        while (runReactorPass(reactor, events)) {
         }
 
         for (std::vector<int>::const_iterator it = serverSockets.begin(); it != serverSockets.end(); ++it) { close(*it); }
@@ -720,29 +1113,76 @@ void Server::start() {
     } catch (const std::exception& e) {
         std::cerr << "Server error: " << e.what() << std::endl;
     }
+    return true;
 }
 
+// One wait-and-dispatch round of an event loop; false once the poller failed
+bool Server::runReactorPass(Reactor& reactor, std::vector<PollEvent>& events) {
+    // Sleep until the next deadline; with no timers pending, until an fd is ready
+    long timeout = reactor.timers.nextTimeoutMs(monotonicMillis());
+    bool reaping = !reactor.cgiExitPending.empty() || reactor.cgiPool.reaping();
+    if (reaping && (timeout < 0 || timeout > CGI_REAP_POLL_MS)) timeout = CGI_REAP_POLL_MS;
+    int nready = reactor.poller->wait(events, static_cast<int>(timeout));
+    if (nready == -1) {
+        if (errno == EINTR) return true;
+        std::cerr << "Error in " << reactor.poller->name() << " wait: " << strerror(errno) << std::endl;
+        return false;
+    }
+
+    unsigned long now = monotonicMillis();
 
-void Server::dispatchRequest(int clientFd, HttpRequest& request, HttpResponse& response, 
+    // Filesystem changes invalidate cached lookups before any request of this batch is served
+    int watchFd = reactor.openFiles.eventFd();
+    for (size_t i = 0; watchFd != -1 && i < events.size(); ++i) {
+        if (events[i].fd == watchFd) reactor.openFiles.processEvents();
+    }
+
+    processCgiIo(reactor, events);
+    processFastCgiIo(reactor, events);
+    processCgiPoolIo(reactor, events);
+    processClientReads(reactor, events, now);
+    processClientWrites(reactor, events, now);
+    processReadyClients(reactor);
+    handleExpiredTimers(reactor, now);
+    // Accept last so a recycled fd number never picks up a stale event from this batch
+    acceptConnections(reactor, events, now);
+    if (reactor.wakeFds[0] != -1) {
+        syncReactor(reactor);
+        rebalanceReactor(reactor, now);
+    }
+    return true;
+}
+
+void Server::dispatchRequest(Reactor& reactor, int clientFd, HttpRequest& request, HttpResponse& response, 
                               const ConfigParser::ServerConfig& config, bool& responseReady, ClientState& state) {
     responseReady = true; // Default: response is ready unless CGI
     clearFileStream(state.fileStream);
     
-    const LocationConfig& locConfig = findLocationConfig(config, request.getPath());
+    const std::string path = request.getPath().str();
+    const LocationConfig& locConfig = findLocationConfig(config, path);
     std::string effectiveRoot = locConfig.getRoot().empty() ? config.root : locConfig.getRoot();
-    std::string path = request.getPath();
+
+    HttpMethod method = request.getMethodId();
 
     // OPTIONS should always return an Allow header with 200
-    if (request.getMethod() == "OPTIONS") {
-        handleOptionsRequest(request, response, config);
+    if (method == METHOD_OPTIONS) {
+        handleOptionsRequest(response, locConfig);
         return;
     }
 
     // Handle CGI requests
-    if (locConfig.isCgiPath(path) && (request.getMethod() == "POST" || request.getMethod() == "GET" || request.getMethod() == "HEAD")) {
+    if (locConfig.isCgiPath(path) && (method & (METHOD_POST | METHOD_GET | METHOD_HEAD))) {
         std::string cgiEffectiveRoot = !locConfig.getRoot().empty() ? locConfig.getRoot() : config.root;
-        bool isHead = (request.getMethod() == "HEAD");
-        bool cgiStarted = startCgiRequest(clientFd, request, config, locConfig, cgiEffectiveRoot, isHead);
+        bool isHead = (method == METHOD_HEAD);
+        if (!locConfig.getFastCgiPass().empty()) {
+            if (startFastCgiRequest(reactor, clientFd, request, config, locConfig, isHead)) {
+                responseReady = false;
+            } else {
+                serveErrorPage(response, 502, config); // backend unreachable
+            }
+            return;
+        }
+        bool cgiStarted = startCgiRequest(reactor, clientFd, request, config, locConfig, cgiEffectiveRoot, isHead);
         if (cgiStarted) {
             responseReady = false; // Response will be generated later when CGI completes
             return;
@@ -754,26 +1194,34 @@ void Server::dispatchRequest(int clientFd, HttpRequest& request, HttpResponse& r
         }
     }
     
-    std::set<std::string> allowedMethods = getAllowedMethodsForPath(request.getPath(), config);
-    if (allowedMethods.find(request.getMethod()) == allowedMethods.end()) {
+    if (!locConfig.allowsMethod(method)) {
         response.setStatus(405); 
-        response.setAllowHeader(allowedMethods);
+        response.setHeader("Allow", locConfig.getAllowHeader());
         serveErrorPage(response, 405, config);
         return;
     }
     
-    if (request.getMethod() == "GET" || request.getMethod() == "HEAD") {
-        handleGetHeadRequest(request, response, config, locConfig, effectiveRoot, 
-                          request.getMethod() == "HEAD", state.fileStream);
-    } else if (request.getMethod() == "POST") {
-        handlePostRequest(request, response, config, locConfig, effectiveRoot);
-    } else if (request.getMethod() == "PUT") {
-        handlePutRequest(request, response, config, locConfig, effectiveRoot);
-    } else if (request.getMethod() == "DELETE") {
-        handleDeleteRequest(request, response, config, locConfig, effectiveRoot);
-    } else {
+    std::string changedPath;
+    switch (method) {
+    case METHOD_GET:
+    case METHOD_HEAD:
+        handleGetHeadRequest(reactor, request, response, config, locConfig, method == METHOD_HEAD, state.fileStream);
+        return;
+    case METHOD_POST:
+        handlePostRequest(request, response, config, locConfig, effectiveRoot, changedPath);
+        break;
+    case METHOD_PUT:
+        handlePutRequest(request, response, config, locConfig, effectiveRoot, changedPath);
+        break;
+    case METHOD_DELETE:
+        handleDeleteRequest(request, response, config, locConfig, effectiveRoot, changedPath);
+        break;
+    default:
         response.setStatus(501); 
         serveErrorPage(response, 501, config);
+        return;
     }
+    // Our own writes must be visible to the next pipelined request, before inotify reports them
+    if (!changedPath.empty()) reactor.openFiles.invalidate(changedPath);
 }
 
@@ -3,6 +3,7 @@
 
 #include <cerrno>
 #include <csignal>
+#include <cstdio>
 #include <cstdlib>
 #include <cstring>
 #include <fcntl.h>
@@ -10,55 +11,66 @@
 #include <sys/wait.h>
 #include <unistd.h>
 
-// Helper to convert HttpRequest to environment variables
-static std::vector<char*> createCgiEnv(HttpRequest& request,
-                                       const ConfigParser::ServerConfig& config,
-                                       const LocationConfig& locConfig,
-                                       const std::string& scriptPath) {
+// Script output that may precede the blank line ending its header block
+static const size_t MAX_CGI_HEADER_BYTES = 64 * 1024;
+
+// CGI/1.1 meta-variables of a request: a CGI child's environment, a FastCGI request's PARAMS
+static std::map<std::string, std::string> buildCgiParams(HttpRequest& request,
+                                                         const ConfigParser::ServerConfig& config,
+                                                         const LocationConfig& locConfig,
+                                                         const std::string& scriptPath) {
     std::map<std::string, std::string> envMap;
 
     // Server and request specific variables
     envMap["GATEWAY_INTERFACE"] = "CGI/1.1";
     envMap["SERVER_SOFTWARE"] = "WebServ/1.0";
-    envMap["SERVER_NAME"] = config.serverName.empty() ? "localhost" : config.serverName;
-    envMap["SERVER_PROTOCOL"] = request.getVersion();
+    envMap["SERVER_NAME"] = config.serverNames.empty() || config.serverNames[0].empty() ? "localhost" : config.serverNames[0];
+    envMap["SERVER_PROTOCOL"] = request.getVersion().str();
     envMap["SERVER_PORT"] = config.listenPorts.empty() ? "80" : config.listenPorts[0];
-    envMap["REQUEST_METHOD"] = request.getMethod();
-    envMap["SCRIPT_NAME"] = request.getPath();
+    envMap["REQUEST_METHOD"] = request.getMethod().str();
+    envMap["SCRIPT_NAME"] = request.getPath().str();
     envMap["SCRIPT_FILENAME"] = scriptPath;
-    envMap["PATH_INFO"] = request.getPath();
+    envMap["PATH_INFO"] = request.getPath().str();
     envMap["PATH_TRANSLATED"] = scriptPath;
-    envMap["REQUEST_URI"] = request.getPath();
-    envMap["QUERY_STRING"] = request.getQueryString();
+    envMap["REQUEST_URI"] = request.getPath().str();
+    envMap["QUERY_STRING"] = request.getQueryString().str();
     envMap["REMOTE_ADDR"] = "127.0.0.1";
     envMap["REMOTE_HOST"] = "localhost";
 
     // HTTP Headers
-    const std::map<std::string, std::string>& headers = request.getHeaders();
-    for (std::map<std::string, std::string>::const_iterator it = headers.begin(); it != headers.end(); ++it) {
+    const HttpHeaders& headers = request.getHeaders();
+    for (size_t h = 0; h < headers.count(); ++h) {
         std::string envHeaderName = "HTTP_";
-        std::string headerKey = it->first;
-        for (size_t i = 0; i < headerKey.length(); ++i) {
-            if (headerKey[i] == '-') {
+        StringRef headerKey = headers.name(h);
+        for (size_t i = 0; i < headerKey.size(); ++i) {
+            if (headerKey.data[i] == '-') {
                 envHeaderName += '_';
             } else {
-                envHeaderName += toupper(headerKey[i]);
+                envHeaderName += toupper(headerKey.data[i]);
             }
         }
-        envMap[envHeaderName] = it->second;
+        envMap[envHeaderName] = headers.value(h).str();
     }
 
-    if (request.getMethod() == "POST") {
-        envMap["CONTENT_TYPE"] = request.getHeader("Content-Type");
-        std::ostringstream oss;
-        oss << request.getBody().length();
-        envMap["CONTENT_LENGTH"] = oss.str();
+    if (request.getMethodId() == METHOD_POST) {
+        envMap["CONTENT_TYPE"] = request.getHeader(HEADER_CONTENT_TYPE).str();
+        // A chunked body still being streamed has no length yet; the script reads stdin to EOF
+        if (request.getHeader(HEADER_TRANSFER_ENCODING).empty()) {
+            std::ostringstream oss;
+            oss << request.getBody().size();
+            StringRef declared = request.getHeader(HEADER_CONTENT_LENGTH);
+            envMap["CONTENT_LENGTH"] = declared.empty() ? oss.str() : declared.str();
+        }
     }
     
     if (!locConfig.getCgiPass().empty()) {
         envMap["CGI_PASS_DIRECTIVE"] = locConfig.getCgiPass();
     }
+    return envMap;
+}
 
+// Helper to convert the meta-variables to an execve() environment
+static std::vector<char*> createCgiEnv(const std::map<std::string, std::string>& envMap) {
     std::vector<char*> cgiEnv;
     for (std::map<std::string, std::string>::const_iterator it = envMap.begin(); it != envMap.end(); ++it) {
         std::string envEntry = it->first + "=" + it->second;
@@ -78,22 +90,28 @@ static void freeCgiEnv(std::vector<char*>& cgiEnv) {
     }
 }
 
-// Start CGI request (non-blocking, returns true on success)
-bool Server::startCgiRequest(int clientFd, HttpRequest& request,
+// Start CGI request (non-blocking, returns true on success). With bodyFollows the
+// request body is still arriving and is fed to the script's stdin by feedCgiBody().
+bool Server::startCgiRequest(Reactor& reactor, int clientFd, HttpRequest& request,
                               const ConfigParser::ServerConfig& config,
                               const LocationConfig& locConfig,
                               const std::string& effectiveRoot,
-                              bool isHead) {
+                              bool isHead, bool bodyFollows) {
     std::string cgiPassValue = locConfig.getCgiPass();
 
-    std::cerr << "DEBUG[CGI]: Starting CGI for client " << clientFd << " method='" << request.getMethod() 
-              << "' path='" << request.getPath() << "' bodyLen=" << request.getBody().size() << std::endl;
+    std::cerr << "DEBUG[CGI]: Starting CGI for client " << clientFd << " method='" << request.getMethod().str()
+              << "' path='" << request.getPath().str() << "' bodyLen=" << request.getBody().size() << std::endl;
 
     // Map the requested URI to a filesystem path
-    std::string mappedScriptPath = resolvePath(config, effectiveRoot, request.getPath());
+    std::string mappedScriptPath = resolveRequestPath(config, locConfig, request.getPath().str());
     std::string scriptFilename = mappedScriptPath;
     std::string execPath = cgiPassValue.empty() ? mappedScriptPath : cgiPassValue;
 
+    // Pooled interpreters take the request over their pipes; a body spooled to disk still gets a child
+    if (!cgiPassValue.empty() && locConfig.getCgiPoolSize() > 0 && !request.getBody().inFile() && !bodyFollows) {
+        return startPooledCgiRequest(reactor, clientFd, request, config, locConfig, scriptFilename, isHead);
+    }
+
     // Check executable availability
     if (execPath.empty() || access(execPath.c_str(), X_OK) != 0) {
         std::cerr << "CGI executable not found or not executable: " << execPath << std::endl;
@@ -103,16 +121,32 @@ bool Server::startCgiRequest(int clientFd, HttpRequest& request,
     int pipe_in[2];
     int pipe_out[2];
 
-    if (pipe(pipe_in) == -1 || pipe(pipe_out) == -1) {
+    if (!openCloexecPipe(pipe_in)) {
         std::cerr << "Pipe failed: " << strerror(errno) << std::endl;
         return false;
     }
+    if (!openCloexecPipe(pipe_out)) {
+        std::cerr << "Pipe failed: " << strerror(errno) << std::endl;
+        close(pipe_in[0]); close(pipe_in[1]);
+        return false;
+    }
+
+    // Everything the child needs is built before fork() so it does not allocate
+    std::vector<char*> cgiEnv = createCgiEnv(buildCgiParams(request, config, locConfig, scriptFilename));
+    char* argv[2];
+    argv[0] = strdup(execPath.c_str());
+    argv[1] = NULL;
+
+    // A spooled body becomes the child's stdin directly instead of being pumped through the pipe
+    int bodyFd = request.getMethodId() == METHOD_POST ? request.getBody().fd() : -1;
 
     pid_t pid = fork();
     if (pid == -1) {
         std::cerr << "Fork failed: " << strerror(errno) << std::endl;
         close(pipe_in[0]); close(pipe_in[1]);
         close(pipe_out[0]); close(pipe_out[1]);
+        freeCgiEnv(cgiEnv);
+        free(argv[0]);
         return false;
     }
 
@@ -120,10 +154,11 @@ bool Server::startCgiRequest(int clientFd, HttpRequest& request,
         close(pipe_in[1]);
         close(pipe_out[0]);
 
-        if (dup2(pipe_in[0], STDIN_FILENO) == -1) {
+        if (dup2(bodyFd != -1 ? bodyFd : pipe_in[0], STDIN_FILENO) == -1) {
             std::cerr << "dup2 stdin failed: " << strerror(errno) << std::endl;
             exit(EXIT_FAILURE);
         }
+        if (bodyFd != -1) lseek(STDIN_FILENO, 0, SEEK_SET);
         close(pipe_in[0]);
 
         if (dup2(pipe_out[1], STDOUT_FILENO) == -1) {
@@ -131,55 +166,47 @@ bool Server::startCgiRequest(int clientFd, HttpRequest& request,
             exit(EXIT_FAILURE);
         }
         close(pipe_out[1]);
-        
-        std::vector<char*> cgiEnv = createCgiEnv(request, config, locConfig, scriptFilename);
-        
-        char* argv[3];
-        if (!cgiPassValue.empty()) {
-            argv[0] = strdup(execPath.c_str());
-            argv[1] = NULL;
-            argv[2] = NULL;
-        } else {
-            argv[0] = strdup(execPath.c_str());
-            argv[1] = NULL;
-            argv[2] = NULL;
-        }
 
         execve(argv[0], argv, &cgiEnv[0]);
         
         std::cerr << "Execve failed for " << argv[0] << ": " << strerror(errno) << std::endl;
-        freeCgiEnv(cgiEnv);
-        free(argv[0]);
-        if (argv[1]) free(argv[1]);
-        exit(EXIT_FAILURE);
+        _exit(EXIT_FAILURE);
 
     } else { // Parent process
         close(pipe_in[0]);
         close(pipe_out[1]);
+        if (bodyFd != -1) {
+            close(pipe_in[1]);
+            pipe_in[1] = -1;
+        }
+        freeCgiEnv(cgiEnv);
+        free(argv[0]);
 
         // Set pipes to non-blocking
-        int flags_in = fcntl(pipe_in[1], F_GETFL, 0);
-        int flags_out = fcntl(pipe_out[0], F_GETFL, 0);
-        fcntl(pipe_in[1], F_SETFL, flags_in | O_NONBLOCK);
-        fcntl(pipe_out[0], F_SETFL, flags_out | O_NONBLOCK);
+        if (pipe_in[1] != -1) fcntl(pipe_in[1], F_SETFL, fcntl(pipe_in[1], F_GETFL, 0) | O_NONBLOCK);
+        fcntl(pipe_out[0], F_SETFL, fcntl(pipe_out[0], F_GETFL, 0) | O_NONBLOCK);
 
         // Create CGI state
-        CgiState& cgi = cgiStates[clientFd];
+        CgiState& cgi = reactor.cgiStates[clientFd];
         cgi.pid = pid;
         cgi.pipe_in = pipe_in[1];
         cgi.pipe_out = pipe_out[0];
-        cgi.bodyToWrite = request.getBody();
+        const RequestBody& body = request.getBody();
+        cgi.bodyToWrite = body.inFile() ? std::string() : std::string(body.data(), body.size());
         cgi.bodyWritten = 0;
         cgi.cgiOutput.clear();
-        cgi.writeComplete = (request.getMethod() != "POST" || cgi.bodyToWrite.empty());
+        cgi.bodyPending = bodyFollows;
+        cgi.writeComplete = !bodyFollows && (request.getMethodId() != METHOD_POST || bodyFd != -1 || cgi.bodyToWrite.empty());
         cgi.readComplete = false;
-        cgi.startTime = time(NULL);
-        cgi.lastIO = time(NULL);
+        cgi.startTime = monotonicMillis();
+        cgi.lastIO = cgi.startTime;
         cgi.request = request;
         cgi.config = &config;
         cgi.locConfig = locConfig;
         cgi.effectiveRoot = effectiveRoot;
         cgi.isHead = isHead;
+        watchCgiPipes(reactor, clientFd, cgi);
+        armCgiTimer(reactor, clientFd, cgi);
 
         std::cerr << "DEBUG[CGI]: Started pid=" << pid << " for client " << clientFd << std::endl;
         return true;
@@ -187,40 +214,129 @@ bool Server::startCgiRequest(int clientFd, HttpRequest& request,
     return false;
             }
             
-// Handle writing to CGI stdin
-void Server::handleCgiWrite(int clientFd, CgiState& cgi) {
+// Start a request on the location's fastcgi_pass backend (returns false when it cannot be reached)
+bool Server::startFastCgiRequest(Reactor& reactor, int clientFd, HttpRequest& request,
+                                 const ConfigParser::ServerConfig& config,
+                                 const LocationConfig& locConfig,
+                                 bool isHead) {
+    // The backend opens SCRIPT_FILENAME itself, possibly on another host, so it is not checked here
+    std::string scriptFilename = resolveRequestPath(config, locConfig, request.getPath().str());
+
+    CgiState& cgi = reactor.cgiStates[clientFd];
+    cgi.backend = CGI_FASTCGI;
+    cgi.writeComplete = true;
+    cgi.startTime = monotonicMillis();
+    cgi.lastIO = cgi.startTime;
+    cgi.request = request;
+    cgi.config = &config;
+    cgi.locConfig = locConfig;
+    cgi.isHead = isHead;
+
+    // STDIN is sent from the state's own copy of the body, which lives as long as the request
+    const RequestBody& body = cgi.request.getBody();
+    size_t stdinLength = request.getMethodId() == METHOD_POST ? body.size() : 0;
+    const char* stdinData = stdinLength > 0 ? body.data() : "";
+    if (stdinData == NULL ||
+        !reactor.fastcgi.begin(*reactor.poller, clientFd, locConfig.getFastCgiPass(), locConfig.getFastCgiMultiplex(),
+                               buildCgiParams(cgi.request, config, locConfig, scriptFilename), stdinData, stdinLength,
+                               &cgi.cgiOutput)) {
+        reactor.cgiStates.erase(clientFd);
+        return false;
+    }
+    armCgiTimer(reactor, clientFd, cgi);
+    return true;
+}
+
+// Queue a request for one of the location's cgi_pool workers (returns false when none runs)
+bool Server::startPooledCgiRequest(Reactor& reactor, int clientFd, HttpRequest& request,
+                                   const ConfigParser::ServerConfig& config,
+                                   const LocationConfig& locConfig,
+                                   const std::string& scriptFilename,
+                                   bool isHead) {
+    CgiState& cgi = reactor.cgiStates[clientFd];
+    cgi.backend = CGI_POOL;
+    cgi.writeComplete = true;
+    cgi.startTime = monotonicMillis();
+    cgi.lastIO = cgi.startTime;
+    cgi.request = request;
+    cgi.config = &config;
+    cgi.locConfig = locConfig;
+    cgi.isHead = isHead;
+
+    // The frame's body is written from the state's own copy, which lives as long as the request
+    const RequestBody& body = cgi.request.getBody();
+    size_t stdinLength = request.getMethodId() == METHOD_POST ? body.size() : 0;
+    const char* stdinData = stdinLength > 0 ? body.data() : "";
+    if (stdinData == NULL ||
+        !reactor.cgiPool.begin(*reactor.poller, clientFd, locConfig.getCgiPass(), locConfig.getCgiPoolSize(),
+                               locConfig.getCgiPoolMaxRequests(),
+                               buildCgiParams(cgi.request, config, locConfig, scriptFilename), stdinData,
+                               stdinLength, &cgi.cgiOutput, cgi.startTime)) {
+        reactor.cgiStates.erase(clientFd);
+        return false;
+    }
+    armCgiTimer(reactor, clientFd, cgi);
+    return true;
+}
+
+// Handle writing to CGI stdin: as much of bodyToWrite as the pipe takes, watching
+// for writability only while some is left. stdin closes once the whole body is in.
+void Server::handleCgiWrite(Reactor& reactor, int clientFd, CgiState& cgi) {
     if (cgi.writeComplete) return;
 
-    ssize_t written = write(cgi.pipe_in, cgi.bodyToWrite.c_str() + cgi.bodyWritten, 
-                           cgi.bodyToWrite.length() - cgi.bodyWritten);
-    if (written > 0) {
-        cgi.bodyWritten += written;
-        cgi.lastIO = time(NULL);
-        
-        if (cgi.bodyWritten >= cgi.bodyToWrite.length()) {
-            close(cgi.pipe_in);
-            cgi.pipe_in = -1;
+    while (cgi.bodyWritten < cgi.bodyToWrite.length()) {
+        ssize_t written = write(cgi.pipe_in, cgi.bodyToWrite.c_str() + cgi.bodyWritten, 
+                               cgi.bodyToWrite.length() - cgi.bodyWritten);
+        if (written > 0) {
+            cgi.bodyWritten += written;
+            cgi.lastIO = monotonicMillis();
+            armCgiTimer(reactor, clientFd, cgi);
+        } else if (written < 0 && errno == EINTR) {
+            continue;
+        } else if (written < 0 && errno != EAGAIN && errno != EWOULDBLOCK) {
+            // Script closed its stdin early; the rest of the body is dropped
+            unwatchCgiPipe(reactor, cgi.pipe_in);
             cgi.writeComplete = true;
-            std::cerr << "DEBUG[CGI]: Client " << clientFd << " stdin closed after " << cgi.bodyWritten << " bytes" << std::endl;
+            cgi.bodyToWrite.clear();
+            cgi.bodyWritten = 0;
+            return;
+        } else {
+            break; // Pipe full; try again when selectable
         }
-    } else {
-        return; // Not ready; try again when selectable
     }
-            }
+
+    bool pending = cgi.bodyWritten < cgi.bodyToWrite.length();
+    if (!pending) {
+        cgi.bodyToWrite.clear();
+        cgi.bodyWritten = 0;
+        if (!cgi.bodyPending) {
+            unwatchCgiPipe(reactor, cgi.pipe_in);
+            cgi.writeComplete = true;
+            std::cerr << "DEBUG[CGI]: Client " << clientFd << " stdin closed" << std::endl;
+            return;
+        }
+    }
+    bool watched = reactor.cgiPipeOwners.find(cgi.pipe_in) != reactor.cgiPipeOwners.end();
+    if (pending && !watched && reactor.poller->add(cgi.pipe_in, EVENT_WRITE)) {
+        reactor.cgiPipeOwners[cgi.pipe_in] = clientFd;
+    } else if (!pending && watched) {
+        reactor.poller->remove(cgi.pipe_in);
+        reactor.cgiPipeOwners.erase(cgi.pipe_in);
+    }
+}
             
 // Handle reading from CGI stdout
-void Server::handleCgiRead(int clientFd, CgiState& cgi) {
+void Server::handleCgiRead(Reactor& reactor, int clientFd, CgiState& cgi) {
     if (cgi.readComplete) return;
 
     char buffer[16384];
     ssize_t bytesRead = read(cgi.pipe_out, buffer, sizeof(buffer));
     if (bytesRead > 0) {
         cgi.cgiOutput.append(buffer, bytesRead);
-        cgi.lastIO = time(NULL);
+        cgi.lastIO = monotonicMillis();
     } else if (bytesRead == 0) {
         // CGI finished writing
-        close(cgi.pipe_out);
-        cgi.pipe_out = -1;
+        unwatchCgiPipe(reactor, cgi.pipe_out);
         cgi.readComplete = true;
         std::cerr << "DEBUG[CGI]: Client " << clientFd << " stdout EOF, output=" << cgi.cgiOutput.size() << " bytes" << std::endl;
     } else if (bytesRead < 0) {
@@ -228,83 +344,181 @@ void Server::handleCgiRead(int clientFd, CgiState& cgi) {
     }
 }
 
-// Finalize CGI request and generate response
-void Server::finalizeCgiRequest(int clientFd, CgiState& cgi, int status, std::string& responseBuffer) {
+// Finalize CGI request once the child exited
+void Server::finalizeCgiRequest(Reactor& reactor, int clientFd, CgiState& cgi, int status) {
     // Close any remaining pipes
-    if (cgi.pipe_in != -1) {
-        close(cgi.pipe_in);
-        cgi.pipe_in = -1;
-    }
-    if (cgi.pipe_out != -1) {
-        close(cgi.pipe_out);
-        cgi.pipe_out = -1;
-    }
+    unwatchCgiPipe(reactor, cgi.pipe_in);
+    unwatchCgiPipe(reactor, cgi.pipe_out);
 
     std::cerr << "DEBUG[CGI]: Finalizing client " << clientFd << " WIFEXITED=" << WIFEXITED(status) 
               << " WEXITSTATUS=" << (WIFEXITED(status) ? WEXITSTATUS(status) : -1) 
               << " output_size=" << cgi.cgiOutput.size() << std::endl;
 
-    HttpResponse response;
+    bool failed = !WIFEXITED(status) || WEXITSTATUS(status) != EXIT_SUCCESS;
+    if (failed) {
+        std::cerr << "CGI script execution failed for client " << clientFd << std::endl;
+        if (WIFSIGNALED(status)) {
+            std::cerr << "CGI killed by signal: " << WTERMSIG(status) << std::endl;
+        }
+    }
+    endCgiRequest(reactor, clientFd, failed);
+}
 
-        if (WIFEXITED(status) && WEXITSTATUS(status) == EXIT_SUCCESS) {
-        // Parse CGI output
-        size_t headerEndPos = cgi.cgiOutput.find("\r\n\r\n");
-        if (headerEndPos == std::string::npos) {
-            headerEndPos = cgi.cgiOutput.find("\n\n");
-            if (headerEndPos == std::string::npos) {
-                std::cerr << "CGI output format error for client " << clientFd << std::endl;
-                serveErrorPage(response, 500, *cgi.config);
-                responseBuffer = response.generateResponse(cgi.isHead);
-                    return;
-                }
-            headerEndPos += 2;
-            } else {
-            headerEndPos += 4;
-            }
+// Offset just past the blank line ending the CGI header block, npos while it is incomplete
+static size_t findCgiHeaderEnd(const std::string& output) {
+    size_t pos = output.find("\r\n\r\n");
+    if (pos != std::string::npos) return pos + 4;
+    pos = output.find("\n\n");
+    return pos != std::string::npos ? pos + 2 : std::string::npos;
+}
 
-        std::string cgiHeadersStr = cgi.cgiOutput.substr(0, headerEndPos);
-        std::string cgiBodyStr = cgi.cgiOutput.substr(headerEndPos);
+// Applies a CGI header block: Status sets the code, other fields are copied
+static void applyCgiHeaders(const std::string& cgiHeadersStr, HttpResponse& response) {
+    response.setStatus(200);
+
+    std::istringstream headerStream(cgiHeadersStr);
+    std::string headerLine;
+    bool contentTypeSet = false;
+    while (std::getline(headerStream, headerLine)) {
+        if (headerLine.empty() || headerLine == "\r") continue;
+        if (!headerLine.empty() && headerLine[headerLine.length() - 1] == '\r') {
+            headerLine.erase(headerLine.length() - 1);
+        }
 
-            response.setStatus(200);
+        size_t colonPos = headerLine.find(':');
+        if (colonPos != std::string::npos) {
+            std::string headerName = headerLine.substr(0, colonPos);
+            std::string headerValue = headerLine.substr(colonPos + 1);
+            size_t first = headerValue.find_first_not_of(" \t");
+            if (std::string::npos == first) headerValue = ""; else {
+                size_t last = headerValue.find_last_not_of(" \t");
+                headerValue = headerValue.substr(first, (last - first + 1));
+            }
+            if (headerName == "Status") {
+                std::istringstream statusVal(headerValue);
+                int statusCode; statusVal >> statusCode;
+                response.setStatus(statusCode);
+            } else {
+                response.setHeader(headerName, headerValue);
+                if (headerName == "Content-Type") contentTypeSet = true;
+            }
+        }
+    }
+    if (!contentTypeSet) response.setHeader("Content-Type", "text/html");
+}
 
-            std::istringstream headerStream(cgiHeadersStr);
-            std::string headerLine;
-            bool contentTypeSet = false;
-            while (std::getline(headerStream, headerLine)) {
-                if (headerLine.empty() || headerLine == "\r") continue;
-                if (!headerLine.empty() && headerLine[headerLine.length() - 1] == '\r') {
-                    headerLine.erase(headerLine.length() - 1);
-                }
+// Turns complete script output (CGI headers, a blank line, the body) into the response;
+// used when the output ended before its header block did
+void Server::buildCgiResponse(int clientFd, CgiState& cgi, HttpResponse& response) {
+    size_t headerEndPos = findCgiHeaderEnd(cgi.cgiOutput);
+    if (headerEndPos == std::string::npos) {
+        std::cerr << "CGI output format error for client " << clientFd << std::endl;
+        serveErrorPage(response, 500, *cgi.config);
+        return;
+    }
+    applyCgiHeaders(cgi.cgiOutput.substr(0, headerEndPos), response);
+    // The CGI output buffer becomes the response body without another copy
+    cgi.cgiOutput.erase(0, headerEndPos);
+    response.swapBody(cgi.cgiOutput);
+}
 
-                size_t colonPos = headerLine.find(':');
-                if (colonPos != std::string::npos) {
-                    std::string headerName = headerLine.substr(0, colonPos);
-                    std::string headerValue = headerLine.substr(colonPos + 1);
-                    size_t first = headerValue.find_first_not_of(" \t");
-                    if (std::string::npos == first) headerValue = ""; else {
-                        size_t last = headerValue.find_last_not_of(" \t");
-                        headerValue = headerValue.substr(first, (last - first + 1));
-                    }
-                    if (headerName == "Status") {
-                        std::istringstream statusVal(headerValue);
-                        int statusCode; statusVal >> statusCode;
-                        response.setStatus(statusCode);
-                    } else {
-                        response.setHeader(headerName, headerValue);
-                        if (headerName == "Content-Type") contentTypeSet = true;
-                    }
-                }
+// Moves new script output to the client: the response head as soon as the CGI header
+// block is complete, then each piece of body as it arrives. Shared by CGI children,
+// FastCGI backends and pool workers. Returns false when the request was ended (an
+// oversized header block), after which cgi is gone.
+bool Server::streamCgiOutput(Reactor& reactor, int clientFd, CgiState& cgi) {
+    std::map<int, ClientState>::iterator client = reactor.clients.find(clientFd);
+    if (client == reactor.clients.end()) return true;
+    ClientState& state = client->second;
+
+    if (!cgi.streaming) {
+        size_t headerEndPos = findCgiHeaderEnd(cgi.cgiOutput);
+        if (headerEndPos == std::string::npos) {
+            if (cgi.cgiOutput.size() <= MAX_CGI_HEADER_BYTES) return true;
+            std::cerr << "CGI header block too large for client " << clientFd << std::endl;
+            HttpResponse response;
+            response.setHeader("Connection", cgi.request.wantsKeepAlive() ? "keep-alive" : "close");
+            serveErrorPage(response, 502, *cgi.config);
+            completeCgiRequest(reactor, clientFd, response);
+            return false;
+        }
+        HttpResponse response;
+        applyCgiHeaders(cgi.cgiOutput.substr(0, headerEndPos), response);
+        cgi.cgiOutput.erase(0, headerEndPos);
+
+        // Without a length from the script the body is chunked, or ends with the connection for HTTP/1.0
+        int status = response.getStatus();
+        cgi.bodyless = cgi.isHead || status == 204 || status == 304;
+        bool keepAlive = cgi.request.wantsKeepAlive();
+        if (!cgi.bodyless && !response.hasHeader("Content-Length")) {
+            if (cgi.request.getVersion() == "HTTP/1.1") {
+                response.setHeader("Transfer-Encoding", "chunked");
+                cgi.chunked = true;
+            } else {
+                keepAlive = false;
             }
-            if (!contentTypeSet) response.setHeader("Content-Type", "text/html");
-            response.setBody(cgiBodyStr);
+        }
+        response.setHeader("Connection", keepAlive ? "keep-alive" : "close");
+        response.serializeHead(state.output);
+        state.keepAlive = keepAlive;
+        cgi.streaming = true;
+    }
 
+    if (cgi.bodyless) {
+        cgi.cgiOutput.clear(); // the head is all such a response may carry
+    } else if (!cgi.cgiOutput.empty()) {
+        if (cgi.chunked) {
+            char sizeLine[24];
+            int length = snprintf(sizeLine, sizeof(sizeLine), "%lx\r\n", static_cast<unsigned long>(cgi.cgiOutput.size()));
+            state.output.append(sizeLine, length);
+            state.output.adopt(cgi.cgiOutput);
+            state.output.append("\r\n", 2);
         } else {
-        std::cerr << "CGI script execution failed for client " << clientFd << std::endl;
-        if (WIFSIGNALED(status)) {
-            std::cerr << "CGI killed by signal: " << WTERMSIG(status) << std::endl;
-            }
-        serveErrorPage(response, 502, *cgi.config);
+            state.output.adopt(cgi.cgiOutput);
+        }
+    }
+    throttleCgiOutput(reactor, clientFd, state);
+    refreshClient(reactor, clientFd, state);
+    return true;
+}
+
+// Completes a CGI, FastCGI or pool request whose output has ended. A response whose
+// head already went out is finished in place; failing then leaves it truncated and
+// closes the connection, which is all a client can be told at that point.
+void Server::endCgiRequest(Reactor& reactor, int clientFd, bool failed) {
+    CgiState& cgi = reactor.cgiStates[clientFd];
+    if (!cgi.streaming) {
+        HttpResponse response;
+        response.setHeader("Connection", cgi.request.wantsKeepAlive() ? "keep-alive" : "close");
+        if (failed) {
+            serveErrorPage(response, 502, *cgi.config);
+        } else {
+            buildCgiResponse(clientFd, cgi, response);
         }
+        completeCgiRequest(reactor, clientFd, response);
+        return;
+    }
 
-    responseBuffer = response.generateResponse(cgi.isHead);
+    if (!failed) streamCgiOutput(reactor, clientFd, cgi);
+    bool chunked = cgi.chunked;
+    cleanupCgi(reactor, clientFd);
+    std::map<int, ClientState>::iterator client = reactor.clients.find(clientFd);
+    if (client == reactor.clients.end()) return;
+    ClientState& state = client->second;
+    if (failed) {
+        state.keepAlive = false;
+    } else if (chunked) {
+        state.output.append("0\r\n\r\n", 5);
+    }
+    if (!state.keepAlive) {
+        state.closing = true;
+        // Already drained, so no write event will come to close it
+        if (state.output.empty()) {
+            closeClientFd(reactor, clientFd);
+            return;
+        }
+    }
+    refreshClient(reactor, clientFd, state);
+    // Pipelined requests were held back until this response was complete
+    if (!state.inBuffer.empty()) scheduleClient(reactor, clientFd, state);
 }
@@ -6,6 +6,40 @@
 #include <sys/stat.h>
 #include <unistd.h>
 
+#include <algorithm>
+
+// std::string::find over a raw range; returns std::string::npos when absent
+static size_t findIn(const char* data, size_t length, const std::string& needle, size_t from) {
+    if (from > length) return std::string::npos;
+    const char* end = data + length;
+    const char* hit = std::search(data + from, end, needle.begin(), needle.end());
+    return hit == end ? std::string::npos : static_cast<size_t>(hit - data);
+}
+
+// Writes the whole request body to path; a spooled body is copied by the kernel
+static bool saveBody(const RequestBody& body, const std::string& path) {
+    int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd == -1) return false;
+    bool ok = body.writeTo(fd);
+    if (close(fd) != 0) ok = false;
+    return ok;
+}
+
+// Reads a small file straight into its final buffer through an open descriptor
+static bool readWholeFile(int fd, size_t size, std::string& out) {
+    if (fd < 0) return false;
+    out.resize(size);
+    size_t got = 0;
+    while (got < size) {
+        ssize_t n = pread(fd, &out[got], size - got, got);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+        got += n;
+    }
+    out.resize(got);
+    return true;
+}
+
 static std::string extractFilenameFromContentDisposition(const std::string& headerValue) {
     // Try RFC5987 filename* first
     std::string low = toLower(headerValue);
@@ -31,12 +65,32 @@ static std::string extractFilenameFromContentDisposition(const std::string& head
     return "";
 }
 
+// The write handlers report the topmost path they touched: a directory they
+// create first covers the files written into it afterwards
+static void noteChange(std::string& changedPath, const std::string& path) {
+    if (changedPath.empty()) changedPath = path;
+}
+
+// The topmost directory along path that does not exist yet, empty if path exists
+static std::string firstMissingDirectory(const std::string& path) {
+    std::string missing;
+    std::string dir = path;
+    struct stat st;
+    while (!dir.empty() && stat(dir.c_str(), &st) != 0) {
+        missing = dir;
+        size_t slash = dir.find_last_of('/');
+        if (slash == std::string::npos || slash == 0) break;
+        dir.erase(slash);
+    }
+    return missing;
+}
+
 static std::string suggestFilenameFromHeaders(const HttpRequest& request) {
     // Prefer X-Filename
-    std::string suggested = request.getHeader("x-filename");
+    std::string suggested = request.getHeader(HEADER_X_FILENAME).str();
     if (!suggested.empty()) return basenameLike(suggested);
     // Try Content-Disposition
-    std::string cd = request.getHeader("content-disposition");
+    std::string cd = request.getHeader(HEADER_CONTENT_DISPOSITION).str();
     if (!cd.empty()) {
         std::string name = extractFilenameFromContentDisposition(cd);
         if (!name.empty()) return name;
@@ -44,21 +98,49 @@ static std::string suggestFilenameFromHeaders(const HttpRequest& request) {
     return "";
 }
 
-static bool setContentLengthFromFile(HttpResponse& response, const std::string& filePath) {
-    std::ifstream file(filePath.c_str(), std::ios::binary);
-    if (!file) return false;
-    file.seekg(0, std::ios::end);
-    std::streamsize size = file.tellg();
-    std::ostringstream sizeStr; sizeStr << size;
-    response.setHeader("Content-Length", sizeStr.str());
-    return true;
+// Resolves uri to a file, index file or missing path, consulting the loop's open
+// file cache first. A hit costs no syscalls; a miss opens the path and each index
+// candidate beneath the root once per validity period.
+const OpenFileCache::Entry& Server::lookupStaticFile(Reactor& reactor, const ConfigParser::ServerConfig& config,
+                                                     const LocationConfig& locConfig, const std::string& uri) {
+    unsigned long now = monotonicMillis();
+    const OpenFileCache::Entry* hit = reactor.openFiles.find(&config, uri, now);
+    if (hit != NULL) return *hit;
+
+    std::string sub;
+    const RootDirectory& root = mapRequestPath(config, locConfig, uri, sub);
+    OpenFileCache::Entry entry;
+    lookupBeneath(root, sub, entry, true);
+
+    if (!entry.path.empty() && entry.error == 0 && S_ISDIR(entry.st.st_mode)) {
+        std::vector<std::string> indexFiles = config.indexFiles;
+        std::string index = locConfig.getIndex();
+        if (!index.empty() && std::find(indexFiles.begin(), indexFiles.end(), index) == indexFiles.end()) {
+            indexFiles.insert(indexFiles.begin(), index);
+        }
+        // Fallback to index.html only if autoindex is off
+        if (indexFiles.empty() && !locConfig.getAutoindex()) {
+            indexFiles.push_back("index.html");
+        }
+        for (size_t i = 0; i < indexFiles.size(); ++i) {
+            OpenFileCache::Entry index;
+            lookupBeneath(root, sub.empty() ? indexFiles[i] : sub + "/" + indexFiles[i], index, true);
+            if (!index.path.empty() && index.error == 0 && S_ISREG(index.st.st_mode)) {
+                entry.indexPath = index.path;
+                entry.indexSt = index.st;
+                entry.fd = index.fd;
+                break;
+            }
+            if (index.fd != -1) close(index.fd);
+        }
+    }
+    return reactor.openFiles.insert(&config, uri, entry, now);
 }
 
 // Handler for GET and HEAD requests
-void Server::handleGetHeadRequest(HttpRequest& request, HttpResponse& response, 
+void Server::handleGetHeadRequest(Reactor& reactor, HttpRequest& request, HttpResponse& response, 
                                  const ConfigParser::ServerConfig& config, 
                                  const LocationConfig& locConfig, 
-                                 const std::string& effectiveRoot,
                                  bool isHead,
                                  FileStreamState& streamPlan) {
     if (streamPlan.fd != -1) close(streamPlan.fd);
@@ -66,9 +148,10 @@ void Server::handleGetHeadRequest(HttpRequest& request, HttpResponse& response,
     streamPlan.offset = 0;
     streamPlan.size = 0;
     streamPlan.active = false;
-    streamPlan.pendingChunk.clear();
+    streamPlan.useSendfile = true;
+    streamPlan.pending.clear();
     streamPlan.isHead = isHead;
-    const size_t INLINE_LIMIT = 64 * 1024;
+    const size_t INLINE_LIMIT = StaticFileCache::MAX_FILE_BYTES;
     // Check if there's a redirect defined for this location
     if (!locConfig.getRedirect().empty()) {
         response.setStatus(301); // Moved Permanently
@@ -79,67 +162,48 @@ void Server::handleGetHeadRequest(HttpRequest& request, HttpResponse& response,
     }
 
     // Resolve the request path
-    std::string resolvedPath = resolvePath(config, effectiveRoot, request.getPath());
-    if (resolvedPath.empty()) {
+    const OpenFileCache::Entry& file = lookupStaticFile(reactor, config, locConfig, request.getPath().str());
+    if (file.path.empty()) {
         response.setStatus(403); // Forbidden
         serveErrorPage(response, 403, config);
         return;
     }
-
-    struct stat st;
-    if (stat(resolvedPath.c_str(), &st) != 0) {
+    if (file.error != 0) {
         response.setStatus(404); // Not Found
         serveErrorPage(response, 404, config);
         return;
     }
+    const std::string& resolvedPath = file.path;
 
-    if (S_ISDIR(st.st_mode)) {
+    if (S_ISDIR(file.st.st_mode)) {
         // Directory handling without forcing a trailing-slash redirect; try an index file first
-        std::vector<std::string> indexFiles = config.indexFiles;
-        std::string index = locConfig.getIndex();
-        if (!index.empty() && std::find(indexFiles.begin(), indexFiles.end(), index) == indexFiles.end()) {
-            indexFiles.insert(indexFiles.begin(), index);
-        }
-        
-        // Fallback to index.html only if autoindex is off
-        if (indexFiles.empty() && !locConfig.getAutoindex()) {
-            indexFiles.push_back("index.html");
-        }
-
-        std::string indexPath;
-    for (size_t i = 0; i < indexFiles.size(); ++i) {
-        std::string testPath = resolvePath(config, resolvedPath, indexFiles[i]);
-        if (!testPath.empty() && stat(testPath.c_str(), &st) == 0 && S_ISREG(st.st_mode)) {
-                indexPath = testPath;
-                break;
-            }
-        }
-
-        if (!indexPath.empty()) {
-            std::ifstream file(indexPath.c_str(), std::ios::binary);
-            if (file) {
-                std::ostringstream ss;
-                ss << file.rdbuf();
-                std::string fileContent = ss.str();
-                if (!isHead) {
-                    response.setBody(fileContent);
-                }
+        const std::string& indexPath = file.indexPath;
+        PreparedResponse* cached = indexPath.empty() ? NULL : reactor.fileCache.lookup(indexPath, file.indexSt, file.fd);
+        if (cached != NULL) {
+            response.setPrepared(cached);
+        } else if (!indexPath.empty()) {
+            std::string fileContent;
+            if (!isHead && readWholeFile(file.fd, file.indexSt.st_size, fileContent)) {
+                response.swapBody(fileContent);
             }
             response.setStatus(200);
             response.setHeader("Content-Type", HttpResponse::getMimeType(indexPath));
-            if (isHead) { setContentLengthFromFile(response, indexPath); }
+            if (isHead && file.fd != -1) {
+                std::ostringstream sizeStr; sizeStr << file.indexSt.st_size;
+                response.setHeader("Content-Length", sizeStr.str());
+            }
         } else if (locConfig.getAutoindex()) {
             DIR *dir = opendir(resolvedPath.c_str());
             std::string html = "<!DOCTYPE html><html><head><title>Index of " +
-                             request.getPath() + "</title></head><body><h1>Index of " +
-                             request.getPath() + "</h1><ul>";
+                             request.getPath().str() + "</title></head><body><h1>Index of " +
+                             request.getPath().str() + "</h1><ul>";
             
             if (dir) {
                 struct dirent *entry;
                 while ((entry = readdir(dir)) != NULL) {
                     std::string name = entry->d_name;
                     if (name != "." && name != "..") {
-                        std::string href = request.getPath();
+                        std::string href = request.getPath().str();
                         if (!href.empty() && href[href.length() - 1] != '/') href += "/";
                         href += name;
                         html += "<li><a href=\"" + href + "\">" + name + 
@@ -151,7 +215,7 @@ void Server::handleGetHeadRequest(HttpRequest& request, HttpResponse& response,
             html += "</ul></body></html>";
             
             if (!isHead) {
-                response.setBody(html);
+                response.swapBody(html);
             }
             response.setStatus(200);
             response.setHeader("Content-Type", "text/html");
@@ -161,13 +225,20 @@ void Server::handleGetHeadRequest(HttpRequest& request, HttpResponse& response,
             response.setStatus(404);
             serveErrorPage(response, 404, config);
         }
-    } else if (S_ISREG(st.st_mode)) {
-        // Regular file handling
+    } else if (S_ISREG(file.st.st_mode)) {
+        // Regular file handling; small files are answered from the cache
+        const struct stat& st = file.st;
+        PreparedResponse* cached = reactor.fileCache.lookup(resolvedPath, st, file.fd);
+        if (cached != NULL) {
+            response.setPrepared(cached);
+            return;
+        }
         response.setStatus(200);
         response.setHeader("Content-Type", HttpResponse::getMimeType(resolvedPath));
         std::ostringstream sizeStr; sizeStr << st.st_size; response.setHeader("Content-Length", sizeStr.str());
         if (!isHead && static_cast<size_t>(st.st_size) > INLINE_LIMIT) {
-            int fd = open(resolvedPath.c_str(), O_RDONLY);
+            // Own descriptor: the cached one may be evicted while the stream runs
+            int fd = file.fd == -1 ? -1 : dup(file.fd);
             if (fd < 0) {
                 response.setStatus(500);
                 serveErrorPage(response, 500, config);
@@ -177,23 +248,18 @@ void Server::handleGetHeadRequest(HttpRequest& request, HttpResponse& response,
             streamPlan.offset = 0;
             streamPlan.size = st.st_size;
             streamPlan.active = true;
-            streamPlan.pendingChunk.clear();
+            streamPlan.pending.clear();
             streamPlan.isHead = false;
             response.setBody(""); // body streamed later
         } else {
-            std::ifstream file(resolvedPath.c_str(), std::ios::binary);
-            if (file.is_open()) {
-                if (!isHead) {
-                    std::ostringstream ss;
-                    ss << file.rdbuf();
-                    response.setBody(ss.str());
-                }
-                file.close();
-            } else {
+            std::string fileContent;
+            bool readable = isHead ? file.fd != -1 : readWholeFile(file.fd, st.st_size, fileContent);
+            if (!readable) {
                 response.setStatus(500);
                 serveErrorPage(response, 500, config);
                 return;
             }
+            response.swapBody(fileContent);
         }
     } else {
         response.setStatus(403);
@@ -210,13 +276,14 @@ void Server::handleGetHeadRequest(HttpRequest& request, HttpResponse& response,
 void Server::handlePostRequest(HttpRequest& request, HttpResponse& response, 
                               const ConfigParser::ServerConfig& config, 
                               const LocationConfig& locConfig, 
-                              const std::string& effectiveRoot) {
+                              const std::string& effectiveRoot,
+                              std::string& changedPath) {
     // Check if upload processing is configured
     if (!locConfig.getUploadStore().empty()) {
         // Resolve upload directory relative to effectiveRoot even if upload_store starts with '/'
         std::string uploadStore = locConfig.getUploadStore();
         if (!uploadStore.empty() && uploadStore[0] == '/') uploadStore = uploadStore.substr(1);
-        std::string uploadDir = resolvePath(config, effectiveRoot, uploadStore);
+        std::string uploadDir = resolvePath(effectiveRoot, uploadStore);
         if (uploadDir.empty()) {
             response.setStatus(500); // Internal Server Error
             serveErrorPage(response, 500, config);
@@ -232,18 +299,21 @@ void Server::handlePostRequest(HttpRequest& request, HttpResponse& response,
                 serveErrorPage(response, 500, config);
                 return;
             }
+            noteChange(changedPath, uploadDir);
         }
 
         // Decide how to save body: raw binary or multipart/form-data
-        std::string contentType = request.getHeader("content-type");
+        std::string contentType = request.getHeader(HEADER_CONTENT_TYPE).str();
 
         std::string savedFilename;
         std::string fullPath;
-        const std::string& body = request.getBody();
+        // A spooled body is mapped, so multipart parsing never copies it into memory
+        const char* body = request.getBody().data();
+        size_t bodyLen = body != NULL ? request.getBody().size() : 0;
 
         // Check for multipart
         std::string ctLower = toLower(contentType);
-        if (ctLower.find("multipart/form-data") != std::string::npos) {
+        if (bodyLen > 0 && ctLower.find("multipart/form-data") != std::string::npos) {
             // Extract boundary parameter robustly
             std::string boundary;
             {
@@ -268,16 +338,16 @@ void Server::handlePostRequest(HttpRequest& request, HttpResponse& response,
                 const std::string sep = std::string("--") + boundary;
                 size_t searchPos = 0;
                 while (true) {
-                    size_t bpos = body.find(sep, searchPos);
+                    size_t bpos = findIn(body, bodyLen, sep, searchPos);
                     if (bpos == std::string::npos) break;
                     size_t after = bpos + sep.size();
                     // Final boundary?
-                    if (after + 1 < body.size() && body[after] == '-' && body[after+1] == '-') break;
+                    if (after + 1 < bodyLen && body[after] == '-' && body[after+1] == '-') break;
                     // skip CRLF if present
-                    if (after + 1 < body.size() && body[after] == '\r' && body[after+1] == '\n') after += 2;
-                    size_t headersEnd = body.find("\r\n\r\n", after);
+                    if (after + 1 < bodyLen && body[after] == '\r' && body[after+1] == '\n') after += 2;
+                    size_t headersEnd = findIn(body, bodyLen, "\r\n\r\n", after);
                     if (headersEnd == std::string::npos) break;
-                    std::string partHeaders = body.substr(after, headersEnd - after);
+                    std::string partHeaders(body + after, headersEnd - after);
                     // Parse filename
                     std::istringstream ph(partHeaders);
                     std::string hline;
@@ -291,7 +361,7 @@ void Server::handlePostRequest(HttpRequest& request, HttpResponse& response,
                     }
                     size_t contentStart = headersEnd + 4;
                     // Find next boundary marker from contentStart
-                    size_t nextMark = body.find(sep, contentStart);
+                    size_t nextMark = findIn(body, bodyLen, sep, contentStart);
                     if (nextMark == std::string::npos) break;
                     size_t contentEnd = nextMark;
                     // Exclude trailing CRLF if present
@@ -299,11 +369,12 @@ void Server::handlePostRequest(HttpRequest& request, HttpResponse& response,
 
                     if (!filename.empty()) {
                         savedFilename = filename;
-                        fullPath = resolvePath(config, uploadDir, savedFilename);
+                        fullPath = resolvePath(uploadDir, savedFilename);
                         if (fullPath.empty()) break;
                         std::ofstream outFile(fullPath.c_str(), std::ios::binary);
                         if (!outFile.is_open()) { fullPath.clear(); break; }
-                        if (contentEnd > contentStart) outFile.write(&body[0] + contentStart, contentEnd - contentStart);
+                        noteChange(changedPath, fullPath);
+                        if (contentEnd > contentStart) outFile.write(body + contentStart, contentEnd - contentStart);
                         outFile.close();
                         break; // done
                     }
@@ -313,10 +384,10 @@ void Server::handlePostRequest(HttpRequest& request, HttpResponse& response,
 
                 // As a last resort, try to sniff filename from header text in body
                 if (fullPath.empty()) {
-                    size_t disp = body.find("Content-Disposition:");
+                    size_t disp = findIn(body, bodyLen, "Content-Disposition:", 0);
                     if (disp != std::string::npos) {
-                        size_t lineEnd = body.find("\r\n", disp);
-                        std::string headerLine = (lineEnd == std::string::npos) ? body.substr(disp) : body.substr(disp, lineEnd - disp);
+                        size_t lineEnd = findIn(body, bodyLen, "\r\n", disp);
+                        std::string headerLine = (lineEnd == std::string::npos) ? std::string(body + disp, bodyLen - disp) : std::string(body + disp, lineEnd - disp);
                         std::string fallbackName = extractFilenameFromContentDisposition(headerLine);
                         if (!fallbackName.empty()) savedFilename = fallbackName;
                     }
@@ -335,26 +406,24 @@ void Server::handlePostRequest(HttpRequest& request, HttpResponse& response,
             } else {
                 savedFilename = suggestedFilename;
             }
-            fullPath = resolvePath(config, uploadDir, savedFilename);
+            fullPath = resolvePath(uploadDir, savedFilename);
             if (fullPath.empty()) {
                 response.setStatus(500);
                 serveErrorPage(response, 500, config);
                 return;
             }
-            std::ofstream outFile(fullPath.c_str(), std::ios::binary);
-            if (!outFile.is_open()) {
+            noteChange(changedPath, fullPath);
+            if (!saveBody(request.getBody(), fullPath)) {
                 response.setStatus(500);
                 serveErrorPage(response, 500, config);
                 return;
             }
-            outFile.write(request.getBody().c_str(), request.getBody().length());
-            outFile.close();
         }
 
         response.setStatus(201);
         response.setBody("<html><body><h1>File uploaded successfully to " + fullPath + "</h1></body></html>");
         response.setHeader("Content-Type", "text/html");
-        std::string requestPath = request.getPath();
+        std::string requestPath = request.getPath().str();
         response.setHeader("Location", requestPath + (requestPath.empty() || requestPath[requestPath.length()-1] == '/' ? "" : "/") + savedFilename);
     } else {
         response.setStatus(405); // Method Not Allowed
@@ -367,22 +436,24 @@ void Server::handlePostRequest(HttpRequest& request, HttpResponse& response,
 void Server::handleDeleteRequest(HttpRequest& request, HttpResponse& response, 
                                const ConfigParser::ServerConfig& config, 
                                const LocationConfig& locConfig,
-                               const std::string& effectiveRoot) {
+                               const std::string& effectiveRoot,
+                               std::string& changedPath) {
     // Resolve the base directory. If an upload_store is configured for this location,
     // deletions should target that store to stay consistent with PUT/POST handling.
     std::string targetDir = effectiveRoot;
     if (!locConfig.getUploadStore().empty()) {
         std::string uploadStore = locConfig.getUploadStore();
         if (!uploadStore.empty() && uploadStore[0] == '/') uploadStore = uploadStore.substr(1);
-        std::string resolvedStore = resolvePath(config, effectiveRoot, uploadStore);
+        std::string resolvedStore = resolvePath(effectiveRoot, uploadStore);
         if (!resolvedStore.empty()) {
             targetDir = resolvedStore;
         }
     }
 
     // Derive the path relative to the location prefix
-    std::string uriPath = request.getPath();
-    std::string locPath = locConfig.getPath();
+    std::string uriPath = request.getPath().str();
+    // Regex locations map the whole URI below the root
+    std::string locPath = locConfig.isRegex() ? "/" : locConfig.getPath();
     std::string relativeSubpath;
     if (!locPath.empty() && uriPath.find(locPath) == 0) {
         if (uriPath.length() > locPath.size()) {
@@ -395,7 +466,7 @@ void Server::handleDeleteRequest(HttpRequest& request, HttpResponse& response,
         relativeSubpath = (locPath[0] == '/') ? locPath.substr(1) : locPath;
     }
 
-    std::string resolvedPath = resolvePath(config, targetDir, relativeSubpath);
+    std::string resolvedPath = resolvePath(targetDir, relativeSubpath);
     if (resolvedPath.empty()) {
         response.setStatus(403); // Verboden
         serveErrorPage(response, 403, config);
@@ -412,8 +483,10 @@ void Server::handleDeleteRequest(HttpRequest& request, HttpResponse& response,
 
     bool success = false;
     if (S_ISDIR(st.st_mode)) {
+        noteChange(changedPath, resolvedPath);
         success = deleteDirectoryRecursively(resolvedPath);
     } else if (S_ISREG(st.st_mode)) {
+        noteChange(changedPath, resolvedPath);
         success = (remove(resolvedPath.c_str()) == 0);
     } else {
         // Allow only regular files and directories, no special files
@@ -435,15 +508,9 @@ void Server::handleDeleteRequest(HttpRequest& request, HttpResponse& response,
 }
 
 // Handler for OPTIONS requests
-void Server::handleOptionsRequest(HttpRequest& request, HttpResponse& response, 
-                                 const ConfigParser::ServerConfig& config) {
-    std::set<std::string> allowedMethods = getAllowedMethodsForPath(request.getPath(), config);
-    
-    // Zorg ervoor dat OPTIONS is opgenomen in de toegestane methoden
-    allowedMethods.insert("OPTIONS");
-
+void Server::handleOptionsRequest(HttpResponse& response, const LocationConfig& locConfig) {
     response.setStatus(200); // OK
-    response.setAllowHeader(allowedMethods);
+    response.setHeader("Allow", locConfig.getOptionsAllowHeader());
     
     // Add CORS headers
     response.setHeader("Access-Control-Allow-Origin", "*");
@@ -458,7 +525,8 @@ void Server::handleOptionsRequest(HttpRequest& request, HttpResponse& response,
 void Server::handlePutRequest(HttpRequest& request, HttpResponse& response,
                               const ConfigParser::ServerConfig& config,
                               const LocationConfig& locConfig,
-                              const std::string& effectiveRoot) {
+                              const std::string& effectiveRoot,
+                              std::string& changedPath) {
     // Must be allowed by allow_methods PUT
     // Save file to upload_store (or fallback to effectiveRoot)
     // Resolve upload_store relative to effectiveRoot even if it starts with '/'
@@ -468,7 +536,7 @@ void Server::handlePutRequest(HttpRequest& request, HttpResponse& response,
     } else {
         std::string uploadStore = locConfig.getUploadStore();
         if (!uploadStore.empty() && uploadStore[0] == '/') uploadStore = uploadStore.substr(1);
-        targetDir = resolvePath(config, effectiveRoot, uploadStore);
+        targetDir = resolvePath(effectiveRoot, uploadStore);
     }
     if (targetDir.empty()) {
         response.setStatus(500);
@@ -483,14 +551,16 @@ void Server::handlePutRequest(HttpRequest& request, HttpResponse& response,
             serveErrorPage(response, 500, config);
             return;
         }
+        noteChange(changedPath, targetDir);
     }
 
     // Derive suggested filename from headers (X-Filename or Content-Disposition)
     std::string suggestedFilename = suggestFilenameFromHeaders(request);
 
     // Determine subpath (directory or filename) from URI after location prefix
-    std::string uriPath = request.getPath();
-    std::string locPath = locConfig.getPath();
+    std::string uriPath = request.getPath().str();
+    // Regex locations map the whole URI below the root
+    std::string locPath = locConfig.isRegex() ? "/" : locConfig.getPath();
     std::string relativeSubpath;
     if (!locPath.empty() && uriPath.find(locPath) == 0) {
         if (uriPath.length() < locPath.size()) {
@@ -510,26 +580,28 @@ void Server::handlePutRequest(HttpRequest& request, HttpResponse& response,
         // No name provided in URL; use suggested or generate
         std::string nameToUse = suggestedFilename;
         if (nameToUse.empty()) { std::ostringstream oss; oss << "put_" << time(NULL); nameToUse = oss.str(); }
-        finalPath = resolvePath(config, targetDir, nameToUse);
+        finalPath = resolvePath(targetDir, nameToUse);
     } else {
         // If subpath looks like a directory (no dot in last segment), and we have a suggested filename, store inside that directory
         size_t lastSlash = relativeSubpath.find_last_of('/');
         std::string lastSegment = (lastSlash == std::string::npos) ? relativeSubpath : relativeSubpath.substr(lastSlash + 1);
         bool treatAsDirectory = (lastSegment.find('.') == std::string::npos) && !suggestedFilename.empty();
         if (treatAsDirectory) {
-            std::string dirResolved = resolvePath(config, targetDir, relativeSubpath);
+            std::string dirResolved = resolvePath(targetDir, relativeSubpath);
             if (dirResolved.empty()) { response.setStatus(403); serveErrorPage(response, 403, config); return; }
             // Create directory path if needed
+            noteChange(changedPath, firstMissingDirectory(dirResolved));
             if (!createDirectoriesRecursively(dirResolved)) { response.setStatus(500); serveErrorPage(response, 500, config); return; }
-            finalPath = resolvePath(config, dirResolved, suggestedFilename);
+            finalPath = resolvePath(dirResolved, suggestedFilename);
         } else {
             // Treat as explicit filename (may include nested directories)
-            finalPath = resolvePath(config, targetDir, relativeSubpath);
+            finalPath = resolvePath(targetDir, relativeSubpath);
             if (finalPath.empty()) { response.setStatus(403); serveErrorPage(response, 403, config); return; }
             // Ensure parent directories exist
             size_t ps = finalPath.find_last_of('/');
             if (ps != std::string::npos) {
                 std::string parent = finalPath.substr(0, ps);
+                noteChange(changedPath, firstMissingDirectory(parent));
                 if (!createDirectoriesRecursively(parent)) { response.setStatus(500); serveErrorPage(response, 500, config); return; }
             }
         }
@@ -549,14 +621,12 @@ void Server::handlePutRequest(HttpRequest& request, HttpResponse& response,
         return;
     }
 
-    std::ofstream out(fullPath.c_str(), std::ios::binary);
-    if (!out.is_open()) {
+    noteChange(changedPath, fullPath);
+    if (!saveBody(request.getBody(), fullPath)) {
         response.setStatus(500);
         serveErrorPage(response, 500, config);
         return;
     }
-    out.write(request.getBody().c_str(), request.getBody().size());
-    out.close();
 
     response.setStatus(201); // Created
     response.setHeader("Content-Type", "text/plain");
@@ -0,0 +1,123 @@
+#include "ServerNameTable.hpp"
+#include "Utils.hpp"
+
+#include <cctype>
+#include <cstring>
+#include <iostream>
+
+static const size_t INITIAL_SLOTS = 16;
+
+ServerNameTable::NameMap::NameMap() : slots(INITIAL_SLOTS), used(0) {}
+
+// FNV-1a over the lowercased bytes, so lookups need no lowercased copy
+size_t ServerNameTable::NameMap::hash(const char* name, size_t length) {
+    size_t h = 2166136261u;
+    for (size_t i = 0; i < length; ++i) {
+        h ^= static_cast<unsigned char>(tolower(static_cast<unsigned char>(name[i])));
+        h *= 16777619u;
+    }
+    return h;
+}
+
+const ConfigParser::ServerConfig* ServerNameTable::NameMap::insert(const std::string& name,
+                                                                   const ConfigParser::ServerConfig* config) {
+    const ConfigParser::ServerConfig* existing = find(name.data(), name.size());
+    if (existing != NULL) return existing;
+    if ((used + 1) * 2 > slots.size()) grow();
+    size_t mask = slots.size() - 1;
+    size_t i = hash(name.data(), name.size()) & mask;
+    while (slots[i].config != NULL) i = (i + 1) & mask;
+    slots[i].name = name;
+    slots[i].config = config;
+    ++used;
+    return config;
+}
+
+const ConfigParser::ServerConfig* ServerNameTable::NameMap::find(const char* name, size_t length) const {
+    if (used == 0) return NULL;
+    size_t mask = slots.size() - 1;
+    for (size_t i = hash(name, length) & mask; slots[i].config != NULL; i = (i + 1) & mask) {
+        const std::string& candidate = slots[i].name;
+        if (candidate.size() != length) continue;
+        size_t k = 0;
+        while (k < length && candidate[k] == tolower(static_cast<unsigned char>(name[k]))) ++k;
+        if (k == length) return slots[i].config;
+    }
+    return NULL;
+}
+
+void ServerNameTable::NameMap::grow() {
+    std::vector<Slot> old(slots.size() * 2);
+    old.swap(slots);
+    used = 0;
+    for (size_t i = 0; i < old.size(); ++i) {
+        if (old[i].config != NULL) insert(old[i].name, old[i].config);
+    }
+}
+
+ServerNameTable::ServerNameTable() : defaultServer(NULL) {}
+
+void ServerNameTable::addName(NameMap& map, const std::string& name, const std::string& original,
+                              const ConfigParser::ServerConfig* config) {
+    if (map.insert(name, config) != config) {
+        std::cerr << "Warning: Conflicting server_name '" << original << "', ignored." << std::endl;
+    }
+}
+
+void ServerNameTable::add(const ConfigParser::ServerConfig* config) {
+    if (defaultServer == NULL) defaultServer = config;
+    for (size_t i = 0; i < config->serverNames.size(); ++i) {
+        const std::string& original = config->serverNames[i];
+        if (!original.empty() && original[0] == '~') {
+            std::string error;
+            if (!regexes.add(original.substr(1), true, error)) {
+                std::cerr << "Warning: Ignoring server_name '" << original << "': " << error << "." << std::endl;
+                continue;
+            }
+            regexTargets.push_back(config);
+            continue;
+        }
+        std::string name = toLower(original);
+        size_t star = name.find('*');
+        if (star == std::string::npos && !name.empty() && name[0] == '.') {
+            addName(exact, name.substr(1), original, config);
+            addName(suffixes, name, original, config);
+        } else if (star == std::string::npos) {
+            addName(exact, name, original, config);
+        } else if (star == 0 && name.size() > 2 && name[1] == '.' && name.find('*', 1) == std::string::npos) {
+            addName(suffixes, name.substr(1), original, config);
+        } else if (star == name.size() - 1 && name.size() > 2 && name[star - 1] == '.' &&
+                   name.find('*') == star) {
+            addName(prefixes, name.substr(0, star), original, config);
+        } else {
+            std::cerr << "Warning: Ignoring server_name '" << original
+                      << "': a wildcard must be a whole leading or trailing label." << std::endl;
+        }
+    }
+}
+
+void ServerNameTable::compile() {
+    regexes.compile();
+}
+
+const ConfigParser::ServerConfig* ServerNameTable::match(const StringRef& host) const {
+    // Host is "name", "name:port" or "[v6]:port"; a trailing dot names the same host
+    const char* name = host.data;
+    bool bracketed = !host.empty() && name[0] == '[';
+    const char* stop = static_cast<const char*>(memchr(name, bracketed ? ']' : ':', host.size()));
+    size_t length = stop == NULL ? host.size() : stop - name + (bracketed ? 1 : 0);
+    if (length > 0 && name[length - 1] == '.') --length;
+
+    const ConfigParser::ServerConfig* config = exact.find(name, length);
+    if (config != NULL) return config;
+    // Longest wildcard first: suffixes starting at the leftmost dot, prefixes ending at the rightmost
+    for (size_t i = 0; i < length; ++i) {
+        if (name[i] == '.' && (config = suffixes.find(name + i, length - i)) != NULL) return config;
+    }
+    for (size_t i = length; i > 0; --i) {
+        if (name[i - 1] == '.' && (config = prefixes.find(name, i)) != NULL) return config;
+    }
+    int regex = regexes.firstMatch(name, length);
+    if (regex >= 0) return regexTargets[regex];
+    return defaultServer;
+}
@@ -0,0 +1,193 @@
+#include "Server.hpp"
+#include "Utils.hpp"
+
+// How often a reactor compares its connection count with its siblings
+static const unsigned long REBALANCE_INTERVAL_MS = 500;
+// Smaller differences are left alone so connections do not bounce between loops
+static const int REBALANCE_MIN_SKEW = 8;
+// Upper bound of connections moved in one rebalance round
+static const int REBALANCE_MAX_MOVES = 64;
+
+struct ReactorThreadArgs {
+    Server* server;
+    Reactor* reactor;
+};
+
+static bool openWakePipe(int fds[2]) {
+#ifdef __linux__
+    return pipe2(fds, O_NONBLOCK | O_CLOEXEC) == 0;
+#else
+    if (pipe(fds) == -1) return false;
+    for (int i = 0; i < 2; ++i) {
+        fcntl(fds[i], F_SETFL, fcntl(fds[i], F_GETFL, 0) | O_NONBLOCK);
+        fcntl(fds[i], F_SETFD, FD_CLOEXEC);
+    }
+    return true;
+#endif
+}
+
+static int publishedLoad(Reactor& reactor) {
+    pthread_mutex_lock(&reactor.inboxLock);
+    int load = reactor.load;
+    pthread_mutex_unlock(&reactor.inboxLock);
+    return load;
+}
+
+// Nothing buffered in either direction and no response in progress
+static bool isIdleConnection(const Reactor& reactor, int fd, const ClientState& st) {
+    return !st.queued && !st.closing && !st.readingBody && st.inBuffer.empty() &&
+           st.output.empty() && !st.fileStream.active &&
+           reactor.cgiStates.find(fd) == reactor.cgiStates.end();
+}
+
+int Server::resolveThreadCount() const {
+    if (globalConfig.workerThreads > 0) return globalConfig.workerThreads;
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    return cpus > 0 ? static_cast<int>(cpus) : 1;
+}
+
+// Runs threadCount reactor threads fed by an accept-only loop on the calling thread.
+// Configuration is shared read-only; connection and CGI state stay with their reactor.
+bool Server::runThreadedLoops(int threadCount) {
+    unsigned long now = monotonicMillis();
+    for (int i = 0; i < threadCount; ++i) {
+        Reactor* reactor = new Reactor(now);
+        reactors.push_back(reactor);
+        reactor->index = i;
+        reactor->poller = EventPoller::create(globalConfig.eventBackend);
+        if (!configureFileCaches(*reactor) || !openWakePipe(reactor->wakeFds) || !reactor->poller->add(reactor->wakeFds[0], EVENT_READ)) {
+            std::cerr << "Failed to set up event loop " << i << ": " << strerror(errno) << std::endl;
+            return false;
+        }
+        startCgiPools(*reactor);
+    }
+
+    Reactor acceptor(now);
+    acceptor.poller = EventPoller::create(globalConfig.eventBackend);
+    if (!registerListeningSockets(acceptor)) {
+        std::cerr << "Failed to register listening sockets with " << acceptor.poller->name() << std::endl;
+        return false;
+    }
+
+    std::vector<ReactorThreadArgs> args(threadCount);
+    for (int i = 0; i < threadCount; ++i) {
+        args[i].server = this;
+        args[i].reactor = reactors[i];
+        pthread_t thread;
+        int err = pthread_create(&thread, NULL, reactorThreadMain, &args[i]);
+        if (err != 0) {
+            // Running threads already use 'reactors', so there is no clean way back
+            std::cerr << "Failed to start event loop thread " << i << ": " << strerror(err) << std::endl;
+            exit(EXIT_FAILURE);
+        }
+        pthread_detach(thread);
+    }
+
+    std::cout << "Server is running (" << acceptor.poller->name() << ", pid " << getpid() << ", "
+              << threadCount << " threads). Press Ctrl+C to stop." << std::endl;
+
+    std::vector<PollEvent> events;
+    while (runReactorPass(acceptor, events)) {
+    }
+    // The reactor threads still reference this object and its configuration
+    std::cerr << "Accept loop failed, exiting" << std::endl;
+    exit(EXIT_FAILURE);
+}
+
+void* Server::reactorThreadMain(void* arg) {
+    ReactorThreadArgs* args = static_cast<ReactorThreadArgs*>(arg);
+    Reactor& reactor = *args->reactor;
+    std::vector<PollEvent> events;
+    while (args->server->runReactorPass(reactor, events)) {
+    }
+    std::cerr << "Event loop " << reactor.index << " stopped" << std::endl;
+    // Keep the acceptor and rebalancing away from a loop that no longer runs
+    pthread_mutex_lock(&reactor.inboxLock);
+    reactor.load = INT_MAX;
+    pthread_mutex_unlock(&reactor.inboxLock);
+    return NULL;
+}
+
+Reactor& Server::leastLoadedReactor() {
+    size_t best = 0;
+    int bestLoad = publishedLoad(*reactors[0]);
+    for (size_t i = 1; i < reactors.size() && bestLoad > 0; ++i) {
+        int load = publishedLoad(*reactors[i]);
+        if (load < bestLoad) {
+            best = i;
+            bestLoad = load;
+        }
+    }
+    return *reactors[best];
+}
+
+// Queues a connection for another reactor; safe to call from any thread
+void Server::handOff(Reactor& target, const Handoff& handoff) {
+    pthread_mutex_lock(&target.inboxLock);
+    bool wasEmpty = target.inbox.empty();
+    target.inbox.push_back(handoff);
+    ++target.load;
+    pthread_mutex_unlock(&target.inboxLock);
+    if (wasEmpty) {
+        // A full pipe means the target is already due to wake up
+        char byte = 0;
+        ssize_t ignored = write(target.wakeFds[1], &byte, 1);
+        (void)ignored;
+    }
+}
+
+// Adopts queued handoffs and publishes the current load; runs once per loop pass
+void Server::syncReactor(Reactor& reactor) {
+    char drain[64];
+    while (read(reactor.wakeFds[0], drain, sizeof(drain)) > 0) {
+    }
+
+    std::vector<Handoff> incoming;
+    pthread_mutex_lock(&reactor.inboxLock);
+    incoming.swap(reactor.inbox);
+    reactor.load = static_cast<int>(reactor.clients.size() + incoming.size());
+    pthread_mutex_unlock(&reactor.inboxLock);
+
+    for (size_t i = 0; i < incoming.size(); ++i) {
+        adoptClient(reactor, incoming[i].fd, incoming[i].port, incoming[i].lastActivity);
+    }
+}
+
+// Moves idle keep-alive connections to the least loaded sibling when this loop is
+// clearly ahead. Only the owning thread can detach a connection safely, so the
+// busy loop sheds work instead of an idle one reaching into its tables.
+void Server::rebalanceReactor(Reactor& reactor, unsigned long now) {
+    if (now < reactor.nextRebalance) return;
+    reactor.nextRebalance = now + REBALANCE_INTERVAL_MS;
+
+    Reactor* lightest = NULL;
+    int lightestLoad = 0;
+    for (size_t i = 0; i < reactors.size(); ++i) {
+        if (reactors[i] == &reactor) continue;
+        int load = publishedLoad(*reactors[i]);
+        if (lightest == NULL || load < lightestLoad) {
+            lightest = reactors[i];
+            lightestLoad = load;
+        }
+    }
+    int mine = static_cast<int>(reactor.clients.size());
+    int skew = mine - lightestLoad;
+    if (lightest == NULL || skew < REBALANCE_MIN_SKEW || skew * 4 < mine) return;
+
+    int budget = skew / 2 < REBALANCE_MAX_MOVES ? skew / 2 : REBALANCE_MAX_MOVES;
+    std::vector<Handoff> moving;
+    for (std::map<int, ClientState>::const_iterator it = reactor.clients.begin();
+         it != reactor.clients.end() && static_cast<int>(moving.size()) < budget; ++it) {
+        if (isIdleConnection(reactor, it->first, it->second)) {
+            moving.push_back(Handoff(it->first, it->second.port, it->second.lastActivity));
+        }
+    }
+    for (size_t i = 0; i < moving.size(); ++i) {
+        detachClient(reactor, moving[i].fd);
+        handOff(*lightest, moving[i]);
+    }
+    if (DEBUG_LOG && !moving.empty()) {
+        std::cerr << "DEBUG[THREADS]: Loop " << reactor.index << " moved " << moving.size()
+                  << " idle connections to loop " << lightest->index << std::endl;
+    }
+}
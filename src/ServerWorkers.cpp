@@ -0,0 +1,165 @@
+#include "Server.hpp"
+
+#include <sched.h>
+#ifdef __linux__
+#include <sys/prctl.h>
+#endif
+
+// A worker that cannot bind its listeners exits with this status; restarting it would not help
+static const int WORKER_EXIT_FATAL = 3;
+// Workers dying sooner than this after being spawned are restarted with a delay
+static const time_t WORKER_MIN_LIFETIME_SEC = 1;
+
+static volatile sig_atomic_t g_terminate = 0;
+static volatile sig_atomic_t g_terminateSignal = SIGTERM;
+static volatile sig_atomic_t g_restart = 0;
+static volatile sig_atomic_t g_childExited = 0;
+
+static void masterSignalHandler(int sig) {
+    if (sig == SIGCHLD) {
+        g_childExited = 1;
+    } else if (sig == SIGHUP) {
+        g_restart = 1;
+    } else {
+        g_terminate = 1;
+        g_terminateSignal = sig;
+    }
+}
+
+static void setSignalHandler(int sig, void (*handler)(int)) {
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = handler;
+    sigemptyset(&sa.sa_mask);
+    sigaction(sig, &sa, NULL);
+}
+
+static void pinToCpu(int slot) {
+#ifdef __linux__
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    if (cpus <= 0) return;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(slot % cpus, &set);
+    if (sched_setaffinity(0, sizeof(set), &set) != 0) {
+        std::cerr << "Worker " << slot << ": sched_setaffinity failed: " << strerror(errno) << std::endl;
+    }
+#else
+    (void)slot;
+#endif
+}
+
+int Server::resolveWorkerCount() const {
+    if (globalConfig.workerProcesses > 0) return globalConfig.workerProcesses;
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    return cpus > 0 ? static_cast<int>(cpus) : 1;
+}
+
+pid_t Server::spawnWorker(const std::set<int>& portsToBind, int slot) {
+    pid_t pid = fork();
+    if (pid != 0) {
+        if (pid < 0) std::cerr << "Fork of worker " << slot << " failed: " << strerror(errno) << std::endl;
+        return pid;
+    }
+
+    // Worker: drop the master's handlers and die together with the master
+    setSignalHandler(SIGTERM, SIG_DFL);
+    setSignalHandler(SIGINT, SIG_DFL);
+    setSignalHandler(SIGQUIT, SIG_DFL);
+    setSignalHandler(SIGHUP, SIG_DFL);
+    setSignalHandler(SIGCHLD, SIG_DFL);
+    sigset_t none;
+    sigemptyset(&none);
+    sigprocmask(SIG_SETMASK, &none, NULL);
+#ifdef __linux__
+    prctl(PR_SET_PDEATHSIG, SIGTERM);
+#endif
+    if (globalConfig.workerCpuAffinity) pinToCpu(slot);
+
+    bool ok = runEventLoop(portsToBind, true);
+    exit(ok ? EXIT_SUCCESS : WORKER_EXIT_FATAL);
+}
+
+void Server::runMaster(const std::set<int>& portsToBind, int workerCount) {
+    setSignalHandler(SIGTERM, masterSignalHandler);
+    setSignalHandler(SIGINT, masterSignalHandler);
+    setSignalHandler(SIGQUIT, masterSignalHandler);
+    setSignalHandler(SIGHUP, masterSignalHandler);
+    setSignalHandler(SIGCHLD, masterSignalHandler);
+
+    // Signals stay blocked except inside sigsuspend(), so none is missed between checks
+    sigset_t blocked, waitMask;
+    sigemptyset(&blocked);
+    sigaddset(&blocked, SIGTERM);
+    sigaddset(&blocked, SIGINT);
+    sigaddset(&blocked, SIGQUIT);
+    sigaddset(&blocked, SIGHUP);
+    sigaddset(&blocked, SIGCHLD);
+    sigprocmask(SIG_BLOCK, &blocked, &waitMask);
+    sigdelset(&waitMask, SIGTERM);
+    sigdelset(&waitMask, SIGINT);
+    sigdelset(&waitMask, SIGQUIT);
+    sigdelset(&waitMask, SIGHUP);
+    sigdelset(&waitMask, SIGCHLD);
+
+    std::vector<pid_t> workers(workerCount, -1);
+    std::vector<time_t> spawnedAt(workerCount, 0);
+    for (int i = 0; i < workerCount; ++i) {
+        workers[i] = spawnWorker(portsToBind, i);
+        spawnedAt[i] = time(NULL);
+    }
+    std::cout << "Master " << getpid() << " started " << workerCount << " worker processes" << std::endl;
+
+    int alive = workerCount;
+    bool stopping = false;
+    while (alive > 0) {
+        if (g_terminate && !stopping) {
+            stopping = true;
+            std::cout << "Master shutting down workers" << std::endl;
+            for (size_t i = 0; i < workers.size(); ++i) {
+                if (workers[i] > 0) kill(workers[i], g_terminateSignal);
+            }
+        }
+        if (g_restart && !stopping) {
+            // Recycle every worker; the reaping below spawns the replacements
+            g_restart = 0;
+            for (size_t i = 0; i < workers.size(); ++i) {
+                if (workers[i] > 0) kill(workers[i], SIGTERM);
+            }
+        }
+
+        g_childExited = 0;
+        int status;
+        pid_t pid;
+        while ((pid = waitpid(-1, &status, WNOHANG)) > 0) {
+            for (size_t slot = 0; slot < workers.size(); ++slot) {
+                if (workers[slot] != pid) continue;
+                workers[slot] = -1;
+                bool fatal = WIFEXITED(status) && WEXITSTATUS(status) == WORKER_EXIT_FATAL;
+                if (stopping || fatal) {
+                    if (fatal) std::cerr << "Worker " << slot << " could not start; not restarting it" << std::endl;
+                    --alive;
+                    break;
+                }
+                bool crashed = WIFSIGNALED(status) ? WTERMSIG(status) != SIGTERM
+                                                   : WEXITSTATUS(status) != EXIT_SUCCESS;
+                if (crashed) {
+                    std::cerr << "Worker " << slot << " (pid " << pid << ") died unexpectedly, restarting" << std::endl;
+                    // Avoid a fork loop when a worker keeps crashing right after start
+                    if (time(NULL) - spawnedAt[slot] < WORKER_MIN_LIFETIME_SEC) sleep(1);
+                }
+                workers[slot] = spawnWorker(portsToBind, static_cast<int>(slot));
+                spawnedAt[slot] = time(NULL);
+                if (workers[slot] < 0) --alive;
+                break;
+            }
+        }
+
+        if (alive > 0 && !g_childExited && !(g_terminate && !stopping) && !g_restart) {
+            sigsuspend(&waitMask);
+        }
+    }
+
+    sigprocmask(SIG_UNBLOCK, &blocked, NULL);
+    std::cout << "Master exiting" << std::endl;
+}
@@ -0,0 +1,111 @@
+#include "StaticFileCache.hpp"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <sstream>
+
+const size_t StaticFileCache::MAX_FILE_BYTES;
+
+// Reads exactly size bytes, through fd when the caller already holds one;
+// a file that changed length meanwhile is not cached
+static bool readExactly(const std::string& path, int fd, size_t size, std::string& out) {
+    int ownFd = -1;
+    if (fd < 0) {
+        fd = ownFd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) return false;
+    }
+    out.resize(size);
+    size_t got = 0;
+    while (got < size) {
+        ssize_t n = pread(fd, &out[got], size - got, got);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+        got += n;
+    }
+    if (ownFd != -1) close(ownFd);
+    return got == size;
+}
+
+static std::string httpDate(time_t when) {
+    struct tm parts;
+    char text[64];
+    gmtime_r(&when, &parts);
+    strftime(text, sizeof(text), "%a, %d %b %Y %H:%M:%S GMT", &parts);
+    return text;
+}
+
+// Header block of a 200 response; fields in the order HttpResponse::serialize() emits them
+static std::string buildHead(const std::string& connection, const std::string& fields) {
+    return "HTTP/1.1 200 OK\r\nConnection: " + connection + "\r\n" + fields + "\r\n";
+}
+
+StaticFileCache::StaticFileCache() : bytes(0), capacity(0) {}
+
+StaticFileCache::~StaticFileCache() {
+    while (!lru.empty()) evict(lru.back());
+}
+
+void StaticFileCache::setCapacity(size_t maxBytes) {
+    capacity = maxBytes;
+    while (bytes > capacity && !lru.empty()) evict(lru.back());
+}
+
+PreparedResponse* StaticFileCache::lookup(const std::string& path, const struct stat& st, int fd) {
+    if (capacity == 0 || static_cast<size_t>(st.st_size) > MAX_FILE_BYTES) return NULL;
+
+    std::map<std::string, Entry*>::iterator it = entries.find(path);
+    if (it != entries.end()) {
+        Entry* entry = it->second;
+        if (entry->inode == st.st_ino && entry->device == st.st_dev &&
+            entry->size == st.st_size && entry->mtime == st.st_mtime) {
+            lru.splice(lru.begin(), lru, entry->lruPos);
+            return entry;
+        }
+        evict(entry);
+    }
+    return load(path, st, fd);
+}
+
+StaticFileCache::Entry* StaticFileCache::load(const std::string& path, const struct stat& st, int fd) {
+    Entry* entry = new Entry();
+    if (!readExactly(path, fd, st.st_size, entry->body)) {
+        entry->release();
+        return NULL;
+    }
+    entry->path = path;
+    entry->device = st.st_dev;
+    entry->inode = st.st_ino;
+    entry->size = st.st_size;
+    entry->mtime = st.st_mtime;
+
+    std::ostringstream fields;
+    fields << "Content-Length: " << st.st_size << "\r\n"
+           << "Content-Type: " << HttpResponse::getMimeType(path) << "\r\n"
+           << "ETag: \"" << std::hex << st.st_mtime << "-" << st.st_size << std::dec << "\"\r\n"
+           << "Last-Modified: " << httpDate(st.st_mtime) << "\r\n";
+    entry->keepAliveHead = buildHead("keep-alive", fields.str());
+    entry->closeHead = buildHead("close", fields.str());
+
+    entry->cost = entry->body.size() + entry->keepAliveHead.size() + entry->closeHead.size() + path.size();
+    if (entry->cost > capacity) {
+        entry->release();
+        return NULL;
+    }
+    while (bytes + entry->cost > capacity && !lru.empty()) evict(lru.back());
+
+    lru.push_front(entry);
+    entry->lruPos = lru.begin();
+    entries[path] = entry;
+    bytes += entry->cost;
+    return entry;
+}
+
+// Drops the cache's reference; responses still sending the entry keep it alive
+void StaticFileCache::evict(Entry* entry) {
+    entries.erase(entry->path);
+    lru.erase(entry->lruPos);
+    bytes -= entry->cost;
+    entry->release();
+}
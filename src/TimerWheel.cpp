@@ -0,0 +1,105 @@
+#include "TimerWheel.hpp"
+
+TimerWheel::TimerWheel(unsigned long nowMs) : currentTick(nowMs / TICK_MS), count(0) {
+    for (int i = 0; i < LEVEL0_SLOTS + LEVEL1_SLOTS; ++i) heads[i] = -1;
+}
+
+void TimerWheel::schedule(int key, unsigned long deadlineMs) {
+    if (key < 0) return;
+    if (static_cast<size_t>(key) >= nodes.size()) nodes.resize(key + 1);
+    unlink(key);
+    // Round up so a timer never fires early; anything already due fires on the next tick
+    unsigned long tick = (deadlineMs + TICK_MS - 1) / TICK_MS;
+    if (tick <= currentTick) tick = currentTick + 1;
+    link(key, tick);
+}
+
+void TimerWheel::cancel(int key) {
+    if (key < 0 || static_cast<size_t>(key) >= nodes.size()) return;
+    unlink(key);
+}
+
+bool TimerWheel::isScheduled(int key) const {
+    return key >= 0 && static_cast<size_t>(key) < nodes.size() && nodes[key].slot != -1;
+}
+
+size_t TimerWheel::size() const {
+    return count;
+}
+
+void TimerWheel::link(int key, unsigned long tick) {
+    Node& node = nodes[key];
+    unsigned long delta = tick - currentTick;
+    int slot;
+    if (delta < static_cast<unsigned long>(LEVEL0_SLOTS)) {
+        slot = static_cast<int>(tick & (LEVEL0_SLOTS - 1));
+    } else {
+        // Far deadlines park in the coarse level and are re-linked when their group comes up
+        unsigned long horizon = static_cast<unsigned long>(LEVEL0_SLOTS) * LEVEL1_SLOTS - 1;
+        unsigned long placeTick = delta > horizon ? currentTick + horizon : tick;
+        slot = LEVEL0_SLOTS + static_cast<int>((placeTick >> LEVEL0_BITS) & (LEVEL1_SLOTS - 1));
+    }
+    node.tick = tick;
+    node.slot = slot;
+    node.prev = -1;
+    node.next = heads[slot];
+    if (heads[slot] != -1) nodes[heads[slot]].prev = key;
+    heads[slot] = key;
+    ++count;
+}
+
+void TimerWheel::unlink(int key) {
+    Node& node = nodes[key];
+    if (node.slot == -1) return;
+    if (node.prev != -1) nodes[node.prev].next = node.next;
+    else heads[node.slot] = node.next;
+    if (node.next != -1) nodes[node.next].prev = node.prev;
+    node.prev = node.next = node.slot = -1;
+    --count;
+}
+
+void TimerWheel::expire(unsigned long nowMs, std::vector<int>& expired) {
+    unsigned long target = nowMs / TICK_MS;
+    while (currentTick < target) {
+        ++currentTick;
+        if (count == 0) {
+            currentTick = target;
+            break;
+        }
+        if ((currentTick & (LEVEL0_SLOTS - 1)) == 0) {
+            // Entering a new level-1 group: spread its timers over level 0
+            int slot = LEVEL0_SLOTS + static_cast<int>((currentTick >> LEVEL0_BITS) & (LEVEL1_SLOTS - 1));
+            int key = heads[slot];
+            heads[slot] = -1;
+            while (key != -1) {
+                int next = nodes[key].next;
+                unsigned long tick = nodes[key].tick;
+                nodes[key].slot = -1;
+                --count;
+                link(key, tick);
+                key = next;
+            }
+        }
+        int slot = static_cast<int>(currentTick & (LEVEL0_SLOTS - 1));
+        while (heads[slot] != -1) {
+            int key = heads[slot];
+            unlink(key);
+            expired.push_back(key);
+        }
+    }
+}
+
+long TimerWheel::nextTimeoutMs(unsigned long nowMs) const {
+    if (count == 0) return -1;
+    // The next cascade boundary is the latest useful wake-up: level-1 timers of the
+    // following group may be due before anything left in level 0
+    unsigned long dueTick = ((currentTick >> LEVEL0_BITS) + 1) << LEVEL0_BITS;
+    for (unsigned long tick = currentTick + 1; tick < dueTick; ++tick) {
+        if (heads[tick & (LEVEL0_SLOTS - 1)] != -1) {
+            dueTick = tick;
+            break;
+        }
+    }
+    unsigned long dueMs = dueTick * TICK_MS;
+    return dueMs > nowMs ? static_cast<long>(dueMs - nowMs) : 0;
+}
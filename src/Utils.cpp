@@ -3,6 +3,8 @@
 #include <dirent.h>
 #include <cstdio>
 #include <cstring> // For strcmp
+#include <ctime>   // For clock_gettime
+#include <fcntl.h>
 
 // Function to trim whitespace from both ends of a string
 std::string trim(const std::string &str) {
@@ -115,3 +117,23 @@ bool deleteDirectoryRecursively(const std::string& path) {
     closedir(dir);
     return rmdir(path.c_str()) == 0;
 }
+
+// Function to read the monotonic clock in milliseconds (unaffected by wall-clock changes)
+unsigned long monotonicMillis() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<unsigned long>(ts.tv_sec) * 1000UL + static_cast<unsigned long>(ts.tv_nsec / 1000000L);
+}
+
+// Function to create a pipe whose ends are not inherited by exec()ed children; with
+// worker_threads a sibling thread may fork a CGI at any moment
+bool openCloexecPipe(int fds[2]) {
+#ifdef __linux__
+    return pipe2(fds, O_CLOEXEC) == 0;
+#else
+    if (pipe(fds) == -1) return false;
+    fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+    fcntl(fds[1], F_SETFD, FD_CLOEXEC);
+    return true;
+#endif
+}